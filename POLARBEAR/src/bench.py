@@ -0,0 +1,220 @@
+"""Filename: bench.py
+Author: Weiyang Wang
+Description: Benchmark of the gih module, run by `make bench` from the build
+             directory. Interrupts come from the software trigger of the
+             device (irq IRQ_NONE) at the given rate and burst, the data ring
+             is kept full with writev(), and every output engine is run
+             against every sink. For each run it reports
+                 - interrupts fired, missed (no output, e.g. dropped on a
+                   full event queue) and short (less than the write size
+                   sent, the data ring ran dry),
+                 - sustained output throughput,
+                 - emission latency percentiles, interrupt to output start
+                   and interrupt to output end, from the event log.
+             Notice that this script REQUIRES ROOT PERMISSION.
+Date: Oct 14, 2026
+"""
+
+from __future__ import print_function
+import sys
+from sys import stderr
+import argparse
+import select
+import socket
+import threading
+import time
+
+from gih import Gih
+
+
+ENGINES = {'wq': Gih.ENGINE_WQ, 'kthread': Gih.ENGINE_KTHREAD}
+SINKS   = {'file': Gih.SINK_FILE, 'udp': Gih.SINK_UDP, 'mmap': Gih.SINK_MMAP,
+           'aio': Gih.SINK_AIO}
+
+LOG_TIMEOUT = 500                   # ms without logs that ends a run, on
+                                    # top of twice the delay
+POLL_TIMEOUT = 50                   # ms, helper threads check for the end
+
+
+def percentile(values, q):
+    """Value at quantile q of sorted values, 0 if there are none."""
+    if not values:
+        return 0
+    return values[min(len(values) - 1, int(len(values) * q))]
+
+
+def feed(g, size, done):
+    """Keep the data ring of g full until done is set."""
+    bufs   = [bytearray(b'g' * size)] * 16
+    poller = select.poll()
+    poller.register(g.fileno(), select.POLLOUT)
+
+    while not done.is_set():
+        if g.writev(bufs) <= 0:
+            poller.poll(POLL_TIMEOUT)
+
+
+def sinkOutput(g, done):
+    """Drain the output ring of a SINK_MMAP device until done is set."""
+    poller = select.poll()
+    poller.register(g.fileno(), select.POLLIN)
+
+    while not done.is_set():
+        if poller.poll(POLL_TIMEOUT):
+            g.readOutput()
+
+
+def sinkUdp(sock, done):
+    """Drain the datagrams of a SINK_UDP device until done is set."""
+    sock.settimeout(POLL_TIMEOUT / 1000.0)
+
+    while not done.is_set():
+        try:
+            sock.recv(65536)
+        except socket.timeout:
+            pass
+
+
+def countIntr(g, fired, timeout):
+    """Count the interrupt logs of g, until none came for timeout ms. The
+    logs of the previous runs are skipped."""
+    for _ in g.iterLogs(0, chunk = 256, timeout = timeout, tail = True):
+        fired[0] += 1
+
+
+def collectEvents(g, records, timeout):
+    """Collect the event logs of g, until none came for timeout ms. The
+    logs of the previous runs are skipped."""
+    records.extend(g.iterLogs(3, chunk = 256, timeout = timeout,
+                              tail = True))
+
+
+def run(g, args, engine, sink):
+    """One run of engine against sink.
+
+    Returns:
+        dict -- the results, None if the device failed to start
+    """
+    done    = threading.Event()
+    helpers = []
+    sock    = None
+    path    = ''
+
+    if sink in (Gih.SINK_FILE, Gih.SINK_AIO):
+        path = '/dev/null'
+    elif sink == Gih.SINK_UDP:
+        sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        sock.bind(('127.0.0.1', 0))
+        path = '{:s}:{:d}'.format(*sock.getsockname())
+        helpers.append(threading.Thread(target = sinkUdp, args = (sock, done)))
+
+    if not g.configure(start = True, irq = Gih.IRQ_NONE,
+                       delayTime = args.delay, wrtSize = args.size,
+                       keepMissed = 1, path = path, engine = engine,
+                       sink = sink, sync = Gih.SYNC_NEVER,
+                       stage = args.stage):
+        if sock is not None:
+            sock.close()
+        return None
+
+    # an event is only logged once its output ran, a delay after the
+    # interrupt
+    timeout = max(LOG_TIMEOUT, 2 * args.delay + LOG_TIMEOUT)
+    fired   = [0]
+    records = []
+    readers = [threading.Thread(target = countIntr,
+                                args = (g, fired, timeout)),
+               threading.Thread(target = collectEvents,
+                                args = (g, records, timeout))]
+    helpers.append(threading.Thread(target = feed,
+                                    args = (g, args.size, done)))
+    if sink == Gih.SINK_MMAP:
+        helpers.append(threading.Thread(target = sinkOutput, args = (g, done)))
+
+    for t in helpers + readers:
+        t.daemon = True
+        t.start()
+
+    # let the feeder fill the ring, and the log readers open, before the
+    # first interrupt
+    time.sleep(0.1)
+
+    periods = max(1, int(args.rate * args.seconds))
+    g.trigger(period = int(1e9 / args.rate), burst = args.burst,
+              count = periods)
+
+    for t in readers:
+        t.join()
+    done.set()
+    for t in helpers:
+        t.join()
+
+    g.stop()
+    if sock is not None:
+        sock.close()
+
+    start = sorted(r[1] - r[0] for r in records)
+    end   = sorted(r[2] - r[0] for r in records)
+    sent  = sum(r[4] for r in records if r[4] > 0)
+    span  = (records[-1][2] - records[0][0]) if records else 0
+
+    return {'fired':  fired[0],
+            'missed': fired[0] - len(records),
+            'short':  sum(1 for r in records if r[4] < args.size),
+            'mbps':   sent * 1e3 / span if span else 0.0,
+            'start':  [percentile(start, q) / 1e3 for q in (.5, .99, .999)],
+            'end':    [percentile(end, q) / 1e3 for q in (.5, .99, .999)]}
+
+
+def main():
+    parser = argparse.ArgumentParser(description = 'gih benchmark')
+    parser.add_argument('--rate', type = float, default = 1000,
+                        help = 'trigger rate in Hz (default: 1000)')
+    parser.add_argument('--burst', type = int, default = 1,
+                        help = 'interrupts per trigger (default: 1)')
+    parser.add_argument('--seconds', type = float, default = 5,
+                        help = 'length of each run (default: 5)')
+    parser.add_argument('--size', type = int, default = 4096,
+                        help = 'write size in byte (default: 4096)')
+    parser.add_argument('--delay', type = int, default = 0,
+                        help = 'delay time in ms (default: 0)')
+    parser.add_argument('--stage', action = 'store_true',
+                        help = 'stage the payload during the delay')
+    parser.add_argument('--engines', default = 'wq,kthread',
+                        help = 'engines to run (default: wq,kthread)')
+    parser.add_argument('--sinks', default = 'file,udp,mmap,aio',
+                        help = 'sinks to run (default: file,udp,mmap,aio)')
+    parser.add_argument('--module', default = 'gih.ko',
+                        help = 'path of the kernel module (default: gih.ko)')
+    args = parser.parse_args()
+
+    g = Gih(gihPath = args.module)
+    failed = False
+
+    print('{:d} Hz x {:d}, {:d} byte, {:d} ms delay, {:g} s per run'.format(
+        int(args.rate), args.burst, args.size, args.delay, args.seconds))
+    print('{:8s} {:5s} {:>8s} {:>7s} {:>7s} {:>8s}  {:>26s}  {:>26s}'.format(
+        'engine', 'sink', 'fired', 'missed', 'short', 'MB/s',
+        'irq-start p50/p99/p99.9 us', 'irq-end p50/p99/p99.9 us'))
+
+    for e in args.engines.split(','):
+        for s in args.sinks.split(','):
+            res = run(g, args, ENGINES[e], SINKS[s])
+            if res is None:
+                print('{:8s} {:5s} failed to start'.format(e, s), file = stderr)
+                failed = True
+                continue
+
+            print('{:8s} {:5s} {:8d} {:7d} {:7d} {:8.1f}  {:>26s}  {:>26s}'
+                .format(e, s, res['fired'], res['missed'], res['short'],
+                        res['mbps'],
+                        '/'.join('{:.1f}'.format(v) for v in res['start']),
+                        '/'.join('{:.1f}'.format(v) for v in res['end'])))
+
+    g.close()
+    Gih.unload()
+    return 1 if failed else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
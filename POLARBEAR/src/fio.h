@@ -135,35 +135,163 @@ static int file_write(struct file * filp,
  *                                        size_t size)
  *     
  * Description: 
- *     Write @size amount of data from @kfifo_buf to @filp. Creates a buffer to
- *     hold data from @kfifo_buf, than calls file_write() to finish the writing.
+ *     Write @size amount of data from @kfifo_buf to @filp. Data is written 
+ *     straight out of the kfifo's buffer, in at most two contiguous segments
+ *     (the second one only if the data wraps around the end of the buffer),
+ *     so no intermediate copy or per-byte dequeue is done. The kfifo is only 
+ *     advanced by the number of bytes actually accepted by @filp.
  *     
  * Arguments:
  *     @filp: pointer to file to be written to 
- *     @kfifo_buf: pointer to a kfifo struct that holds data.
+ *     @kfifo_buf: pointer to a kfifo struct that holds data, element size
+ *                 must be 1 byte.
  *     @size: amount of data to write
  *     
  * Side Effects:
- *     On success, @size amount of data is written into the file.
+ *     On success, @size amount of data is written into the file and removed
+ *     from @kfifo_buf.
  *     
  * Error Condition: 
- *     This function does not check if @kfifo_buf even has @size amount of 
- *     data in it, therefore does the checking before calling. 
- *     Error when file_write() (vfs_write()) returns error.
+ *     Must only be called by the consumer of @kfifo_buf, with @size no more 
+ *     than the data the producer has published to it. The producer index is
+ *     not looked at here, the caller takes (acquires) it, so a producer that
+ *     publishes its index elsewhere (e.g. a shared ring) works as well.
+ *     Error when file_write() (vfs_write()) returns error, in which case 
+ *     nothing is removed from @kfifo_buf.
  *     
  * Return: 
- *     Returns the result of file_write(filp, data, size)
+ *     Number of bytes written on success, or the error of the first segment.
  */
 static inline int file_write_kfifo(struct file * filp, 
                                    struct kfifo * kfifo_buf,  
                                    size_t size) {
-    size_t put;
-    unsigned char data[size];
-    
-    for (put = 0; put < size; put++)
-        kfifo_get(kfifo_buf, &data[put]);
+    struct __kfifo * fifo = &kfifo_buf->kfifo;
+    unsigned int off;
+    size_t first;
+    int ret;
+    int total;
+
+    if (size == 0)
+        return 0;
+
+    off = fifo->out & fifo->mask;
+    first = min_t(size_t, size, fifo->mask + 1 - off);
+
+    ret = file_write(filp, (unsigned char *)fifo->data + off, first);
+    if (ret <= 0)
+        return ret;
+    total = ret;
+
+    /* second segment, wrapped around to the start of the buffer */
+    if (ret == first && size > first) {
+        ret = file_write(filp, (unsigned char *)fifo->data, size - first);
+        if (ret > 0)
+            total += ret;
+    }
+
+    /* done reading the data before giving the space back */
+    smp_mb();
+    fifo->out += total;
+
+    return total;
+}
+
+/*
+ * Function name: file_read_sequential
+ * 
+ * Function prototype:
+ *     static inline void file_read_sequential(struct file * filp);
+ *     
+ * Description: 
+ *     Has @filp read ahead twice as far as its device does by default, what
+ *     POSIX_FADV_SEQUENTIAL does. Done by hand: vfs_fadvise() isn't there 
+ *     for modules in this kernel, only the syscall.
+ *     
+ * Arguments:
+ *     @filp: the opened file
+ *     
+ * Side Effects:
+ *     The read-ahead window of @filp is doubled, FMODE_RANDOM cleared.
+ *     
+ * Error Condition: 
+ *     None.
+ *     
+ * Return: 
+ *     None.
+ */
+static inline void file_read_sequential(struct file * filp) {
+    struct backing_dev_info * bdi = inode_to_bdi(filp->f_mapping->host);
+
+    filp->f_ra.ra_pages = bdi->ra_pages * 2;
+    spin_lock(&filp->f_lock);
+    filp->f_mode &= ~FMODE_RANDOM;
+    spin_unlock(&filp->f_lock);
+}
+
+/*
+ * Function name: file_read_kfifo
+ * 
+ * Function prototype:
+ *     static inline int file_read_kfifo(struct file * filp, loff_t * pos, 
+ *                                       struct kfifo * kfifo_buf,  
+ *                                       size_t size)
+ *     
+ * Description: 
+ *     Read up to @size bytes of @filp at @pos into the free space of 
+ *     @kfifo_buf, at its producer index. The inverse of file_write_kfifo():
+ *     data is read straight into the kfifo's buffer, in at most two 
+ *     contiguous segments (the second one only if the space wraps around 
+ *     the end of the buffer), with kernel_read(), so the page cache reads 
+ *     ahead of sequential calls as for any reader.
+ *     
+ * Arguments:
+ *     @filp: pointer to file to be read from
+ *     @pos: offset to read at, moved by the bytes read
+ *     @kfifo_buf: pointer to a kfifo struct, element size must be 1 byte.
+ *     @size: amount of data to read, no more than the free space
+ *     
+ * Side Effects:
+ *     On success, the data is in @kfifo_buf past its producer index.
+ *     
+ * Error Condition: 
+ *     Must only be called by the producer of @kfifo_buf. The producer index
+ *     is not moved, the caller publishes the data (e.g. in a shared ring).
+ *     Error when kernel_read() returns error, in which case nothing is read.
+ *     
+ * Return: 
+ *     Number of bytes read on success, 0 at the end of the file, or the 
+ *     error of the first segment.
+ */
+static inline int file_read_kfifo(struct file * filp, loff_t * pos, 
+                                  struct kfifo * kfifo_buf,  
+                                  size_t size) {
+    struct __kfifo * fifo = &kfifo_buf->kfifo;
+    unsigned int off;
+    size_t first;
+    int ret;
+    int total;
+
+    if (size == 0)
+        return 0;
+
+    off = fifo->in & fifo->mask;
+    first = min_t(size_t, size, fifo->mask + 1 - off);
+
+    ret = kernel_read(filp, *pos, (char *)fifo->data + off, first);
+    if (ret <= 0)
+        return ret;
+    total = ret;
+
+    /* second segment, wrapped around to the start of the buffer */
+    if (ret == first && size > first) {
+        ret = kernel_read(filp, *pos + first, (char *)fifo->data, 
+            size - first);
+        if (ret > 0)
+            total += ret;
+    }
 
-    return file_write(filp, data, size);
+    *pos += total;
+    return total;
 }
 
 /*
@@ -182,15 +310,13 @@ static inline int file_write_kfifo(struct file * filp,
  *     On success, synchronize the file.
  *     
  * Error Condition: 
- *     Currently this function does no error checking. I might look into the
- *     source code of vfs_fsync() and add that. 
+ *     Errors of vfs_fsync() are returned.
  *     
  * Return: 
- *     0
+ *     0 on success, -ERRORCODE on failure.
  */
 static inline int file_sync(struct file * filp) {
-    vfs_fsync(filp, 0);
-    return 0;
+    return vfs_fsync(filp, 0);
 }
 
 #endif
@@ -29,9 +29,29 @@
 #include <linux/buffer_head.h>
 #include <linux/fcntl.h>
 #include <linux/ktime.h>
-#include <linux/delay.h>
+#include <linux/hrtimer.h>
 #include <linux/sysfs.h>
 #include <linux/device.h>
+#include <linux/mm.h>
+#include <linux/vmalloc.h>
+#include <linux/wait.h>
+#include <linux/poll.h>
+#include <linux/kthread.h>
+#include <linux/irq.h>
+#include <linux/cpumask.h>
+#include <linux/net.h>
+#include <linux/in.h>
+#include <linux/inet.h>
+#include <linux/uio.h>
+#include <linux/splice.h>
+#include <linux/bio.h>
+#include <linux/backing-dev.h>
+#include <net/net_namespace.h>
+#include <linux/percpu.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/jump_label.h>
+#include <linux/moduleparam.h>
 
 #include <asm/uaccess.h>
 #include <asm/segment.h>
@@ -39,7 +59,14 @@
 #include <asm/io.h>
 
 #include "gih.h"
+#include "place.h"
 #include "fio.h"
+#include "sink.h"
+#include "hist.h"
+#include "stats.h"
+
+#define CREATE_TRACE_POINTS
+#include "gih_trace.h"
 
 /* see each function's header for more detailed documentation */
 
@@ -47,34 +74,224 @@
 static int gih_open(struct inode *, struct file *);
 static int gih_close(struct inode *, struct file *);
 static long gih_ioctl(struct file *, unsigned int, unsigned long);
-static ssize_t gih_write(struct file *, const char __user *, size_t, loff_t *);
+static int gih_write_begin(gih_dev *, bool);
+static ssize_t gih_write_iter(struct kiocb *, struct iov_iter *);
+static ssize_t gih_splice_write(struct pipe_inode_info *, struct file *, 
+                                loff_t *, size_t, unsigned int);
+static int gih_mmap(struct file *, struct vm_area_struct *);
+static unsigned int gih_poll(struct file *, poll_table *);
+static unsigned int gih_ring_free(gih_dev *);
+static void gih_vm_open(struct vm_area_struct *);
+static void gih_vm_close(struct vm_area_struct *);
+static void gih_ring_reset(gih_dev *);
+static unsigned int gih_ring_avail(gih_dev *);
+static void gih_ring_put(struct __kfifo *, unsigned int, const void *, size_t);
+static void gih_ring_peek(struct __kfifo *, unsigned int, void *, size_t);
+static size_t gih_ring_copy_iter(struct __kfifo *, unsigned int, size_t, 
+                                 struct iov_iter *);
+static ssize_t gih_write_frames(gih_dev *, struct iov_iter *);
+static size_t gih_frames_take(gih_dev *, unsigned int, size_t);
+static void gih_frames_align(gih_dev *, unsigned int, size_t);
+static int gih_ring_alloc(gih_dev *, size_t);
+static int gih_ring_move(gih_dev *, int);
+static int gih_resize_logs(gih_dev *, unsigned int);
+static void gih_place(gih_dev *);
+static int gih_apply_config(gih_dev *, const struct gih_config *);
+static int gih_start(gih_dev *);
+static void gih_stop(gih_dev *);
 static irqreturn_t gih_intr(int, void *);
+static enum hrtimer_restart gih_timer_fn(struct hrtimer *);
+static void gih_arm_timer(gih_dev *, ktime_t);
+static void gih_timer_off(gih_dev *);
+static void gih_kick(gih_dev *);
+static int gih_trigger(gih_dev *, const struct gih_trigger *);
+static void gih_trig_fire(gih_dev *, unsigned int);
+static enum hrtimer_restart gih_trig_fn(struct hrtimer *);
+static void gih_trig_stop(gih_dev *);
 static void gih_do_work(struct work_struct *);
+static int gih_engine_fn(void *);
+static int gih_engine_start(gih_dev *);
+static void gih_engine_stop(gih_dev *);
+static void gih_drain(gih_dev *);
+static void gih_emit(gih_dev *, const struct gih_event *);
+static size_t gih_out_size(gih_dev *, size_t);
+static void gih_stage(gih_dev *, const struct gih_event *);
+static void gih_stage_flush(gih_dev *);
+static void gih_set_lead(gih_dev *, s64);
+static void gih_lead_update(gih_dev *, const struct gih_event *, ktime_t);
+static void gih_sync_work(struct work_struct *);
+static void gih_sync_stop(gih_dev *);
+static void gih_aio_work(struct work_struct *);
+static void gih_aio_stop(gih_dev *);
+static int gih_src_start(gih_dev *);
+static void gih_src_stop(gih_dev *);
+static void gih_src_work(struct work_struct *);
 
 struct file_operations gih_fops = {
     .owner              = THIS_MODULE,
-    .write              = gih_write,
+    .write_iter         = gih_write_iter,
+    .splice_write       = gih_splice_write,
     .unlocked_ioctl     = gih_ioctl, 
+    .mmap               = gih_mmap,
+    .poll               = gih_poll,
     .open               = gih_open,
     .release            = gih_close
 };
 
-static gih_dev gih = { 0 };             /* gih device */
+static const struct vm_operations_struct gih_vm_ops = {
+    .open               = gih_vm_open,
+    .close              = gih_vm_close
+};
+
+static gih_mod gih_module = { 0 };      /* all gih instances */
+
+/* number of instances, set on module load */
+static unsigned int instances = GIH_DEF_INSTANCES;
+module_param(instances, uint, S_IRUGO);
+MODULE_PARM_DESC(instances, "number of gih instances (/dev/gihN)");
+
+/* initial ring sizes of every instance, can be changed with ioctl later */
+static unsigned long ring_size = DATA_FIFO_SZ;
+module_param(ring_size, ulong, S_IRUGO);
+MODULE_PARM_DESC(ring_size, "data ring size in bytes, rounded up to 2^n");
+
+static unsigned int log_size = LOG_FIFO_SZ;
+module_param(log_size, uint, S_IRUGO);
+MODULE_PARM_DESC(log_size, "log ring size in logs, rounded up to 2^n, "
+    "per CPU for the interrupt log");
+
+/* verbose logging, flips the static key whenever set */
+DEFINE_STATIC_KEY_FALSE(gih_debug_key);
+
+static int debug_set(const char *, const struct kernel_param *);
+static int debug_get(char *, const struct kernel_param *);
+
+static const struct kernel_param_ops debug_ops = {
+    .set                = debug_set,
+    .get                = debug_get
+};
+
+module_param_cb(debug, &debug_ops, NULL, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(debug, "verbose logging, 0 or 1, can be changed any time");
 
 /* log devices */
 static int log_open(struct inode *, struct file *);
 static int log_close(struct inode *, struct file *);
 static ssize_t log_read(struct file *, char *, size_t, loff_t *);
+static ssize_t log_read_text(log_reader *, char __user *, size_t, loff_t *);
+static ssize_t log_read_bin(log_reader *, char __user *, size_t);
+static long log_ioctl(struct file *, unsigned int, unsigned long);
+static unsigned int log_poll(struct file *, poll_table *);
+static void log_stamp(gih_dev *, struct log *, ktime_t);
+static void log_push(log_dev *, const void *);
+static int log_sprint(log_dev *, const union log_rec *, char *, size_t);
+static int log_ring_alloc(log_dev *, unsigned int);
+static int log_ring_move(log_dev *, int);
+static unsigned int log_pushed(log_dev *);
+static unsigned int log_count(log_reader *);
+static unsigned int log_lapped(log_reader *, int, unsigned int);
+static bool log_peek(log_reader *, int, void *);
+static ssize_t log_read_ring(log_reader *, int, char __user *, size_t);
+static unsigned int log_merge_start(log_reader *);
+static int log_merge_next(log_reader *, void *);
 
 struct file_operations log_fops = {
-    .owner   = THIS_MODULE,
-    .read    = log_read,
-    .open    = log_open,
-    .release = log_close
+    .owner          = THIS_MODULE,
+    .read           = log_read,
+    .unlocked_ioctl = log_ioctl,
+    .poll           = log_poll,
+    .open           = log_open,
+    .release        = log_close
+};
+
+/* latency histograms in debugfs */
+static int hist_open(struct inode *, struct file *);
+static int hist_show(struct seq_file *, void *);
+static ssize_t hist_write(struct file *, const char __user *, size_t, 
+    loff_t *);
+
+static const struct file_operations hist_fops = {
+    .owner          = THIS_MODULE,
+    .open           = hist_open,
+    .read           = seq_read,
+    .write          = hist_write,
+    .llseek         = seq_lseek,
+    .release        = single_release
+};
+
+/* debugfs file names of the histograms, by HIST_* */
+static const char * const hist_names[NUM_HIST] = {
+    "irq_to_start", "start_to_end", "deadline_error"
+};
+
+/* drop accounting in sysfs, gihN/stats/<counter> of the class device */
+static ssize_t stat_show(struct device *, struct device_attribute *, char *);
+
+#define GIH_STAT_ATTR(_name, _stat)                                         \
+    static struct dev_ext_attribute stat_attr_##_name = {                   \
+        __ATTR(_name, S_IRUGO, stat_show, NULL), (void *)(_stat)            \
+    }
+
+GIH_STAT_ATTR(irqs,            GIH_STAT_IRQS);
+GIH_STAT_ATTR(irqs_missed,     GIH_STAT_IRQS_MISSED);
+GIH_STAT_ATTR(emits,           GIH_STAT_EMITS);
+GIH_STAT_ATTR(short_writes,    GIH_STAT_SHORT);
+GIH_STAT_ATTR(bytes_in,        GIH_STAT_BYTES_IN);
+GIH_STAT_ATTR(bytes_out,       GIH_STAT_BYTES_OUT);
+GIH_STAT_ATTR(bytes_full,      GIH_STAT_BYTES_FULL);
+GIH_STAT_ATTR(bytes_discarded, GIH_STAT_BYTES_DISC);
+GIH_STAT_ATTR(bytes_lost,      GIH_STAT_BYTES_LOST);
+GIH_STAT_ATTR(log0_dropped,    GIH_STAT_LOG_DROPS + INTR_LOG_MINOR);
+GIH_STAT_ATTR(log1_dropped,    GIH_STAT_LOG_DROPS + WQ_N_LOG_MINOR);
+GIH_STAT_ATTR(log2_dropped,    GIH_STAT_LOG_DROPS + WQ_X_LOG_MINOR);
+GIH_STAT_ATTR(log3_dropped,    GIH_STAT_LOG_DROPS + EVENT_LOG_MINOR);
+GIH_STAT_ATTR(log4_dropped,    GIH_STAT_LOG_DROPS + AIO_LOG_MINOR);
+
+static struct attribute * stat_attrs[] = {
+    &stat_attr_irqs.attr.attr,
+    &stat_attr_irqs_missed.attr.attr,
+    &stat_attr_emits.attr.attr,
+    &stat_attr_short_writes.attr.attr,
+    &stat_attr_bytes_in.attr.attr,
+    &stat_attr_bytes_out.attr.attr,
+    &stat_attr_bytes_full.attr.attr,
+    &stat_attr_bytes_discarded.attr.attr,
+    &stat_attr_bytes_lost.attr.attr,
+    &stat_attr_log0_dropped.attr.attr,
+    &stat_attr_log1_dropped.attr.attr,
+    &stat_attr_log2_dropped.attr.attr,
+    &stat_attr_log3_dropped.attr.attr,
+    &stat_attr_log4_dropped.attr.attr,
+    NULL
+};
+
+static const struct attribute_group stat_group = {
+    .name           = "stats",
+    .attrs          = stat_attrs
+};
+
+/* lead of the output timer in sysfs, gihN/lead_ns */
+static ssize_t lead_show(struct device *, struct device_attribute *, char *);
+
+static DEVICE_ATTR(lead_ns, S_IRUGO, lead_show, NULL);
+
+static struct attribute * gih_attrs[] = {
+    &dev_attr_lead_ns.attr,
+    NULL
+};
+
+static const struct attribute_group gih_group = {
+    .attrs          = gih_attrs
 };
 
-static log_dev log_devices[3] = { 0 }; /* all the logging device, can be
-                                          accessed by their minor number */
+static const struct attribute_group * gih_groups[] = {
+    &gih_group,
+    &stat_group,
+    NULL
+};
+
+static int gih_setup_instance(unsigned int);
+static void gih_remove_instance(gih_dev *);
 
 /*
  * Function name: gih_open
@@ -98,7 +315,9 @@ static log_dev log_devices[3] = { 0 }; /* all the logging device, can be
  *     @filp:  file pointer of the gih char device 
  *     
  * Side Effects:
- *     On all opening, sets up the data_wait, irq_wq, data_buf and work fields 
+ *     Sets the private_data field of @filp to the gih instance of the minor
+ *     number opened.
+ *     On all opening, sets up the irq_wq, data_buf and work fields 
  *     of the gih device
  *     On non-initial opening, sets up the irq line and opens the destination 
  *     file. Locks the dev_open mutex.
@@ -113,16 +332,19 @@ static log_dev log_devices[3] = { 0 }; /* all the logging device, can be
  */
 static int gih_open(struct inode * inode, struct file * filp) {
 
+    gih_dev * gih = gih_module.devices[iminor(inode)];
+
     /* lock the gih device, it can only be opened once */
-    if (!mutex_trylock(&gih.dev_open)) {return -EBUSY;}
+    if (!mutex_trylock(&gih->dev_open)) {return -EBUSY;}
     
-    printk(KERN_ALERT "[gih] Opening gih device...\n");
+    printk(KERN_ALERT "[gih] Opening gih device %u...\n", gih->index);
+
+    filp->private_data = gih;
 
     /* set up necessary fields */
-    atomic_set(&gih.data_wait, 0);
-    gih.irq_wq = create_workqueue(IRQ_WQ_NAME);
-    kfifo_reset(&gih.data_buf);
-    INIT_WORK(&gih.work, gih_do_work);
+    gih->irq_wq = create_workqueue(IRQ_WQ_NAME);
+    gih_ring_reset(gih);
+    INIT_WORK(&gih->work, gih_do_work);
 
     printk(KERN_ALERT "[gih] Remember to start the device with ioctl after "
         "configuration.\n");
@@ -131,14 +353,14 @@ static int gih_open(struct inode * inode, struct file * filp) {
 
     // /* otherwise, set up the dest. file and irq */
     // else {
-    //     error = request_irq(gih.irq, gih_intr, IRQF_SHARED,
-    //         IRQ_NAME, (void*)&gih);
+    //     error = request_irq(gih->irq, gih_intr, IRQF_SHARED,
+    //         IRQ_NAME, (void*)gih);
     //     if (error < 0) {
     //         printk(KERN_ALERT "[gih] IRQ REQUEST ERROR: %d\n", error);
     //         return error;
     //     }
     //
-    //     gih.dest_filp = file_open(gih.path, O_WRONLY, S_IRWXUGO);
+    //     gih->dest_filp = file_open(gih->path, O_WRONLY, S_IRWXUGO);
     // }
     // 
     return 0;
@@ -154,7 +376,7 @@ static int gih_open(struct inode * inode, struct file * filp) {
  *     Close the gih device. If the device is running (i.e. setup is true),
  *     gih_close() will release the irq line, close the dest. file, and 
  *     flushes/destroys the workqueue. If there're still data left in the 
- *     gih device (data_wait != 0), depending on keep_missed, gih_close() will
+ *     gih device, depending on keep_missed, gih_close() will
  *     either discard all the data or dump them all at once
  *     
  * Arguments:
@@ -162,9 +384,12 @@ static int gih_open(struct inode * inode, struct file * filp) {
  *     @filp:  file pointer of the gih char device 
  *     
  * Side Effects:
- *     Frees the registered irq, flushes then destroys the workqueue, and
+ *     Stops the software trigger, frees the registered irq, cancels the 
+ *     pending output timer, 
+ *     flushes then destroys the workqueue, and
  *     write all the data left into the destination file and close it
- *     if gih is running or discard them. Print a message if it's not running.
+ *     if gih is running or discard them. The file is synced before closing
+ *     unless the sync policy is never. Print a message if it's not running.
  *     Unlock the opening lock.
  *     
  * Error Condition: 
@@ -176,825 +401,4750 @@ static int gih_open(struct inode * inode, struct file * filp) {
  */
 static int gih_close(struct inode * inode, struct file * filp) {
 
+    gih_dev * gih = filp->private_data;
     int copied = 0;
-    size_t dwait;
+    unsigned int dwait;
 
-    printk(KERN_ALERT "[gih] Releasing gih device...\n");
+    printk(KERN_ALERT "[gih] Releasing gih device %u...\n", gih->index);
 
     /* if the device is not functioning, print the necessary message */
-    if (!gih.setup) {
+    if (!gih->setup) {
         printk(KERN_ALERT "[gih] Device hasn't been setup.\n");
-        destroy_workqueue(gih.irq_wq);
-        mutex_unlock(&gih.dev_open);
+        destroy_workqueue(gih->irq_wq);
+        mutex_unlock(&gih->dev_open);
         return 0;
     }
 
     /* otherwise, release whatever should be released */
-    if (gih.setup) {
-        free_irq(gih.irq, (void*)&gih);
-        flush_workqueue(gih.irq_wq);
-        gih.setup = FALSE;      
+    if (gih->setup) {
+        gih_trig_stop(gih);
+        if (gih->irq != GIH_IRQ_NONE) free_irq(gih->irq, (void*)gih);
+        gih_timer_off(gih);
+        gih_engine_stop(gih);
+        flush_workqueue(gih->irq_wq);
+        gih_stage_flush(gih);
+        gih_aio_stop(gih);
+        gih_src_stop(gih);
+        gih->setup = FALSE;      
     }
-    destroy_workqueue(gih.irq_wq);
+    destroy_workqueue(gih->irq_wq);
 
 
-    mutex_lock(&gih.wrt_lock);
+    /* the output is stopped, and no producer is left on a closing file */
 
-    /* if we should remove all missed data, reset kfifo */
-    if (!gih.keep_missed) {
-        kfifo_reset(&gih.data_buf);
-        atomic_set(&gih.data_wait, 0);
+    /* if we should remove all missed data, reset kfifo; played back data 
+       is only read ahead, not missed */
+    if (gih->source[0])
+        gih_ring_reset(gih);
+
+    else if (!gih->keep_missed) {
+        stat_add(gih->stats, GIH_STAT_BYTES_DISC, gih_ring_avail(gih));
+        gih_ring_reset(gih);
     }
 
     else {
         /* this would result as dumping all unsent data, skipping the intr */
 
-        dwait = atomic_read(&gih.data_wait);
-        copied = file_write_kfifo(gih.dest_filp, &gih.data_buf, dwait);
+        dwait = gih_ring_avail(gih);
+        copied = sink_flush_kfifo(&gih->sink, &gih->data_buf, dwait);
 
         if  (copied < 0) {
+            stat_add(gih->stats, GIH_STAT_BYTES_LOST, dwait);
             printk(KERN_ALERT "[gih] ERROR writing the rest of data\n");
         } 
 
         else if (copied != dwait) {
+            stat_add(gih->stats, GIH_STAT_BYTES_OUT, copied);
+            stat_add(gih->stats, GIH_STAT_BYTES_LOST, dwait - copied);
             printk(KERN_ALERT 
-                "[gih] WARNING: data lose occurred, %zu bytes lost\n", 
+                "[gih] WARNING: data lose occurred, %u bytes lost\n", 
                 dwait - copied);
             copied = 0;
         }
-    }
 
-    mutex_unlock(&gih.wrt_lock);
+        else
+            stat_add(gih->stats, GIH_STAT_BYTES_OUT, copied);
+    }
 
-    file_close(gih.dest_filp);
-    gih.dest_filp = NULL;
+    gih_sync_stop(gih);
+    sink_close(&gih->sink);
 
-    mutex_unlock(&gih.dev_open);
+    mutex_unlock(&gih->dev_open);
     return copied;
 }
 
 /*
- * Function name: gih_write
+ * Function name: gih_write_begin
+ * 
+ * Function prototype:
+ *     static int gih_write_begin(gih_dev * gih, bool discard);
+ *     
+ * Description: 
+ *     Readies the data ring for a write: continues from where a former mmap
+ *     feeder left it and, if @discard and missed data is not kept, has the
+ *     next output drop all the data queued so far.
+ *     
+ * Arguments:
+ *     @gih:     the gih instance
+ *     @discard: drop the missed data for this write
+ *     
+ * Side Effects:
+ *     The producer index of data_buf may move, discard_to and discard_seq 
+ *     are set for a discard.
+ *     
+ * Error Condition: 
+ *     While mapped or played back from a source, returns -EBUSY and nothing
+ *     is changed. Caller needs to hold wrt_lock.
+ *     
+ * Return: 
+ *     0 on success, -ERRORCODE on failure.
+ */
+static int gih_write_begin(gih_dev * gih, bool discard) {
+
+    unsigned int head;
+
+    if (atomic_read(&gih->mapped) || gih->src_filp) {return -EBUSY;}
+
+    /* continue from where a former mmap feeder left the ring */
+    head = READ_ONCE(gih->ring_ctrl->head);
+    if (head - READ_ONCE(gih->data_buf.kfifo.out) <= kfifo_size(&gih->data_buf))
+        gih->data_buf.kfifo.in = head;
+
+    /* if we should remove all missed data, have the output drop it; the 
+       producer can't touch the consumer index */
+    if (discard && !gih->keep_missed) {
+        WRITE_ONCE(gih->discard_to, gih->data_buf.kfifo.in);
+        smp_store_release(&gih->discard_seq, gih->discard_seq + 1);
+    }
+
+    return 0;
+}
+
+/*
+ * Function name: gih_write_iter
  * 
  * Function prototype:
- *     static ssize_t gih_write(struct file * filp, 
- *                              const char __user * buffer, 
- *                              size_t len, 
- *                              loff_t * offset)
+ *     static ssize_t gih_write_iter(struct kiocb * iocb, 
+ *                                   struct iov_iter * from)
  *     
  * Description: 
  *     Write data to the gih device. gih will hold these data until an interrupt
  *     occurs, and send the specified amount of data to the destination file 
  *     after a specified delay time. 
+ *     Serves both write() and writev(): all the buffers of a writev() are 
+ *     one write, copied into the ring under one lock, and with missed data 
+ *     not kept only the data before the whole call is dropped. A bvec 
+ *     iterator is a pipe-full of a splice, which dropped the missed data 
+ *     once for all its pipe-fulls (see gih_splice_write()).
+ *     In frame mode each buffer is queued as one frame, see 
+ *     gih_write_frames().
  *     
  * Arguments:
- *     @filp:   file pointer of the gih char device 
- *     @buffer: incoming data buffer from user space
- *     @len   : length of the incoming data
- *     @offset: offset into the gih device
+ *     @iocb:   the I/O control block, ki_filp is the gih char device
+ *     @from:   incoming data buffers from user space
  *     
  * Side Effects:
- *     Locks the writing lock on buffer while executing.
+ *     Locks the writing lock while executing, which only serializes the 
+ *     producers; the output never takes it, the data is handed over through
+ *     the producer index only (see struct gih_ring_ctrl).
  *     Data will be copied to the data_buf in gih_device (implemented by kfifo).
+ *     The producer index in the shared control page is updated.
+ *     If missed data is not kept, all data before this write is marked to be
+ *     dropped by the next output.
  *     
  * Error Condition: 
  *     If kfifo is full / have less space then len, only part of the incoming
- *     data will be accepted into the buffer.
+ *     data will be accepted into the buffer. Data marked to be dropped still 
+ *     takes space until the next output drops it.
+ *     While the data ring is mmap-ed, the mapping is the only producer and 
+ *     writing will return -EBUSY; so while played back from a source (see 
+ *     gih_src_work()).
+ *     A faulting buffer stops the copy there, -EFAULT if nothing was copied.
+ *     For frame mode, see gih_write_frames().
  *     
  * Return: 
- *     number of bytes copied to data_buf on success,
+ *     number of bytes copied to data_buf on success (payload only in frame
+ *     mode),
  *     -ERRORCODE on failure.
  */
-static ssize_t gih_write(struct file * filp, 
-                         const char __user * buffer, 
-                         size_t len, 
-                         loff_t * offset) {
+static ssize_t gih_write_iter(struct kiocb * iocb, struct iov_iter * from) {
 
-    int copied;
+    gih_dev * gih = iocb->ki_filp->private_data;
+    struct __kfifo * fifo = &gih->data_buf.kfifo;
+    size_t len = iov_iter_count(from);
+    size_t copied;
     size_t length;
     size_t avail;
+    unsigned int in;
+    ssize_t ret;
+
+    mutex_lock(&gih->wrt_lock);
 
-    if (DEBUG) printk(KERN_ALERT "[gih] Entering write function...\n");
+    ret = gih_write_begin(gih, !(from->type & ITER_BVEC));
+    if (ret) {
+        mutex_unlock(&gih->wrt_lock);
+        return ret;
+    }
 
-    mutex_lock(&gih.wrt_lock);
+    in = fifo->in;
 
-    /* if we should remove all missed data, reset kfifo */
-    if (!gih.keep_missed) {
-        kfifo_reset(&gih.data_buf);
-        atomic_set(&gih.data_wait, 0);
+    /* whole frames only, see GIH_MODE_FRAMES */
+    if (gih->mode == GIH_MODE_FRAMES) {
+        ret = gih_write_frames(gih, from);
+        goto publish;
     }
 
     /* check how much space is still left */
-    if ((avail = kfifo_avail(&gih.data_buf)) < len - 1) 
-        printk(KERN_ALERT "[gih] WARNING: gih buffer is full, "
+    if ((avail = kfifo_avail(&gih->data_buf)) < len) {
+        trace_gih_overflow(gih->index, GIH_OVF_DATA, len - avail);
+        stat_add(gih->stats, GIH_STAT_BYTES_FULL, len - avail);
+        printk_ratelimited(KERN_ALERT "[gih] WARNING: gih buffer is full, "
             "%zu byte not written in this call.\n", len - avail);
+    }
 
     length = min(len, avail);
-    
-    kfifo_from_user(&gih.data_buf, buffer, length, &copied);
 
-    /* TODO: is atomic really more efficient here??? */
-    *offset = atomic_add_return(copied, &gih.data_wait);
+    copied = gih_ring_copy_iter(fifo, fifo->in, length, from);
+    fifo->in += copied;
 
-    mutex_unlock(&gih.wrt_lock);
+    ret = (!copied && length) ? -EFAULT : copied;
 
-    if (DEBUG) {
-        printk(KERN_ALERT "[gih] %d bytes written to gih.\n", copied);
-        printk(KERN_ALERT "[gih] data_buf kfifo length is %d", 
-            kfifo_len(&gih.data_buf));
-        printk(KERN_ALERT "[gih] data_wait is %lld", *offset);
-    }
+publish:
+    smp_store_release(&gih->ring_ctrl->head, fifo->in);
 
-    return copied;
+    trace_gih_write_enqueued(gih->index, fifo->in - in, 
+        gih->data_buf.kfifo.in - READ_ONCE(gih->data_buf.kfifo.out));
+    stat_add(gih->stats, GIH_STAT_BYTES_IN, fifo->in - in);
+
+    mutex_unlock(&gih->wrt_lock);
+
+    return ret;
 }
 
 /*
- * Function name: gih_ioctl 
+ * Function name: gih_splice_write
  * 
  * Function prototype:
- *     static long gih_ioctl(struct file * filp, 
- *                           unsigned int cmd, 
- *                           unsigned long arg)
+ *     static ssize_t gih_splice_write(struct pipe_inode_info * pipe, 
+ *                                     struct file * out, loff_t * ppos, 
+ *                                     size_t len, unsigned int flags)
  *     
  * Description: 
- *     All ioctl commands are used to configure the gih device on its first 
- *     opening. There're four fields that user NEEDS TO specify: 
- *         -irq number to be registered
- *         -delay time before data is send out to destination file
- *         -amount of data to send out upon receive each interrupt
- *         -path of the destination file
- *     AFTER all these fields are set, call the last GIH_IOC_CONFIG_START case
- *     to finish configuration and start the gih device. GIH_IOC_CONFIG_START
- *     will register irq and open the destination file, which the gih_open() 
- *     function will not do on first opening.
- *     If wanted to reconfigure the device, call GIH_IOC_CONFIG_STOP to unset
- *     the device.
+ *     splice() from a pipe, and sendfile() from a file, into the gih device:
+ *     the data goes from the pages of the pipe, or of the page cache, into 
+ *     the data ring with one copy, without going through user space. The 
+ *     buffers of the pipe are handed to gih_write_iter() as a bvec iterator
+ *     per pipe-full, so a transfer larger than the pipe is several writes; 
+ *     the missed data is dropped here once for the whole call, as for a 
+ *     writev(), and not by each of them.
+ *     The pages aren't kept by reference: the ring is contiguous and shared
+ *     with a mmap feeder and the sinks, the data has to be in it.
  *     
  * Arguments:
- *     @filp: file pointer of the gih char device
- *     @cmd:  ioctl command to be performed
- *     @arg:  argument passed to a specified ioctl (might be a pointer)
+ *     @pipe:  the pipe holding the data
+ *     @out:   file pointer of the gih char device
+ *     @ppos:  offset into @out, not used
+ *     @len:   bytes to take at most
+ *     @flags: SPLICE_F_*
  *     
  * Side Effects:
- *     For each entry, set the specified field to arg on success.
- *     Starts the gih device if is GIH_IOC_CONFIG_START,
- *     Stpps the device if if is GIH_IOC_CONFIG_STOP.
+ *     See gih_write_iter(). The bytes taken are consumed from @pipe.
  *     
  * Error Condition: 
- *     Trying to configure the device while it's running will result in -EBUSY.
- *     Invalid arguments to ioctl will result in -EINVAL.
- *     Specific errors will result in its -ERRORCODE.
- *
+ *     In frame mode, buffers of a pipe aren't frames of the feeder, will 
+ *     return -EINVAL. Otherwise as gih_write_iter(), the data left over for
+ *     a full ring stays in the pipe.
+ *     
  * Return: 
- *     0 on success, -ERRORCODE on failure.
+ *     number of bytes taken on success, -ERRORCODE on failure.
  */
-static long gih_ioctl(struct file * filp, 
-                      unsigned int cmd, 
-                      unsigned long arg) {
-
-    int length;
-    int error = 0;
-
-    switch (cmd) {
-
-        /* irq */
-        case GIH_IOC_CONFIG_IRQ:
-            if (gih.setup) {
-                printk(KERN_ALERT "[gih] ERROR setting IRQ: device running.\n");
-                error = -EBUSY;
-            }
-
-            else {
-                if ((int)arg < 0) {
-                    printk(KERN_ALERT "[gih] ERROR: IRQ "
-                            "needs to be positive.\n");
-                    error = -EINVAL;
-                    break;
-                }
-
-                error = 0;
-                gih.irq = (int)arg;
-
-                if (DEBUG) 
-                    printk(KERN_ALERT "[gih] irq configured to %d\n", gih.irq);
-            }
-            break;
-
-
-        /* delay time in milliseconds */
-        case GIH_IOC_CONFIG_DELAY_T:
-            if (gih.setup) {
-                printk(KERN_ALERT "[gih] ERROR setting delay time: "
-                    "device running.\n");
-                error = -EBUSY;
-            }
-
-            else {
-                if ((int)arg < 0) {
-                    printk(KERN_ALERT "[gih] ERROR: delay time "
-                            "needs to be non-negative.\n");
-                    error = -EINVAL;
-                    break;
-                }
-
-                error = 0;
-                gih.sleep_msec = (unsigned int)arg;
-
-                if (DEBUG) 
-                    printk(KERN_ALERT "[gih] delay time configured to %u\n", 
-                        gih.sleep_msec);
-            }
-            
-            break;
-
-
-        /* amount of data to send on each interrupt */
-        case GIH_IOC_CONFIG_WRT_SZ:
-            if (gih.setup) {
-                printk(KERN_ALERT "[gih] ERROR setting write size: "
-                    "device running.\n");
-                error = -EBUSY;
-            }
-
-            else {
-                if ((int)arg <= 0) {
-                    printk(KERN_ALERT "[gih] ERROR: writing size "
-                            "needs to be positive.\n");
-                    error = -EINVAL;
-                    break;
-                }
-
-                error = 0;
-                gih.write_size = (size_t)arg;
-
-                if (DEBUG) 
-                    printk(KERN_ALERT "[gih] write size configured to %zu\n",
-                        gih.write_size);
-            }
-            
-            break;
-
-
-        /* path of the destination file */
-        case GIH_IOC_CONFIG_PATH:
-            if (gih.setup) {
-                printk(KERN_ALERT "[gih] ERROR setting destination path: "
-                    "device running.\n");
-                error = -EBUSY;
-            }
-            
-            else {
-                error = 0;
-                length = strlen((const char *)arg);
-
-                if (length > PATH_MAX_LEN - 1)
-                    return -EINVAL;
-
-                strncpy(gih.path, (const char *)arg, length);
-                gih.path[length] = '\0';
-
-                if (DEBUG) 
-                    printk(KERN_ALERT "[gih] Destination path configured "
-                            "to %s\n", gih.path);
-
-            }
-
-            break;
-
-
-        /* make sure to only call this after configuration */
-        case GIH_IOC_CONFIG_START:
-            if (gih.setup) {
-                printk(KERN_ALERT "[gih] ERROR: device already running.\n");
-                error = -EBUSY;
-            }
-            else {
-                error = 0;
-
-                if (DEBUG) printk(KERN_ALERT "[gih] Finishing configuration\n");
-
-                /* set the irq */
-                error = request_irq(gih.irq, gih_intr, IRQF_SHARED,
-                    IRQ_NAME, (void*)&gih);
-
-                if (error < 0) {
-                    printk(KERN_ALERT "[gih] IRQ REQUEST ERROR: %d\n", error);
-                    return error;
-                }
-            
-                gih.dest_filp = file_open(gih.path, O_WRONLY | O_NONBLOCK, 
-                    S_IALLUGO);
-
-                if (!gih.dest_filp) {
-                    printk(KERN_ALERT "[gih] ERROR setting destination path: "
-                            "file openeing failed.\n");
-                    error = -EBADF;
-                    break;
-                }
-
-                gih.setup = TRUE;
-                printk(KERN_ALERT "[gih] Configuration finished, "
-                        "device started.\n");
-
-            }
-            
-            break;
-
-
-        /* this allows reconfiguration. Release irq. */
-        case GIH_IOC_CONFIG_STOP:
-            if (!gih.setup) {
-                printk(KERN_ALERT "[gih] ERROR: device is not running.\n");
-                error = -EBUSY;
-            }
-
-            else {
-                error = 0;
-                
-                free_irq(gih.irq, (void*)&gih);
-                flush_workqueue(gih.irq_wq);
-                
-                file_close(gih.dest_filp);
-                gih.dest_filp = NULL;
-
-                gih.setup = FALSE;
-                printk(KERN_ALERT "[gih] Device stopped running, "
-                    "reconfiguration available.\n");
-            }
-            
-            break;
-
-
-        /* keep missed data or not */
-        case GIH_IOC_CONFIG_MISS:
-            if (gih.setup) {
-                printk(KERN_ALERT "[gih] ERROR setting missed data behavior: "
-                    "device running.\n");
-                error = -EBUSY;
-            }
-
-            else {
+static ssize_t gih_splice_write(struct pipe_inode_info * pipe, 
+                                struct file * out, loff_t * ppos, 
+                                size_t len, unsigned int flags) {
 
-                error = 0;
-                gih.keep_missed = ((int)arg == 0) ? FALSE : TRUE;
+    gih_dev * gih = out->private_data;
+    int error;
 
-                if (DEBUG) 
-                    printk(KERN_ALERT "[gih] keep missed data: %d\n",
-                        gih.keep_missed);
-            }
-            
-            break;
+    if (gih->mode == GIH_MODE_FRAMES) {return -EINVAL;}
 
+    mutex_lock(&gih->wrt_lock);
+    error = gih_write_begin(gih, TRUE);
+    mutex_unlock(&gih->wrt_lock);
 
-        default:
-            return -EINVAL;
-    }
+    if (error) {return error;}
 
-    return error;
+    return iter_file_splice_write(pipe, out, ppos, len, flags);
 }
 
 /*
- * Function name: gih_do_work
+ * Function name: gih_mmap
  * 
  * Function prototype:
- *     static void gih_do_work(struct work_struct * work);
+ *     static int gih_mmap(struct file * filp, struct vm_area_struct * vma);
  *     
  * Description: 
- *     Work function to execute for the work queue, which does the work of 
- *     sending data that was buffered in the gih device to the destination file
- *     This function also generates two log, one on entering the wq, the other
- *     on exiting the wq, and are stored in the gihlog1 and gihlog2 device. 
- *     When debug is turned on, user can examine the performance of the gih 
- *     device from the debug output generated in this function.
+ *     Map the data ring of the gih device into user space. The mapping starts
+ *     with the control page (struct gih_ring_ctrl, see gih.h), followed by the
+ *     data ring at offset data_off. A user feeder writes payloads in place 
+ *     at head & (size - 1), then publishes the new head; the output consumes
+ *     from the same pages and publishes tail. This saves the copy and the
+ *     syscall of gih_write_iter().
+ *     At offset GIH_MMAP_OUT_OFF, the output ring of the mmap sink is mapped
+ *     instead, see sink_mmap().
  *     
  * Arguments:
- *     @work: work structure that is put on the work queue.
+ *     @filp: file pointer of the gih char device
+ *     @vma:  virtual memory area to map the ring into
  *     
  * Side Effects:
- *     Output at least the specified amount of data (write_size) to the 
- *     destination file. Write two logs to the wq_n_log and wq_x_log device.
+ *     The ring is mapped to @vma. While mapped, gih_write_iter() is disabled.
  *     
  * Error Condition: 
- *     If wrt_lock is contently locked, this function will be blocked.
+ *     Mapping with another offset, or larger than the control page plus the
+ *     data ring, will return -EINVAL.
+ *     While played back from a source, will return -EBUSY.
  *     
  * Return: 
- *     No return value.
+ *     0 on success, -ERRORCODE on failure.
  */
-static void gih_do_work(struct work_struct * work) {
+static int gih_mmap(struct file * filp, struct vm_area_struct * vma) {
 
-    size_t n_out_byte;            /* number of byte to output */
-    size_t out = 0;               /* number of byte actually outputted */
-    struct log exit;
-    struct log entry;
+    gih_dev * gih = filp->private_data;
+    int error;
+    unsigned long size = vma->vm_end - vma->vm_start;
 
-    if (DEBUG) printk(KERN_ALERT "[gih] Entering work queue function...\n");
+    /* the output ring of the mmap sink */
+    if (vma->vm_pgoff == GIH_MMAP_OUT_OFF >> PAGE_SHIFT)
+        return sink_mmap(&gih->sink, vma);
 
-    do_gettimeofday(&entry.time);
+    /* the ring can't be resized while we map it */
+    mutex_lock(&gih->wrt_lock);
 
-    mutex_lock(&gih.wrt_lock);
+    if (vma->vm_pgoff != 0 || 
+        size > PAGE_SIZE + kfifo_size(&gih->data_buf)) {
+        mutex_unlock(&gih->wrt_lock);
+        return -EINVAL;
+    }
 
-    n_out_byte = min((size_t)kfifo_len(&gih.data_buf), gih.write_size);
+    /* the playback source is the producer */
+    if (gih->src_filp) {
+        mutex_unlock(&gih->wrt_lock);
+        return -EBUSY;
+    }
+
+    error = remap_vmalloc_range(vma, gih->ring_ctrl, 0);
+    if (error) {
+        mutex_unlock(&gih->wrt_lock);
+        printk(KERN_ALERT "[gih] ERROR: mapping data ring failed: %d\n", 
+            error);
+        return error;
+    }
+
+    vma->vm_ops = &gih_vm_ops;
+    vma->vm_private_data = gih;
+    gih_vm_open(vma);
+
+    mutex_unlock(&gih->wrt_lock);
+
+    if (GIH_DEBUG) 
+        printk(KERN_ALERT "[gih] data ring mapped, %lu bytes\n", size);
+
+    return 0;
+}
+
+/*
+ * Function name: gih_vm_open
+ * 
+ * Function prototype:
+ *     static void gih_vm_open(struct vm_area_struct * vma);
+ *     
+ * Description: 
+ *     Called whenever a mapping of the data ring is created (including on 
+ *     fork/split), counts the mappings.
+ *     
+ * Arguments:
+ *     @vma: the new mapping
+ *     
+ * Side Effects:
+ *     Increments the mapped count of gih.
+ *     
+ * Error Condition: 
+ *     None.
+ *     
+ * Return: 
+ *     None.
+ */
+static void gih_vm_open(struct vm_area_struct * vma) {
+    gih_dev * gih = vma->vm_private_data;
+    atomic_inc(&gih->mapped);
+}
+
+/*
+ * Function name: gih_vm_close
+ * 
+ * Function prototype:
+ *     static void gih_vm_close(struct vm_area_struct * vma);
+ *     
+ * Description: 
+ *     Called whenever a mapping of the data ring is removed.
+ *     
+ * Arguments:
+ *     @vma: the removed mapping
+ *     
+ * Side Effects:
+ *     Decrements the mapped count of gih, re-enabling gih_write_iter() with 
+ *     the last one.
+ *     
+ * Error Condition: 
+ *     None.
+ *     
+ * Return: 
+ *     None.
+ */
+static void gih_vm_close(struct vm_area_struct * vma) {
+    gih_dev * gih = vma->vm_private_data;
+    atomic_dec(&gih->mapped);
+}
+
+/*
+ * Function name: gih_poll
+ * 
+ * Function prototype:
+ *     static unsigned int gih_poll(struct file * filp, poll_table * wait);
+ *     
+ * Description: 
+ *     poll/select/epoll on the gih device. The device is writable once the 
+ *     data ring has at least low_wat bytes free (GIH_IOC_CONFIG_LOW_WAT); 
+ *     the output wakes pollers up as it frees space. Free space is taken 
+ *     from the indices of the control page, so this also works for a mmap 
+ *     feeder. With the mmap sink, the device is readable while the output 
+ *     ring holds data.
+ *     
+ * Arguments:
+ *     @filp: file pointer of the gih char device
+ *     @wait: poll table
+ *     
+ * Side Effects:
+ *     The caller is added to the wrt_wait and the sink's read_wait queue.
+ *     
+ * Error Condition: 
+ *     None.
+ *     
+ * Return: 
+ *     POLLOUT | POLLWRNORM if writable, POLLIN | POLLRDNORM if readable.
+ */
+static unsigned int gih_poll(struct file * filp, poll_table * wait) {
+
+    gih_dev * gih = filp->private_data;
+    unsigned int low_wat;
+    unsigned int mask = 0;
+
+    poll_wait(filp, &gih->wrt_wait, wait);
+    poll_wait(filp, &gih->sink.read_wait, wait);
+
+    /* a ring smaller than the mark is writable when empty */
+    low_wat = min(gih->low_wat, kfifo_size(&gih->data_buf));
+
+    if (gih_ring_free(gih) >= low_wat) {mask |= POLLOUT | POLLWRNORM;}
+
+    /* output to read from the output ring */
+    if (sink_readable(&gih->sink)) {mask |= POLLIN | POLLRDNORM;}
+
+    return mask;
+}
+
+/*
+ * Function name: gih_ring_free
+ * 
+ * Function prototype:
+ *     static unsigned int gih_ring_free(gih_dev * gih);
+ *     
+ * Description: 
+ *     Free space of the data ring, as published in the control page: head 
+ *     by the producer (gih_write_iter() or a mmap feeder), tail by the output.
+ *     
+ * Arguments:
+ *     @gih: the gih instance
+ *     
+ * Side Effects:
+ *     None.
+ *     
+ * Error Condition: 
+ *     An inconsistent head from a mmap feeder reads as a full ring.
+ *     
+ * Return: 
+ *     Number of free bytes in the data ring.
+ */
+static unsigned int gih_ring_free(gih_dev * gih) {
+
+    unsigned int size = kfifo_size(&gih->data_buf);
+    unsigned int used = READ_ONCE(gih->ring_ctrl->head) - 
+                        READ_ONCE(gih->ring_ctrl->tail);
+
+    return used > size ? 0 : size - used;
+}
+
+/*
+ * Function name: gih_ring_reset
+ * 
+ * Function prototype:
+ *     static void gih_ring_reset(gih_dev * gih);
+ *     
+ * Description: 
+ *     Empties the data ring, both the kfifo and the indices in the shared 
+ *     control page.
+ *     
+ * Arguments:
+ *     @gih: the gih instance
+ *     
+ * Side Effects:
+ *     All data in the ring is discarded.
+ *     
+ * Error Condition: 
+ *     Touches both ends of the ring, so neither a producer nor the output may
+ *     be running.
+ *     
+ * Return: 
+ *     None.
+ */
+static void gih_ring_reset(gih_dev * gih) {
+    kfifo_reset(&gih->data_buf);
+    WRITE_ONCE(gih->ring_ctrl->tail, 0);
+    WRITE_ONCE(gih->ring_ctrl->head, 0);
+    gih->discard_to = 0;
+    gih->discard_seen = gih->discard_seq;
+}
+
+/*
+ * Function name: gih_ring_avail
+ * 
+ * Function prototype:
+ *     static unsigned int gih_ring_avail(gih_dev * gih);
+ *     
+ * Description: 
+ *     Consumer side of the data ring. Takes the producer index published in 
+ *     the control page, by gih_write_iter() or a mmap feeder, and drops the 
+ *     data a producer asked to discard. The index is only taken if it's 
+ *     consistent with the ring, i.e. doesn't claim more data than the ring 
+ *     holds.
+ *     
+ * Arguments:
+ *     @gih: the gih instance
+ *     
+ * Side Effects:
+ *     data_buf's out index may be advanced over discarded data.
+ *     
+ * Error Condition: 
+ *     An inconsistent head reads as an empty ring. Must only be called by the
+ *     output, the single consumer.
+ *     
+ * Return: 
+ *     Number of bytes available to the output.
+ */
+static unsigned int gih_ring_avail(gih_dev * gih) {
+
+    unsigned int head, seq, discard;
+    unsigned int out = gih->data_buf.kfifo.out;
+
+    /* the discard mark is published before a newer head, take it first so
+       the mark never lies beyond the head read below */
+    seq = smp_load_acquire(&gih->discard_seq);
+    discard = READ_ONCE(gih->discard_to);
+
+    /* data written by the producer is visible once head is */
+    head = smp_load_acquire(&gih->ring_ctrl->head);
+
+    if (head - out > kfifo_size(&gih->data_buf)) {return 0;}
+
+    if (seq != gih->discard_seen) {
+        gih->discard_seen = seq;
+
+        if (discard - out <= head - out) {
+            stat_add(gih->stats, GIH_STAT_BYTES_DISC, discard - out);
+            gih->data_buf.kfifo.out = discard;
+            out = discard;
+        }
+    }
+
+    return head - out;
+}
+
+/*
+ * Function name: gih_ring_put / gih_ring_peek
+ * 
+ * Function prototype:
+ *     static void gih_ring_put(struct __kfifo * fifo, unsigned int idx, 
+ *                              const void * src, size_t len);
+ *     static void gih_ring_peek(struct __kfifo * fifo, unsigned int idx, 
+ *                               void * dst, size_t len);
+ *     
+ * Description: 
+ *     Copies @len bytes from @src into the data ring at index @idx, or from
+ *     the ring at @idx into @dst, wrapping around the end of the ring. 
+ *     Neither index of @fifo is moved.
+ *     
+ * Arguments:
+ *     @fifo: the data ring
+ *     @idx: free running index into the ring
+ *     @src / @dst: the kernel buffer
+ *     @len: number of bytes, no more than the ring size
+ *     
+ * Side Effects:
+ *     gih_ring_put() writes the ring, gih_ring_peek() @dst.
+ *     
+ * Error Condition: 
+ *     None. The caller owns the part of the ring, as producer or consumer.
+ *     
+ * Return: 
+ *     None.
+ */
+static void gih_ring_put(struct __kfifo * fifo, unsigned int idx, 
+                         const void * src, size_t len) {
+    unsigned int off = idx & fifo->mask;
+    size_t first = min_t(size_t, len, fifo->mask + 1 - off);
+
+    memcpy((unsigned char *)fifo->data + off, src, first);
+    memcpy(fifo->data, (const unsigned char *)src + first, len - first);
+}
+
+static void gih_ring_peek(struct __kfifo * fifo, unsigned int idx, 
+                          void * dst, size_t len) {
+    unsigned int off = idx & fifo->mask;
+    size_t first = min_t(size_t, len, fifo->mask + 1 - off);
+
+    memcpy(dst, (unsigned char *)fifo->data + off, first);
+    memcpy((unsigned char *)dst + first, fifo->data, len - first);
+}
+
+/*
+ * Function name: gih_ring_copy_iter
+ * 
+ * Function prototype:
+ *     static size_t gih_ring_copy_iter(struct __kfifo * fifo, 
+ *                                      unsigned int idx, size_t len, 
+ *                                      struct iov_iter * from);
+ *     
+ * Description: 
+ *     Copies @len bytes of @from into the data ring at index @idx, up to the
+ *     end of the ring, then from its start. The producer index isn't moved.
+ *     
+ * Arguments:
+ *     @fifo: the data ring
+ *     @idx: free running index into the ring, the producer's
+ *     @len: number of bytes, no more than the free space
+ *     @from: user buffers, advanced past what's copied
+ *     
+ * Side Effects:
+ *     The ring is written.
+ *     
+ * Error Condition: 
+ *     A faulting buffer stops the copy there.
+ *     
+ * Return: 
+ *     Number of bytes copied.
+ */
+static size_t gih_ring_copy_iter(struct __kfifo * fifo, unsigned int idx, 
+                                 size_t len, struct iov_iter * from) {
+    unsigned int off = idx & fifo->mask;
+    size_t first = min_t(size_t, len, fifo->mask + 1 - off);
+    size_t copied;
+
+    copied = copy_from_iter((unsigned char *)fifo->data + off, first, from);
+    if (copied == first && len > first)
+        copied += copy_from_iter(fifo->data, len - first, from);
+
+    return copied;
+}
+
+/*
+ * Function name: gih_write_frames
+ * 
+ * Function prototype:
+ *     static ssize_t gih_write_frames(gih_dev * gih, struct iov_iter * from);
+ *     
+ * Description: 
+ *     Producer side of frame mode. Queues every buffer of @from as one frame,
+ *     its length then its bytes, in order and as long as whole frames fit; 
+ *     empty buffers are skipped. A @from that isn't user iovecs is one 
+ *     frame.
+ *     
+ * Arguments:
+ *     @gih: the gih instance
+ *     @from: data buffers from user space
+ *     
+ * Side Effects:
+ *     Frames are written to the ring and its in index advanced, the caller 
+ *     publishes it.
+ *     
+ * Error Condition: 
+ *     Stops at the first frame that doesn't fit or faults, then returns 
+ *     what was queued before; if that's nothing, -EAGAIN for a full ring, 
+ *     -EMSGSIZE for a frame larger than the ring and -EFAULT for a fault.
+ *     Caller needs to hold wrt_lock.
+ *     
+ * Return: 
+ *     Number of payload bytes queued, or -ERRORCODE.
+ */
+static ssize_t gih_write_frames(gih_dev * gih, struct iov_iter * from) {
+
+    struct __kfifo * fifo = &gih->data_buf.kfifo;
+    const struct iovec * iov;
+    size_t skip;
+    size_t total = 0;
+    size_t len;
+    ssize_t error = 0;
+    __u32 hdr;
+
+    while ((len = iov_iter_count(from))) {
+
+        /* the next buffer that isn't empty, the copy skips the empty ones */
+        if (iter_is_iovec(from)) {
+            iov  = from->iov;
+            skip = from->iov_offset;
+            while (iov->iov_len == skip) {
+                iov++;
+                skip = 0;
+            }
+            len = min(len, iov->iov_len - skip);
+        }
+
+        if (GIH_FRAME_HDR_SZ + len > kfifo_size(&gih->data_buf)) {
+            error = -EMSGSIZE;
+            break;
+        }
+
+        if (GIH_FRAME_HDR_SZ + len > kfifo_avail(&gih->data_buf)) {
+            trace_gih_overflow(gih->index, GIH_OVF_DATA, 
+                iov_iter_count(from));
+            stat_add(gih->stats, GIH_STAT_BYTES_FULL, iov_iter_count(from));
+            error = -EAGAIN;
+            break;
+        }
+
+        /* the frame is only published once it's all there */
+        if (gih_ring_copy_iter(fifo, fifo->in + GIH_FRAME_HDR_SZ, len, 
+            from) != len) {
+            error = -EFAULT;
+            break;
+        }
+
+        hdr = len;
+        gih_ring_put(fifo, fifo->in, &hdr, sizeof(hdr));
+        fifo->in += GIH_FRAME_HDR_SZ + len;
+        total += len;
+    }
+
+    return total ? total : error;
+}
+
+/*
+ * Function name: gih_frames_take
+ * 
+ * Function prototype:
+ *     static size_t gih_frames_take(gih_dev * gih, unsigned int avail, 
+ *                                   size_t budget);
+ *     
+ * Description: 
+ *     Consumer side of frame mode, the size of the next output: whole frames
+ *     from the out index, lengths included, at most @budget bytes and 
+ *     frame_limit frames, but at least the first frame.
+ *     
+ * Arguments:
+ *     @gih: the gih instance
+ *     @avail: bytes published in the ring, by gih_ring_avail()
+ *     @budget: max number of bytes to output
+ *     
+ * Side Effects:
+ *     A length that can't be a frame, by a mmap feeder out of step, has 
+ *     everything published dropped, to start over at head.
+ *     
+ * Error Condition: 
+ *     A frame not all published yet isn't taken. Must only be called by 
+ *     the output.
+ *     
+ * Return: 
+ *     Number of bytes to output.
+ */
+static size_t gih_frames_take(gih_dev * gih, unsigned int avail, 
+                              size_t budget) {
+
+    struct __kfifo * fifo = &gih->data_buf.kfifo;
+    unsigned int frames = 0;
+    size_t n = 0;
+    size_t next;
+    __u32 len;
+
+    while (avail - n >= GIH_FRAME_HDR_SZ) {
+        gih_ring_peek(fifo, fifo->out + n, &len, sizeof(len));
+
+        if (len > kfifo_size(&gih->data_buf) - GIH_FRAME_HDR_SZ) {
+            trace_gih_overflow(gih->index, GIH_OVF_DATA, avail);
+            stat_add(gih->stats, GIH_STAT_BYTES_LOST, avail);
+            printk_ratelimited(KERN_ALERT "[gih] WARNING: bad frame length "
+                "%u, %u byte dropped.\n", len, avail);
+            fifo->out += avail;
+            return 0;
+        }
+
+        next = n + GIH_FRAME_HDR_SZ + len;
+        if (next > avail) {break;}
+
+        if (frames && (next > budget || 
+            (gih->frame_limit && frames == gih->frame_limit)))
+            break;
+
+        n = next;
+        frames++;
+    }
+
+    return n;
+}
+
+/*
+ * Function name: gih_frames_align
+ * 
+ * Function prototype:
+ *     static void gih_frames_align(gih_dev * gih, unsigned int start, 
+ *                                  size_t sent);
+ *     
+ * Description: 
+ *     Keeps frame mode on frame boundaries after a short output: the sink 
+ *     took only @sent bytes of the frames from @start, so the rest of the 
+ *     frame it stopped in is dropped rather than sent as a partial frame.
+ *     
+ * Arguments:
+ *     @gih: the gih instance
+ *     @start: out index before the output
+ *     @sent: bytes the sink took
+ *     
+ * Side Effects:
+ *     data_buf's out index is moved to the end of the frame cut short.
+ *     
+ * Error Condition: 
+ *     Must only be called by the output, over frames gih_frames_take() 
+ *     parsed.
+ *     
+ * Return: 
+ *     None.
+ */
+static void gih_frames_align(gih_dev * gih, unsigned int start, size_t sent) {
+
+    struct __kfifo * fifo = &gih->data_buf.kfifo;
+    unsigned int pos = start;
+    __u32 len;
+
+    while (pos - start < sent) {
+        gih_ring_peek(fifo, pos, &len, sizeof(len));
+        pos += GIH_FRAME_HDR_SZ + len;
+    }
+
+    if (pos != fifo->out) {
+        trace_gih_overflow(gih->index, GIH_OVF_DATA, pos - fifo->out);
+        stat_add(gih->stats, GIH_STAT_BYTES_LOST, pos - fifo->out);
+        printk_ratelimited(KERN_ALERT "[gih] WARNING: short output, rest of "
+            "the frame dropped, %u byte.\n", pos - fifo->out);
+        fifo->out = pos;
+    }
+}
+
+/*
+ * Function name: gih_ring_alloc
+ * 
+ * Function prototype:
+ *     static int gih_ring_alloc(gih_dev * gih, size_t size);
+ *     
+ * Description: 
+ *     (Re)allocates the data ring of @gih with @size bytes, rounded up to a 
+ *     power of 2, together with its control page, on the node the ring is
+ *     placed on. The memory is vmalloc-ed so that rings much larger than 
+ *     what kmalloc can give are possible, and it stays mappable to user 
+ *     space. The old ring, if any, is freed only once the new one is 
+ *     allocated.
+ *     
+ * Arguments:
+ *     @gih:  the gih instance
+ *     @size: size of the data ring in bytes
+ *     
+ * Side Effects:
+ *     data_buf and ring_ctrl of @gih are replaced/reset, all data in the old
+ *     ring is discarded.
+ *     
+ * Error Condition: 
+ *     @size out of [DATA_FIFO_MIN_SZ, DATA_FIFO_MAX_SZ] returns -EINVAL, 
+ *     failed allocation returns -ENOMEM, the old ring is kept on failure.
+ *     Caller needs to hold wrt_lock, the device must not be running nor 
+ *     mapped.
+ *     
+ * Return: 
+ *     0 on success, -ERRORCODE on failure.
+ */
+static int gih_ring_alloc(gih_dev * gih, size_t size) {
+
+    struct gih_ring_ctrl * ctrl;
+
+    BUILD_BUG_ON(offsetof(struct gih_ring_ctrl, head) != GIH_RING_HEAD_OFF ||
+                 offsetof(struct gih_ring_ctrl, tail) != GIH_RING_TAIL_OFF);
+
+    if (size < DATA_FIFO_MIN_SZ || size > DATA_FIFO_MAX_SZ) {return -EINVAL;}
+    size = roundup_pow_of_two(size);
+
+    /* zeroed, so both indices start at 0 */
+    ctrl = place_vmalloc_user(PAGE_SIZE + size, gih->ring_node);
+    if (!ctrl) {
+        printk(KERN_ALERT "[gih] ERROR: allocate data ring of %zu bytes "
+            "failed\n", size);
+        return -ENOMEM;
+    }
+
+    vfree(gih->ring_ctrl);
+    gih->ring_ctrl = ctrl;
+    kfifo_init(&gih->data_buf, (void *)ctrl + PAGE_SIZE, size);
+
+    ctrl->version  = GIH_RING_VERSION;
+    ctrl->data_off = PAGE_SIZE;
+    ctrl->size     = kfifo_size(&gih->data_buf);
+    gih->discard_to = 0;
+    gih->discard_seen = gih->discard_seq;
+
+    return 0;
+}
+
+/*
+ * Function name: gih_ring_move
+ * 
+ * Function prototype:
+ *     static int gih_ring_move(gih_dev * gih, int node);
+ *     
+ * Description: 
+ *     Moves the data ring of @gih, with its control page, onto @node. The 
+ *     data and both indices are copied over, nothing is lost.
+ *     
+ * Arguments:
+ *     @gih:  the gih instance
+ *     @node: the node, NUMA_NO_NODE for anywhere
+ *     
+ * Side Effects:
+ *     ring_ctrl, the ring of data_buf and ring_node of @gih are replaced.
+ *     
+ * Error Condition: 
+ *     Failed allocation returns -ENOMEM, the ring stays where it is. Caller
+ *     needs to hold wrt_lock, the device must not be running nor mapped.
+ *     
+ * Return: 
+ *     0 on success, -ERRORCODE on failure.
+ */
+static int gih_ring_move(gih_dev * gih, int node) {
+
+    size_t size = PAGE_SIZE + kfifo_size(&gih->data_buf);
+    struct gih_ring_ctrl * ctrl;
+
+    ctrl = place_vmalloc_user(size, node);
+    if (!ctrl) {return -ENOMEM;}
+
+    memcpy(ctrl, gih->ring_ctrl, size);
+    vfree(gih->ring_ctrl);
+    gih->ring_ctrl = ctrl;
+    gih->data_buf.kfifo.data = (void *)ctrl + PAGE_SIZE;
+    gih->ring_node = node;
+
+    return 0;
+}
+
+/*
+ * Function name: gih_resize_logs
+ * 
+ * Function prototype:
+ *     static int gih_resize_logs(gih_dev * gih, unsigned int n);
+ *     
+ * Description: 
+ *     Reallocates the log rings of @gih to hold @n logs each, rounded up 
+ *     to a power of 2 (see log_ring_alloc()). None of the log devices can be
+ *     opened meanwhile.
+ *     
+ * Arguments:
+ *     @gih: the gih instance
+ *     @n:   number of logs each log ring holds
+ *     
+ * Side Effects:
+ *     All logs not read yet are discarded.
+ *     
+ * Error Condition: 
+ *     If a log device is opened, returns -EBUSY and nothing is changed.
+ *     Other errors of log_ring_alloc() are returned as is, log rings before
+ *     the failed one keep their new size. The device must not be running.
+ *     
+ * Return: 
+ *     0 on success, -ERRORCODE on failure.
+ */
+static int gih_resize_logs(gih_dev * gih, unsigned int n) {
+
+    int error = 0;
+    int i, locked;
+
+    /* keep the readers out */
+    for (locked = 0; locked < NUM_LOG_DEV; locked++) {
+        mutex_lock(&gih->logs[locked].dev_open);
+        if (!list_empty(&gih->logs[locked].readers)) {
+            mutex_unlock(&gih->logs[locked].dev_open);
+            error = -EBUSY;
+            break;
+        }
+    }
+
+    for (i = 0; !error && i < NUM_LOG_DEV; i++)
+        error = log_ring_alloc(&gih->logs[i], n);
+
+    while (locked--)
+        mutex_unlock(&gih->logs[locked].dev_open);
+
+    return error;
+}
+
+/*
+ * Function name: gih_place
+ * 
+ * Function prototype:
+ *     static void gih_place(gih_dev * gih);
+ *     
+ * Description: 
+ *     Resolves the node of @gih (see GIH_NODE_*) and moves what the output
+ *     touches onto it: the data ring, unless mapped, the log rings of a 
+ *     single writer, unless their device is opened, and the output ring and
+ *     aio buffers, allocated by the sink when it opens. The output engine 
+ *     then runs on the CPUs of the node. GIH_NODE_ANY leaves everything 
+ *     where it is.
+ *     
+ * Arguments:
+ *     @gih: the gih instance
+ *     
+ * Side Effects:
+ *     out_node and out_cpu of @gih are set, the rings may be moved.
+ *     
+ * Error Condition: 
+ *     Best effort: a ring that is busy or can't be allocated on the node 
+ *     stays where it is. A node without an online CPU places nothing.
+ *     Caller needs to hold cfg_lock, the device must not be running.
+ *     
+ * Return: 
+ *     None.
+ */
+static void gih_place(gih_dev * gih) {
+
+    log_dev * device;
+    int node = gih->node;
+    int i;
+
+    if (node == GIH_NODE_ANY) {return;}
+    if (node == GIH_NODE_IRQ) node = place_irq_node(gih->irq);
+
+    gih->out_cpu = place_cpu(node);
+    if (gih->out_cpu >= nr_cpu_ids) {node = NUMA_NO_NODE;}
+
+    gih->out_node  = node;
+    gih->sink.node = node;
+    if (node == NUMA_NO_NODE) {return;}
+
+    mutex_lock(&gih->wrt_lock);
+    if (gih->ring_node != node && !atomic_read(&gih->mapped))
+        gih_ring_move(gih, node);
+    mutex_unlock(&gih->wrt_lock);
+
+    for (i = 0; i < NUM_LOG_DEV; i++) {
+        device = &gih->logs[i];
+        if (device->percpu || device->node == node) {continue;}
+
+        mutex_lock(&device->dev_open);
+        if (list_empty(&device->readers))
+            log_ring_move(device, node);
+        mutex_unlock(&device->dev_open);
+    }
+
+    if (GIH_DEBUG) 
+        printk(KERN_ALERT "[gih] placed on node %d, data ring on node %d\n",
+            node, gih->ring_node);
+}
+
+/*
+ * Function name: gih_ioctl 
+ * 
+ * Function prototype:
+ *     static long gih_ioctl(struct file * filp, 
+ *                           unsigned int cmd, 
+ *                           unsigned long arg)
+ *     
+ * Description: 
+ *     All ioctl commands are used to configure the gih device on its first 
+ *     opening. There're four fields that user NEEDS TO specify: 
+ *         -irq number to be registered
+ *         -delay time before data is send out to destination file
+ *         -amount of data to send out upon receive each interrupt
+ *         -path of the destination file
+ *     AFTER all these fields are set, call the last GIH_IOC_CONFIG_START case
+ *     to finish configuration and start the gih device. GIH_IOC_CONFIG_START
+ *     will register irq and open the destination file, which the gih_open() 
+ *     function will not do on first opening.
+ *     If wanted to reconfigure the device, call GIH_IOC_CONFIG_STOP to unset
+ *     the device.
+ *     GIH_IOC_CONFIG sets any of the fields at once from a struct gih_config,
+ *     and optionally starts the device, in a single call.
+ *     GIH_IOC_CONFIG_LOW_WAT sets the poll threshold, also while running.
+ *     GIH_IOC_TRIGGER fires software interrupts into a device running with
+ *     irq GIH_IRQ_NONE, see gih_trigger().
+ *     All commands are serialized by cfg_lock.
+ *     
+ * Arguments:
+ *     @filp: file pointer of the gih char device
+ *     @cmd:  ioctl command to be performed
+ *     @arg:  argument passed to a specified ioctl (might be a pointer)
+ *     
+ * Side Effects:
+ *     For each entry, set the specified field to arg on success.
+ *     Starts the gih device if is GIH_IOC_CONFIG_START,
+ *     Stpps the device if if is GIH_IOC_CONFIG_STOP.
+ *     
+ * Error Condition: 
+ *     Trying to configure the device while it's running will result in -EBUSY.
+ *     Invalid arguments to ioctl will result in -EINVAL.
+ *     Specific errors will result in its -ERRORCODE.
+ *
+ * Return: 
+ *     0 on success, -ERRORCODE on failure.
+ */
+static long gih_ioctl(struct file * filp, 
+                      unsigned int cmd, 
+                      unsigned long arg) {
+
+    gih_dev * gih = filp->private_data;
+    long length;
+    int error = 0;
+    char path[PATH_MAX_LEN];
+    struct gih_config cfg;
+    struct gih_trigger trig;
+
+    mutex_lock(&gih->cfg_lock);
+
+    switch (cmd) {
+
+        /* irq */
+        case GIH_IOC_CONFIG_IRQ:
+            if (gih->setup) {
+                printk(KERN_ALERT "[gih] ERROR setting IRQ: device running.\n");
+                error = -EBUSY;
+            }
+
+            else {
+                if ((int)arg < 0 && (int)arg != GIH_IRQ_NONE) {
+                    printk(KERN_ALERT "[gih] ERROR: IRQ "
+                            "needs to be positive.\n");
+                    error = -EINVAL;
+                    break;
+                }
+
+                error = 0;
+                gih->irq = (int)arg;
+
+                if (GIH_DEBUG) 
+                    printk(KERN_ALERT "[gih] irq configured to %d\n", gih->irq);
+            }
+            break;
+
+
+        /* delay time in milliseconds */
+        case GIH_IOC_CONFIG_DELAY_T:
+            if (gih->setup) {
+                printk(KERN_ALERT "[gih] ERROR setting delay time: "
+                    "device running.\n");
+                error = -EBUSY;
+            }
+
+            else {
+                if ((int)arg < 0) {
+                    printk(KERN_ALERT "[gih] ERROR: delay time "
+                            "needs to be non-negative.\n");
+                    error = -EINVAL;
+                    break;
+                }
+
+                error = 0;
+                gih->sleep_msec = (unsigned int)arg;
+
+                if (GIH_DEBUG) 
+                    printk(KERN_ALERT "[gih] delay time configured to %u\n", 
+                        gih->sleep_msec);
+            }
+            
+            break;
+
+
+        /* amount of data to send on each interrupt */
+        case GIH_IOC_CONFIG_WRT_SZ:
+            if (gih->setup) {
+                printk(KERN_ALERT "[gih] ERROR setting write size: "
+                    "device running.\n");
+                error = -EBUSY;
+            }
+
+            else {
+                if ((int)arg <= 0) {
+                    printk(KERN_ALERT "[gih] ERROR: writing size "
+                            "needs to be positive.\n");
+                    error = -EINVAL;
+                    break;
+                }
+
+                error = 0;
+                gih->write_size = (size_t)arg;
+
+                if (GIH_DEBUG) 
+                    printk(KERN_ALERT "[gih] write size configured to %zu\n",
+                        gih->write_size);
+            }
+            
+            break;
+
+
+        /* path of the destination file */
+        case GIH_IOC_CONFIG_PATH:
+            if (gih->setup) {
+                printk(KERN_ALERT "[gih] ERROR setting destination path: "
+                    "device running.\n");
+                error = -EBUSY;
+            }
+            
+            else {
+                length = strncpy_from_user(path, (const char __user *)arg, 
+                    PATH_MAX_LEN);
+
+                if (length < 0) {
+                    error = length;
+                    break;
+                }
+
+                if (length > PATH_MAX_LEN - 1) {
+                    error = -EINVAL;
+                    break;
+                }
+
+                error = 0;
+                memcpy(gih->path, path, length + 1);
+
+                if (GIH_DEBUG) 
+                    printk(KERN_ALERT "[gih] Destination path configured "
+                            "to %s\n", gih->path);
+
+            }
+
+            break;
+
+
+        /* make sure to only call this after configuration */
+        case GIH_IOC_CONFIG_START:
+            if (gih->setup) {
+                printk(KERN_ALERT "[gih] ERROR: device already running.\n");
+                error = -EBUSY;
+            }
+            else
+                error = gih_start(gih);
+            
+            break;
+
+
+        /* this allows reconfiguration. Release irq. */
+        case GIH_IOC_CONFIG_STOP:
+            if (!gih->setup) {
+                printk(KERN_ALERT "[gih] ERROR: device is not running.\n");
+                error = -EBUSY;
+            }
+
+            else {
+                error = 0;
+                gih_stop(gih);
+            }
+            
+            break;
+
+
+        /* keep missed data or not */
+        case GIH_IOC_CONFIG_MISS:
+            if (gih->setup) {
+                printk(KERN_ALERT "[gih] ERROR setting missed data behavior: "
+                    "device running.\n");
+                error = -EBUSY;
+            }
+
+            else {
+
+                error = 0;
+                gih->keep_missed = ((int)arg == 0) ? FALSE : TRUE;
+
+                if (GIH_DEBUG) 
+                    printk(KERN_ALERT "[gih] keep missed data: %d\n",
+                        gih->keep_missed);
+            }
+            
+            break;
+
+
+        /* size of the data ring, returns the size after rounding */
+        case GIH_IOC_CONFIG_RING_SZ:
+            if (gih->setup) {
+                printk(KERN_ALERT "[gih] ERROR setting ring size: "
+                    "device running.\n");
+                error = -EBUSY;
+                break;
+            }
+
+            mutex_lock(&gih->wrt_lock);
+
+            if (atomic_read(&gih->mapped)) {
+                printk(KERN_ALERT "[gih] ERROR setting ring size: "
+                    "ring is mapped.\n");
+                error = -EBUSY;
+            }
+            else if (!(error = gih_ring_alloc(gih, (size_t)arg)))
+                error = kfifo_size(&gih->data_buf);
+
+            mutex_unlock(&gih->wrt_lock);
+
+            if (GIH_DEBUG && error > 0)
+                printk(KERN_ALERT "[gih] ring size configured to %d\n", error);
+
+            break;
+
+
+        /* size of the log rings in logs, returns the size after rounding */
+        case GIH_IOC_CONFIG_LOG_SZ:
+            if (gih->setup) {
+                printk(KERN_ALERT "[gih] ERROR setting log size: "
+                    "device running.\n");
+                error = -EBUSY;
+                break;
+            }
+
+            if (!(error = gih_resize_logs(gih, (unsigned int)arg)))
+                error = per_cpu_ptr(gih->logs[INTR_LOG_MINOR].rings, 0)->mask
+                    + 1;
+
+            if (GIH_DEBUG && error > 0)
+                printk(KERN_ALERT "[gih] log size configured to %d\n", error);
+
+            break;
+
+
+        /* free space in bytes for the device to poll writable */
+        case GIH_IOC_CONFIG_LOW_WAT:
+            if ((unsigned int)arg == 0) {
+                printk(KERN_ALERT "[gih] ERROR: low water mark "
+                        "needs to be positive.\n");
+                error = -EINVAL;
+                break;
+            }
+
+            gih->low_wat = (unsigned int)arg;
+
+            if (GIH_DEBUG) 
+                printk(KERN_ALERT "[gih] low water mark configured to %u\n",
+                    gih->low_wat);
+
+            break;
+
+
+        /* everything at once, optionally followed by start */
+        case GIH_IOC_CONFIG:
+            if (gih->setup) {
+                printk(KERN_ALERT "[gih] ERROR configuring: "
+                    "device running.\n");
+                error = -EBUSY;
+                break;
+            }
+
+            if (copy_from_user(&cfg, (const void __user *)arg, sizeof(cfg))) {
+                error = -EFAULT;
+                break;
+            }
+
+            error = gih_apply_config(gih, &cfg);
+
+            if (!error && (cfg.flags & GIH_CFG_F_START))
+                error = gih_start(gih);
+
+            break;
+
+
+        /* synthetic interrupts, once or by the trigger timer */
+        case GIH_IOC_TRIGGER:
+            if (copy_from_user(&trig, (const void __user *)arg, 
+                sizeof(trig))) {
+                error = -EFAULT;
+                break;
+            }
+
+            error = gih_trigger(gih, &trig);
+            break;
+
+
+        default:
+            error = -EINVAL;
+    }
+
+    mutex_unlock(&gih->cfg_lock);
+
+    return error;
+}
+
+/*
+ * Function name: gih_apply_config
+ * 
+ * Function prototype:
+ *     static int gih_apply_config(gih_dev * gih, 
+ *                                 const struct gih_config * cfg);
+ *     
+ * Description: 
+ *     Validates all the fields of @cfg selected by its mask with the same 
+ *     rules as the single field ioctls, then commits them to @gih. Nothing 
+ *     is changed unless all of them are valid.
+ *     
+ * Arguments:
+ *     @gih: the gih instance
+ *     @cfg: configuration, already copied from user space
+ *     
+ * Side Effects:
+ *     On success, irq, sleep_msec, write_size, path, keep_missed, the 
+ *     engine (engine, rt_prio, cpu), the sync policy (sync, sync_arg), 
+ *     the sink type, the log clock, the data mode (mode, frame_limit), 
+ *     staging, the lead, the playback source and the node of @gih are set,
+ *     those selected by the mask. A new data mode empties the data ring.
+ *     
+ * Error Condition: 
+ *     Unknown version, unknown mask or flags bits and invalid fields return 
+ *     -EINVAL, as does a direct aio sink in frame mode, whether either half
+ *     is in @cfg or already configured; a new data mode while the ring is 
+ *     mapped -EBUSY. Caller needs to hold cfg_lock, the device must not be
+ *     running.
+ *     
+ * Return: 
+ *     0 on success, -ERRORCODE on failure.
+ */
+static int gih_apply_config(gih_dev * gih, const struct gih_config * cfg) {
+
+    unsigned int sink, sink_flags, mode;
+
+    if (cfg->version != GIH_CONFIG_VERSION) {
+        printk(KERN_ALERT "[gih] ERROR: config version %u unsupported.\n",
+            cfg->version);
+        return -EINVAL;
+    }
+
+    if ((cfg->mask & ~GIH_CFG_ALL) || (cfg->flags & ~GIH_CFG_F_ALL)) 
+        return -EINVAL;
+
+    /* validate everything first */
+    if ((cfg->mask & GIH_CFG_IRQ) && cfg->irq < 0 && 
+        cfg->irq != GIH_IRQ_NONE) {
+        printk(KERN_ALERT "[gih] ERROR: IRQ needs to be positive.\n");
+        return -EINVAL;
+    }
+
+    if ((cfg->mask & GIH_CFG_DELAY_T) && cfg->delay_msec > INT_MAX) {
+        printk(KERN_ALERT "[gih] ERROR: delay time needs to be "
+            "non-negative.\n");
+        return -EINVAL;
+    }
+
+    if ((cfg->mask & GIH_CFG_WRT_SZ) && 
+        (cfg->write_size == 0 || cfg->write_size > INT_MAX)) {
+        printk(KERN_ALERT "[gih] ERROR: writing size needs to be "
+            "positive.\n");
+        return -EINVAL;
+    }
+
+    if ((cfg->mask & GIH_CFG_PATH) && !memchr(cfg->path, '\0', PATH_MAX_LEN)) {
+        printk(KERN_ALERT "[gih] ERROR: destination path too long.\n");
+        return -EINVAL;
+    }
+
+    if (cfg->mask & GIH_CFG_ENGINE) {
+        if (cfg->engine != GIH_ENGINE_WQ && cfg->engine != GIH_ENGINE_KTHREAD) {
+            printk(KERN_ALERT "[gih] ERROR: unknown engine %d.\n", 
+                cfg->engine);
+            return -EINVAL;
+        }
+
+        if (cfg->rt_prio < 1 || cfg->rt_prio > MAX_USER_RT_PRIO - 1) {
+            printk(KERN_ALERT "[gih] ERROR: priority needs to be in "
+                "[1, %d].\n", MAX_USER_RT_PRIO - 1);
+            return -EINVAL;
+        }
+
+        if (cfg->cpu != GIH_CPU_ANY && cfg->cpu != GIH_CPU_IRQ &&
+            (cfg->cpu < 0 || cfg->cpu >= nr_cpu_ids || !cpu_online(cfg->cpu))) {
+            printk(KERN_ALERT "[gih] ERROR: CPU %d is not online.\n", 
+                cfg->cpu);
+            return -EINVAL;
+        }
+    }
+
+    if (cfg->mask & GIH_CFG_SYNC) {
+        if (cfg->sync > GIH_SYNC_CLOSE) {
+            printk(KERN_ALERT "[gih] ERROR: unknown sync policy %u.\n", 
+                cfg->sync);
+            return -EINVAL;
+        }
+
+        if ((cfg->sync == GIH_SYNC_EVERY || cfg->sync == GIH_SYNC_PERIOD) &&
+            (cfg->sync_arg == 0 || cfg->sync_arg > INT_MAX)) {
+            printk(KERN_ALERT "[gih] ERROR: sync interval needs to be "
+                "positive.\n");
+            return -EINVAL;
+        }
+    }
+
+    if ((cfg->mask & GIH_CFG_SINK) && 
+        (cfg->sink > GIH_SINK_AIO || (cfg->sink_flags & ~GIH_SINK_F_ALL))) {
+        printk(KERN_ALERT "[gih] ERROR: unknown sink %u or sink flags "
+            "%#x.\n", cfg->sink, cfg->sink_flags);
+        return -EINVAL;
+    }
+
+    if ((cfg->mask & GIH_CFG_LOG_CLOCK) && 
+        cfg->log_clock > GIH_LOG_CLOCK_RAW) {
+        printk(KERN_ALERT "[gih] ERROR: unknown log clock %u.\n", 
+            cfg->log_clock);
+        return -EINVAL;
+    }
+
+    if (cfg->mask & GIH_CFG_MODE) {
+        if (cfg->mode > GIH_MODE_FRAMES) {
+            printk(KERN_ALERT "[gih] ERROR: unknown data mode %u.\n", 
+                cfg->mode);
+            return -EINVAL;
+        }
+
+        if (cfg->mode != gih->mode && atomic_read(&gih->mapped)) {
+            printk(KERN_ALERT "[gih] ERROR setting data mode: "
+                "ring is mapped.\n");
+            return -EBUSY;
+        }
+    }
+
+    /* direct writes are whole blocks, frames would be cut; either half may
+       be what's configured already */
+    sink       = (cfg->mask & GIH_CFG_SINK) ? cfg->sink : gih->sink.type;
+    sink_flags = (cfg->mask & GIH_CFG_SINK) ? cfg->sink_flags : 
+                                               gih->sink.flags;
+    mode       = (cfg->mask & GIH_CFG_MODE) ? cfg->mode : gih->mode;
+
+    if (sink == GIH_SINK_AIO && (sink_flags & GIH_SINK_F_DIRECT) && 
+        mode == GIH_MODE_FRAMES) {
+        printk(KERN_ALERT "[gih] ERROR setting destination: direct writes "
+            "of frames are not supported.\n");
+        return -EINVAL;
+    }
+
+    if ((cfg->mask & GIH_CFG_SOURCE) && 
+        (!memchr(cfg->source, '\0', PATH_MAX_LEN) || 
+         (cfg->source_flags & ~GIH_SRC_F_ALL))) {
+        printk(KERN_ALERT "[gih] ERROR: source path too long or unknown "
+            "source flags %#x.\n", cfg->source_flags);
+        return -EINVAL;
+    }
+
+    if ((cfg->mask & GIH_CFG_NODE) && cfg->node != GIH_NODE_ANY && 
+        cfg->node != GIH_NODE_IRQ && 
+        (cfg->node < 0 || cfg->node >= MAX_NUMNODES || 
+         !node_online(cfg->node))) {
+        printk(KERN_ALERT "[gih] ERROR: node %d is not online.\n", cfg->node);
+        return -EINVAL;
+    }
+
+    if (cfg->mask & GIH_CFG_LEAD) {
+        if (cfg->lead_mode > GIH_LEAD_ADAPT) {
+            printk(KERN_ALERT "[gih] ERROR: unknown lead mode %u.\n", 
+                cfg->lead_mode);
+            return -EINVAL;
+        }
+
+        if (cfg->lead_min_usec > cfg->lead_usec || 
+            cfg->lead_usec > cfg->lead_max_usec || 
+            cfg->lead_max_usec > GIH_LEAD_MAX_USEC) {
+            printk(KERN_ALERT "[gih] ERROR: lead needs to be within its "
+                "bounds, and the bounds within [0, %lu] us.\n", 
+                GIH_LEAD_MAX_USEC);
+            return -EINVAL;
+        }
+    }
+
+    /* then commit */
+    if (cfg->mask & GIH_CFG_IRQ)     gih->irq = cfg->irq;
+    if (cfg->mask & GIH_CFG_DELAY_T) gih->sleep_msec = cfg->delay_msec;
+    if (cfg->mask & GIH_CFG_WRT_SZ)  gih->write_size = cfg->write_size;
+    if (cfg->mask & GIH_CFG_PATH)    strcpy(gih->path, cfg->path);
+    if (cfg->mask & GIH_CFG_MISS)    
+        gih->keep_missed = cfg->keep_missed ? TRUE : FALSE;
+    if (cfg->mask & GIH_CFG_ENGINE) {
+        gih->engine  = cfg->engine;
+        gih->rt_prio = cfg->rt_prio;
+        gih->cpu     = cfg->cpu;
+    }
+    if (cfg->mask & GIH_CFG_SYNC) {
+        gih->sync     = cfg->sync;
+        gih->sync_arg = cfg->sync_arg;
+    }
+    if (cfg->mask & GIH_CFG_SINK) {
+        gih->sink.type  = cfg->sink;
+        gih->sink.flags = cfg->sink_flags;
+    }
+    if (cfg->mask & GIH_CFG_LOG_CLOCK) gih->log_clock = cfg->log_clock;
+    if (cfg->mask & GIH_CFG_MODE) {
+        /* what's in the ring doesn't parse in the other mode */
+        mutex_lock(&gih->wrt_lock);
+        if (cfg->mode != gih->mode) gih_ring_reset(gih);
+        gih->mode = cfg->mode;
+        mutex_unlock(&gih->wrt_lock);
+        gih->frame_limit = cfg->frame_limit;
+    }
+    if (cfg->mask & GIH_CFG_STAGE)   gih->stage = cfg->stage ? TRUE : FALSE;
+    if (cfg->mask & GIH_CFG_LEAD) {
+        gih->lead_mode     = cfg->lead_mode;
+        gih->lead_usec     = cfg->lead_usec;
+        gih->lead_min_usec = cfg->lead_min_usec;
+        gih->lead_max_usec = cfg->lead_max_usec;
+    }
+    if (cfg->mask & GIH_CFG_SOURCE) {
+        strcpy(gih->source, cfg->source);
+        gih->source_flags = cfg->source_flags;
+    }
+    if (cfg->mask & GIH_CFG_NODE)    gih->node = cfg->node;
+
+    if (GIH_DEBUG) 
+        printk(KERN_ALERT "[gih] configured: irq %d, delay %u, write size "
+            "%zu, keep missed %d, path %s\n", gih->irq, gih->sleep_msec, 
+            gih->write_size, gih->keep_missed, gih->path);
+
+    return 0;
+}
+
+/*
+ * Function name: gih_start
+ * 
+ * Function prototype:
+ *     static int gih_start(gih_dev * gih);
+ *     
+ * Description: 
+ *     Finishes configuration and starts @gih: places it on its node, 
+ *     computes the output deadline, opens the destination sink, starts the
+ *     output engine and registers the irq, unless it's GIH_IRQ_NONE. The 
+ *     periodic sync is started if that's the sync policy.
+ *     
+ * Arguments:
+ *     @gih: the gih instance
+ *     
+ * Side Effects:
+ *     On success the device is running (setup is true).
+ *     
+ * Error Condition: 
+ *     Failing to open the destination sink, to start the engine or to 
+ *     register the irq returns its error, the device is left stopped. 
+ *     Caller needs to hold cfg_lock, the device must not be running.
+ *     
+ * Return: 
+ *     0 on success, -ERRORCODE on failure.
+ */
+static int gih_start(gih_dev * gih) {
+
+    int error;
+
+    if (GIH_DEBUG) printk(KERN_ALERT "[gih] Finishing configuration\n");
+
+    /* the rings the output touches, on the node it runs on */
+    gih->out_node  = NUMA_NO_NODE;
+    gih->sink.node = NUMA_NO_NODE;
+    gih_place(gih);
+
+    /* output deadline relative to the interrupt, corrected by the lead for
+       the internal delays; an adapting lead starts over */
+    gih->lead_avg = ((s64)gih->lead_usec * NSEC_PER_USEC) << GIH_LEAD_SHIFT;
+    gih_set_lead(gih, (s64)gih->lead_usec * NSEC_PER_USEC);
+
+    kfifo_reset(&gih->events);
+    gih->staged.ready = FALSE;
+
+    /* the output needs the sink and its engine before the first interrupt */
+    gih->sink.aio_raw = (gih->log_clock == GIH_LOG_CLOCK_RAW);
+    error = sink_open(&gih->sink, gih->path, kfifo_size(&gih->data_buf),
+        min_t(size_t, gih->write_size, kfifo_size(&gih->data_buf)));
+
+    if (error < 0) {
+        printk(KERN_ALERT "[gih] ERROR setting destination: "
+                "sink opening failed: %d.\n", error);
+        return error;
+    }
+
+    /* and a full ring, when played back */
+    error = gih_src_start(gih);
+
+    if (error < 0) {
+        printk(KERN_ALERT "[gih] ERROR opening source %s: %d\n", 
+            gih->source, error);
+        goto close_sink;
+    }
+
+    error = gih_engine_start(gih);
+
+    if (error < 0) {
+        printk(KERN_ALERT "[gih] ERROR starting output engine: %d\n", error);
+        goto stop_source;
+    }
+
+    /* set the irq, none if only the software trigger interrupts */
+    gih->timer_on = TRUE;
+    if (gih->irq != GIH_IRQ_NONE)
+        error = request_irq(gih->irq, gih_intr, IRQF_SHARED, IRQ_NAME, 
+            (void*)gih);
+
+    if (error < 0) {
+        printk(KERN_ALERT "[gih] IRQ REQUEST ERROR: %d\n", error);
+        gih_timer_off(gih);
+        goto stop_engine;
+    }
+
+    /* durability, off the timed path */
+    gih->sync_count = 0;
+    if (gih->sync == GIH_SYNC_PERIOD)
+        queue_delayed_work(gih->sync_wq, &gih->sync_work, 
+            msecs_to_jiffies(gih->sync_arg));
+
+    gih->setup = TRUE;
+    printk(KERN_ALERT "[gih] Configuration finished, device started.\n");
+
+    return 0;
+
+stop_engine:
+    gih_engine_stop(gih);
+stop_source:
+    gih_src_stop(gih);
+close_sink:
+    sink_close(&gih->sink);
+    return error;
+}
+
+/*
+ * Function name: gih_stop
+ * 
+ * Function prototype:
+ *     static void gih_stop(gih_dev * gih);
+ *     
+ * Description: 
+ *     Stops the running @gih: stops the software trigger, releases the irq, 
+ *     waits for pending output and syncs then closes the destination file,
+ *     allowing reconfiguration.
+ *     
+ * Arguments:
+ *     @gih: the gih instance
+ *     
+ * Side Effects:
+ *     The device is stopped (setup is false).
+ *     
+ * Error Condition: 
+ *     Caller needs to hold cfg_lock, the device must be running.
+ *     
+ * Return: 
+ *     None.
+ */
+static void gih_stop(gih_dev * gih) {
+
+    gih_trig_stop(gih);
+    if (gih->irq != GIH_IRQ_NONE) free_irq(gih->irq, (void*)gih);
+    gih_timer_off(gih);
+    gih_engine_stop(gih);
+    flush_workqueue(gih->irq_wq);
+    gih_stage_flush(gih);
+    gih_aio_stop(gih);
+    gih_src_stop(gih);
+
+    gih_sync_stop(gih);
+    sink_close(&gih->sink);
+
+    gih->setup = FALSE;
+    printk(KERN_ALERT "[gih] Device stopped running, "
+        "reconfiguration available.\n");
+}
+
+/*
+ * Function name: gih_do_work
+ * 
+ * Function prototype:
+ *     static void gih_do_work(struct work_struct * work);
+ *     
+ * Description: 
+ *     Work function to execute for the work queue, the workqueue engine. The
+ *     work is queued by the output timer once the deadline of the oldest 
+ *     pending event is hit, and drains the due events (see gih_drain()).
+ *     
+ * Arguments:
+ *     @work: work structure that is put on the work queue.
+ *     
+ * Side Effects:
+ *     See gih_drain().
+ *     
+ * Error Condition: 
+ *     None.
+ *     
+ * Return: 
+ *     No return value.
+ */
+static void gih_do_work(struct work_struct * work) {
+
+    gih_dev * gih = container_of(work, gih_dev, work);
+
+    gih_drain(gih);
+}
+
+/*
+ * Function name: gih_engine_fn
+ * 
+ * Function prototype:
+ *     static int gih_engine_fn(void * data);
+ *     
+ * Description: 
+ *     Thread function of the kthread engine. Sleeps until the output timer 
+ *     kicks it, then drains the due events (see gih_drain()). Runs at 
+ *     SCHED_FIFO, so only higher priority real-time tasks (and interrupts) 
+ *     can delay the output.
+ *     
+ * Arguments:
+ *     @data: the gih instance
+ *     
+ * Side Effects:
+ *     See gih_drain().
+ *     
+ * Error Condition: 
+ *     None.
+ *     
+ * Return: 
+ *     0 once stopped by kthread_stop().
+ */
+static int gih_engine_fn(void * data) {
+
+    gih_dev * gih = data;
+
+    while (!kthread_should_stop()) {
+
+        /* the kick is set before the wake up, check it after going to
+           sleep state so none is missed */
+        set_current_state(TASK_INTERRUPTIBLE);
+        if (!atomic_xchg(&gih->engine_kick, 0) && !kthread_should_stop())
+            schedule();
+        __set_current_state(TASK_RUNNING);
+
+        gih_drain(gih);
+    }
+
+    return 0;
+}
+
+/*
+ * Function name: gih_engine_start
+ * 
+ * Function prototype:
+ *     static int gih_engine_start(gih_dev * gih);
+ *     
+ * Description: 
+ *     Starts the kthread engine of @gih if it's configured, at SCHED_FIFO of 
+ *     rt_prio and bound to cpu. For GIH_CPU_IRQ, the thread is bound to the 
+ *     first CPU of the irq's affinity at this point, to share the cache with 
+ *     the interrupt handler. Not pinned, it's kept on the CPUs of the node 
+ *     the device is placed on, if any. Nothing is done for the workqueue 
+ *     engine.
+ *     
+ * Arguments:
+ *     @gih: the gih instance
+ *     
+ * Side Effects:
+ *     engine_task of @gih is set for the kthread engine.
+ *     
+ * Error Condition: 
+ *     Failing to create the thread or to set its scheduling returns the 
+ *     error, no thread is left.
+ *     
+ * Return: 
+ *     0 on success, -ERRORCODE on failure.
+ */
+static int gih_engine_start(gih_dev * gih) {
+
+    struct sched_param param = { .sched_priority = gih->rt_prio };
+    struct task_struct * task;
+    struct irq_data * irq_data;
+    int cpu = gih->cpu;
+    int error;
+
+    if (gih->engine != GIH_ENGINE_KTHREAD) {return 0;}
+
+    if (cpu == GIH_CPU_IRQ) {
+        irq_data = gih->irq != GIH_IRQ_NONE ? 
+            irq_get_irq_data(gih->irq) : NULL;
+        cpu = irq_data ? 
+            cpumask_first(irq_data_get_affinity_mask(irq_data)) : nr_cpu_ids;
+        if (cpu >= nr_cpu_ids || !cpu_online(cpu)) cpu = GIH_CPU_ANY;
+    }
+
+    task = kthread_create(gih_engine_fn, gih, ENGINE_NAME_FMT, gih->index);
+    if (IS_ERR(task)) {return PTR_ERR(task);}
+
+    if (cpu >= 0) 
+        kthread_bind(task, cpu);
+    else if (gih->out_node != NUMA_NO_NODE)
+        set_cpus_allowed_ptr(task, cpumask_of_node(gih->out_node));
+
+    error = sched_setscheduler(task, SCHED_FIFO, &param);
+    if (error) {
+        kthread_stop(task);
+        return error;
+    }
+
+    atomic_set(&gih->engine_kick, 0);
+    gih->engine_task = task;
+    wake_up_process(task);
+
+    if (GIH_DEBUG) 
+        printk(KERN_ALERT "[gih] kthread engine started, prio %d, cpu %d\n",
+            gih->rt_prio, cpu);
+
+    return 0;
+}
+
+/*
+ * Function name: gih_engine_stop
+ * 
+ * Function prototype:
+ *     static void gih_engine_stop(gih_dev * gih);
+ *     
+ * Description: 
+ *     Stops the kthread engine of @gih, if it's running, waiting for its 
+ *     current output to finish. The output timer must be cancelled before.
+ *     
+ * Arguments:
+ *     @gih: the gih instance
+ *     
+ * Side Effects:
+ *     engine_task of @gih is cleared.
+ *     
+ * Error Condition: 
+ *     None.
+ *     
+ * Return: 
+ *     None.
+ */
+static void gih_engine_stop(gih_dev * gih) {
+
+    if (!gih->engine_task) {return;}
+
+    kthread_stop(gih->engine_task);
+    gih->engine_task = NULL;
+}
+
+/*
+ * Function name: gih_drain
+ * 
+ * Function prototype:
+ *     static void gih_drain(gih_dev * gih);
+ *     
+ * Description: 
+ *     Output of either engine. Drains the pending event queue in order, 
+ *     emitting every event whose deadline (interrupt time + delay) has 
+ *     passed, then re-arms the output timer for the next pending event, if 
+ *     any, and stages its payload if staging is on. No waiting is done in 
+ *     here.
+ *     
+ * Arguments:
+ *     @gih: the gih instance
+ *     
+ * Side Effects:
+ *     Due events are dequeued from the event queue and emitted by gih_emit().
+ *     Output timer is re-armed if there's still event pending.
+ *     
+ * Error Condition: 
+ *     Only one engine may drain at a time, it's the single consumer of the 
+ *     event queue and the data ring.
+ *     
+ * Return: 
+ *     No return value.
+ */
+static void gih_drain(gih_dev * gih) {
+
+    struct gih_event evt;
+    ktime_t deadline;
+
+    while (kfifo_peek(&gih->events, &evt)) {
+
+        deadline = ktime_add(evt.stamp, READ_ONCE(gih->delay));
+
+        /* not due yet, wait for the timer again; the payload can be 
+           settled meanwhile */
+        if (ktime_before(ktime_get(), deadline)) {
+            if (gih->stage && !gih->staged.ready)
+                gih_stage(gih, &evt);
+            gih_arm_timer(gih, deadline);
+            break;
+        }
+
+        kfifo_skip(&gih->events);
+        gih_emit(gih, &evt);
+    }
+}
+
+/*
+ * Function name: gih_emit
+ * 
+ * Function prototype:
+ *     static void gih_emit(gih_dev * gih, const struct gih_event * evt);
+ *     
+ * Description: 
+ *     Does the work of sending data that was buffered in the gih device to 
+ *     the destination file, for one interrupt event. This is the only consumer
+ *     of the data ring and doesn't lock against the producers, so feeding 
+ *     isn't held up by the output.
+ *     This function also generates two log, one on entering the output, the 
+ *     other on exiting, and are stored in the gihlog1 and gihlog2 device; both
+ *     carry the sequence number of the interrupt that caused the output.
+ *     When debug is turned on, user can examine the performance of the gih 
+ *     device from the debug output generated in this function.
+ *     
+ * Arguments:
+ *     @gih: the gih instance
+ *     @evt: the pending event to emit, holds interrupt time, sequence number
+ *           and byte budget of this output.
+ *     
+ * Side Effects:
+ *     Output at most the byte budget of @evt to the destination file, whole
+ *     frames only in frame mode (see gih_frames_take()), or the payload 
+ *     gih_stage() settled for @evt. 
+ *     Queues a sync when due by the sync policy. 
+ *     Write two logs to the wq_n_log and wq_x_log device, and records the
+ *     latencies of the event into the histograms of this CPU.
+ *     
+ * Error Condition: 
+ *     None.
+ *     
+ * Return: 
+ *     No return value.
+ */
+static void gih_emit(gih_dev * gih, const struct gih_event * evt) {
+
+    size_t n_out_byte;            /* number of byte to output */
+    size_t out = 0;               /* number of byte actually outputted */
+    unsigned int first;           /* out index before the output */
+    bool staged = FALSE;          /* payload staged by gih_stage() */
+    int ret;
+    struct log exit;
+    struct log entry;
+    struct event_log event;
+    ktime_t start;                /* output start, to the histograms */
+    s64 late;                     /* interrupt to output start, in ns */
+    ktime_t end;                  /* output end */
+
+    start = ktime_get();
+    log_stamp(gih, &entry, start);
+
+    if (gih->staged.ready && gih->staged.seq == evt->seq) {
+        gih->staged.ready = FALSE;
+        staged = gih->staged.copied;
+        n_out_byte = gih->staged.len;
+    }
+    else
+        n_out_byte = gih_out_size(gih, evt->budget);
+
+    first = gih->data_buf.kfifo.out;
+
+    trace_gih_emit_begin(gih->index, evt->seq, n_out_byte, evt->budget);
+
+    if (staged) {
+        sink_commit(&gih->sink);
+        ret = n_out_byte;
+    }
+    else if (gih->sink.type == GIH_SINK_AIO)
+        ret = sink_aio_write(&gih->sink, &gih->data_buf, n_out_byte, 
+            evt->log_stamp, evt->seq);
+    else
+        ret = sink_write_kfifo(&gih->sink, &gih->data_buf, n_out_byte);
+
+    if (ret < 0)
+        printk_ratelimited(KERN_ALERT "[gih] ERROR writing to dest file: "
+            "%d\n", ret);
+    else
+        out = ret;
+
+    stat_inc(gih->stats, GIH_STAT_EMITS);
+    stat_add(gih->stats, GIH_STAT_BYTES_OUT, out);
+    if (out < n_out_byte)
+        stat_inc(gih->stats, GIH_STAT_SHORT);
+
+    if (gih->mode == GIH_MODE_FRAMES && out && out < n_out_byte)
+        gih_frames_align(gih, first, out);
+
+    /* give the space back to a mmap feeder */
+    smp_store_release(&gih->ring_ctrl->tail, gih->data_buf.kfifo.out);
+
+    /* or to the playback source, read off the timed path */
+    if (out && gih->src_filp)
+        queue_work(gih->sync_wq, &gih->src_work);
+
+    trace_gih_emit_end(gih->index, evt->seq, ret, 
+        READ_ONCE(gih->ring_ctrl->head) - gih->data_buf.kfifo.out);
+
+    /* and to whoever polls for it */
+    if (out && wq_has_sleeper(&gih->wrt_wait) && 
+        gih_ring_free(gih) >= min(gih->low_wat, kfifo_size(&gih->data_buf)))
+        wake_up_interruptible(&gih->wrt_wait);
+
+    /* the sync is paid on the sync workqueue, not on the timed path */
+    if (out && gih->sync == GIH_SYNC_EVERY && 
+        ++gih->sync_count >= gih->sync_arg) {
+        gih->sync_count = 0;
+        queue_delayed_work(gih->sync_wq, &gih->sync_work, 0);
+    }
+
+    entry.byte_sent = -1,
+    entry.irq_count = evt->seq;
+    gih->logs[WQ_N_LOG_MINOR].irq_count++;
+    log_push(&gih->logs[WQ_N_LOG_MINOR], &entry);
+
+    exit.byte_sent = min_t(size_t, out, S32_MAX);
+    exit.irq_count = evt->seq;
+    gih->logs[WQ_X_LOG_MINOR].irq_count++;
+    
+    end = ktime_get();
+    log_stamp(gih, &exit, end);
+    log_push(&gih->logs[WQ_X_LOG_MINOR], &exit);
+
+    /* the whole timeline of the interrupt, in one record */
+    event.irq_stamp   = evt->log_stamp;
+    event.start_stamp = entry.stamp;
+    event.end_stamp   = exit.stamp;
+    event.irq_count   = evt->seq;
+    event.byte_sent   = exit.byte_sent;
+    gih->logs[EVENT_LOG_MINOR].irq_count++;
+    log_push(&gih->logs[EVENT_LOG_MINOR], &event);
+
+    /* latencies of this very event, no need to join the logs */
+    late = ktime_to_ns(ktime_sub(start, evt->stamp));
+    hist_record(gih->hist, HIST_IRQ_START, late);
+    hist_record(gih->hist, HIST_START_END, ktime_to_ns(ktime_sub(end, start)));
+    hist_record(gih->hist, HIST_DEADLINE, 
+        late - (s64)gih->sleep_msec * NSEC_PER_MSEC);
+
+    if (gih->lead_mode == GIH_LEAD_ADAPT)
+        gih_lead_update(gih, evt, start);
+}
+
+/*
+ * Function name: gih_out_size
+ * 
+ * Function prototype:
+ *     static size_t gih_out_size(gih_dev * gih, size_t budget);
+ *     
+ * Description: 
+ *     Size of the next output out of the data ring: what's available up to
+ *     @budget bytes, or the whole frames of gih_frames_take() in frame mode.
+ *     
+ * Arguments:
+ *     @gih: the gih instance
+ *     @budget: max number of bytes to output
+ *     
+ * Side Effects:
+ *     See gih_ring_avail() and gih_frames_take().
+ *     
+ * Error Condition: 
+ *     Must only be called by the output.
+ *     
+ * Return: 
+ *     Number of bytes to output.
+ */
+static size_t gih_out_size(gih_dev * gih, size_t budget) {
+
+    unsigned int avail = gih_ring_avail(gih);
+
+    if (gih->mode == GIH_MODE_FRAMES)
+        return gih_frames_take(gih, avail, budget);
+
+    return min((size_t)avail, budget);
+}
+
+/*
+ * Function name: gih_stage
+ * 
+ * Function prototype:
+ *     static void gih_stage(gih_dev * gih, const struct gih_event * evt);
+ *     
+ * Description: 
+ *     Stages the payload of @evt, not due yet (see struct gih_stage): takes
+ *     its size out of the data ring, and has the sink build the output 
+ *     already if it can. Nothing is staged while the data ring is empty, 
+ *     the output then takes the payload at the deadline.
+ *     
+ * Arguments:
+ *     @gih: the gih instance
+ *     @evt: the oldest pending event
+ *     
+ * Side Effects:
+ *     staged is set. Data copied into the sink is given back to a mmap 
+ *     feeder.
+ *     
+ * Error Condition: 
+ *     Must only be called by the output, with nothing staged.
+ *     
+ * Return: 
+ *     None.
+ */
+static void gih_stage(gih_dev * gih, const struct gih_event * evt) {
+
+    struct gih_stage * st = &gih->staged;
+
+    st->len = gih_out_size(gih, evt->budget);
+    if (!st->len) {return;}
+
+    st->copied = sink_stage_kfifo(&gih->sink, &gih->data_buf, st->len);
+    if (st->copied)
+        smp_store_release(&gih->ring_ctrl->tail, gih->data_buf.kfifo.out);
+
+    st->seq   = evt->seq;
+    st->ready = TRUE;
+}
+
+/*
+ * Function name: gih_stage_flush
+ * 
+ * Function prototype:
+ *     static void gih_stage_flush(gih_dev * gih);
+ *     
+ * Description: 
+ *     Sends a payload staged for an event that will not be emitted anymore,
+ *     as the device stops: it's already out of the data ring.
+ *     
+ * Arguments:
+ *     @gih: the gih instance
+ *     
+ * Side Effects:
+ *     The staged output, if any, is committed to the sink; staged is reset.
+ *     
+ * Error Condition: 
+ *     The output must be stopped.
+ *     
+ * Return: 
+ *     None.
+ */
+static void gih_stage_flush(gih_dev * gih) {
+
+    if (gih->staged.ready && gih->staged.copied) 
+        sink_commit(&gih->sink);
+
+    gih->staged.ready = FALSE;
+}
+
+/*
+ * Function name: gih_set_lead
+ * 
+ * Function prototype:
+ *     static void gih_set_lead(gih_dev * gih, s64 lead);
+ *     
+ * Description: 
+ *     Sets the lead of the output timer, and with it the deadline offset of
+ *     the events: the delay less @lead, 0 at the least.
+ *     
+ * Arguments:
+ *     @gih: the gih instance
+ *     @lead: the lead, in ns
+ *     
+ * Side Effects:
+ *     lead_ns and delay are set. Events queued from here on get the new 
+ *     deadline, as do the pending ones when the output looks at them.
+ *     
+ * Error Condition: 
+ *     Only the output, or gih_start() before it runs, may set the lead.
+ *     
+ * Return: 
+ *     None.
+ */
+static void gih_set_lead(gih_dev * gih, s64 lead) {
+
+    s64 delay = (s64)gih->sleep_msec * NSEC_PER_MSEC - lead;
+
+    WRITE_ONCE(gih->lead_ns, lead);
+    WRITE_ONCE(gih->delay, ns_to_ktime(max_t(s64, delay, 0)));
+}
+
+/*
+ * Function name: gih_lead_update
+ * 
+ * Function prototype:
+ *     static void gih_lead_update(gih_dev * gih, 
+ *                                 const struct gih_event * evt, 
+ *                                 ktime_t start);
+ *     
+ * Description: 
+ *     Adapts the lead to the overhead of the output of @evt, from its timer
+ *     deadline (interrupt time + delay) to the output start: the lead 
+ *     follows the EWMA of the overhead, within the configured bounds, so 
+ *     the outputs start on time on average. See GIH_LEAD_ADAPT.
+ *     
+ * Arguments:
+ *     @gih: the gih instance
+ *     @evt: the event just emitted
+ *     @start: start of its output
+ *     
+ * Side Effects:
+ *     lead_avg is updated, the lead set by it.
+ *     
+ * Error Condition: 
+ *     An output held up by the ones before it also counts as overhead, the
+ *     bounds keep the lead in check then. Only called by the output.
+ *     
+ * Return: 
+ *     None.
+ */
+static void gih_lead_update(gih_dev * gih, const struct gih_event * evt, 
+                            ktime_t start) {
+
+    s64 min = ((s64)gih->lead_min_usec * NSEC_PER_USEC) << GIH_LEAD_SHIFT;
+    s64 max = ((s64)gih->lead_max_usec * NSEC_PER_USEC) << GIH_LEAD_SHIFT;
+    s64 overhead;
+
+    overhead = ktime_to_ns(ktime_sub(start, 
+        ktime_add(evt->stamp, gih->delay)));
+
+    gih->lead_avg += overhead - (gih->lead_avg >> GIH_LEAD_SHIFT);
+    gih->lead_avg = clamp(gih->lead_avg, min, max);
+
+    gih_set_lead(gih, gih->lead_avg >> GIH_LEAD_SHIFT);
+}
+
+/*
+ * Function name: gih_sync_work
+ * 
+ * Function prototype:
+ *     static void gih_sync_work(struct work_struct * work);
+ *     
+ * Description: 
+ *     Work function of the sync workqueue, syncs the destination file. It's 
+ *     queued by gih_emit() for GIH_SYNC_EVERY, and re-queues itself for 
+ *     GIH_SYNC_PERIOD, so the cost of the sync is never paid by the output.
+ *     
+ * Arguments:
+ *     @work: the sync_work of the gih device.
+ *     
+ * Side Effects:
+ *     The destination file is synced. For GIH_SYNC_PERIOD the next sync is 
+ *     queued after sync_arg milliseconds.
+ *     
+ * Error Condition: 
+ *     Failing to sync prints a (rate limited) message, the next sync will
+ *     try again.
+ *     
+ * Return: 
+ *     None.
+ */
+static void gih_sync_work(struct work_struct * work) {
+
+    gih_dev * gih = container_of(to_delayed_work(work), gih_dev, sync_work);
+    int ret;
+
+    ret = sink_sync(&gih->sink);
+    if (ret < 0)
+        printk_ratelimited(KERN_ALERT "[gih] ERROR syncing dest file: %d\n",
+            ret);
+
+    if (gih->sync == GIH_SYNC_PERIOD)
+        queue_delayed_work(gih->sync_wq, &gih->sync_work, 
+            msecs_to_jiffies(gih->sync_arg));
+}
+
+/*
+ * Function name: gih_sync_stop
+ * 
+ * Function prototype:
+ *     static void gih_sync_stop(gih_dev * gih);
+ *     
+ * Description: 
+ *     Stops the syncs of @gih and, unless the sync policy is never, does a
+ *     last sync of the destination file so that everything written is 
+ *     durable before it's closed.
+ *     
+ * Arguments:
+ *     @gih: the gih instance
+ *     
+ * Side Effects:
+ *     No sync is pending or running on return. The destination file is 
+ *     synced.
+ *     
+ * Error Condition: 
+ *     The output must already be stopped, otherwise a sync may be queued 
+ *     again. Failing to sync prints a message.
+ *     
+ * Return: 
+ *     None.
+ */
+static void gih_sync_stop(gih_dev * gih) {
+
+    int ret;
+
+    cancel_delayed_work_sync(&gih->sync_work);
+
+    if (gih->sync == GIH_SYNC_NEVER) {return;}
+
+    ret = sink_sync(&gih->sink);
+    if (ret < 0)
+        printk(KERN_ALERT "[gih] ERROR syncing dest file: %d\n", ret);
+}
+
+/*
+ * Function name: gih_aio_work
+ * 
+ * Function prototype:
+ *     static void gih_aio_work(struct work_struct * work);
+ *     
+ * Description: 
+ *     Work function of the completions of the aio sink, on the sync 
+ *     workqueue, queued by every completion. Reaps the completed writes in 
+ *     submission order into the aio log device, interrupt, issue and 
+ *     completion time with the bytes written, and gives them back to the 
+ *     output. Failed or short writes are also counted as short outputs, 
+ *     what's not written as lost.
+ *     
+ * Arguments:
+ *     @work: the aio_work of the gih device.
+ *     
+ * Side Effects:
+ *     Completed writes are freed for the output, logs are pushed.
+ *     
+ * Error Condition: 
+ *     The only writer of the aio log. A failed write prints a (rate 
+ *     limited) message.
+ *     
+ * Return: 
+ *     None.
+ */
+static void gih_aio_work(struct work_struct * work) {
+
+    gih_dev * gih = container_of(work, gih_dev, aio_work);
+    struct gih_aio * w;
+    struct event_log cpl;
+
+    while ((w = sink_aio_reap(&gih->sink))) {
+
+        cpl.irq_stamp   = w->irq_stamp;
+        cpl.start_stamp = w->issued;
+        cpl.end_stamp   = w->completed;
+        cpl.irq_count   = w->seq;
+        cpl.byte_sent   = clamp_t(long, w->res, S32_MIN, S32_MAX);
+
+        if (w->res < 0 || (size_t)w->res < w->len) {
+            stat_inc(gih->stats, GIH_STAT_SHORT);
+            stat_add(gih->stats, GIH_STAT_BYTES_LOST, 
+                w->len - max(w->res, 0L));
+            printk_ratelimited(KERN_ALERT "[gih] ERROR writing to dest "
+                "file: %ld of %zu byte\n", w->res, w->len);
+        }
+
+        sink_aio_release(&gih->sink);
+
+        gih->logs[AIO_LOG_MINOR].irq_count++;
+        log_push(&gih->logs[AIO_LOG_MINOR], &cpl);
+    }
+}
+
+/*
+ * Function name: gih_aio_stop
+ * 
+ * Function prototype:
+ *     static void gih_aio_stop(gih_dev * gih);
+ *     
+ * Description: 
+ *     Waits for the writes in flight of the aio sink and reaps all their 
+ *     completions, so the sink can be closed.
+ *     
+ * Arguments:
+ *     @gih: the gih instance
+ *     
+ * Side Effects:
+ *     May sleep. No reaping is pending or running on return.
+ *     
+ * Error Condition: 
+ *     The output must already be stopped.
+ *     
+ * Return: 
+ *     None.
+ */
+static void gih_aio_stop(gih_dev * gih) {
+
+    if (gih->sink.type != GIH_SINK_AIO) {return;}
+
+    sink_aio_wait(&gih->sink);
+    cancel_work_sync(&gih->aio_work);
+    gih_aio_work(&gih->aio_work);
+}
+
+/*
+ * Function name: gih_src_start
+ * 
+ * Function prototype:
+ *     static int gih_src_start(gih_dev * gih);
+ *     
+ * Description: 
+ *     Opens the playback source of @gih, if one is configured, and fills the
+ *     data ring from the start of it before the first interrupt. The file 
+ *     is read ahead twice as far as by default, as POSIX_FADV_SEQUENTIAL 
+ *     does, so the page cache stays ahead of the refills.
+ *     
+ * Arguments:
+ *     @gih: the gih instance
+ *     
+ * Side Effects:
+ *     The data ring is emptied then filled, src_filp of @gih is set.
+ *     
+ * Error Condition: 
+ *     Failing to open the source returns -EBADF, a mapped data ring -EBUSY,
+ *     nothing is changed. Caller needs to hold cfg_lock, the output must 
+ *     not be running.
+ *     
+ * Return: 
+ *     0 on success, -ERRORCODE on failure.
+ */
+static int gih_src_start(gih_dev * gih) {
+
+    struct file * filp;
+
+    if (!gih->source[0]) {return 0;}
+
+    if (atomic_read(&gih->mapped)) {
+        printk(KERN_ALERT "[gih] ERROR setting source: ring is mapped.\n");
+        return -EBUSY;
+    }
+
+    filp = file_open(gih->source, O_RDONLY | O_LARGEFILE, 0);
+    if (!filp) {return -EBADF;}
+
+    file_read_sequential(filp);
+
+    /* the feeder is gone, what it left isn't played */
+    mutex_lock(&gih->wrt_lock);
+    gih_ring_reset(gih);
+    gih->src_pos = 0;
+    gih->src_eof = FALSE;
+    WRITE_ONCE(gih->src_filp, filp);
+    mutex_unlock(&gih->wrt_lock);
+
+    gih_src_work(&gih->src_work);
+
+    return 0;
+}
+
+/*
+ * Function name: gih_src_stop
+ * 
+ * Function prototype:
+ *     static void gih_src_stop(gih_dev * gih);
+ *     
+ * Description: 
+ *     Stops the refills of the playback source and closes it, if any.
+ *     
+ * Arguments:
+ *     @gih: the gih instance
+ *     
+ * Side Effects:
+ *     No refill is pending or running on return, src_filp of @gih is 
+ *     cleared. What's in the data ring stays.
+ *     
+ * Error Condition: 
+ *     The output must already be stopped, otherwise a refill may be queued
+ *     again.
+ *     
+ * Return: 
+ *     None.
+ */
+static void gih_src_stop(gih_dev * gih) {
+
+    struct file * filp = gih->src_filp;
+
+    if (!filp) {return;}
+
+    cancel_work_sync(&gih->src_work);
+
+    mutex_lock(&gih->wrt_lock);
+    WRITE_ONCE(gih->src_filp, NULL);
+    mutex_unlock(&gih->wrt_lock);
+
+    file_close(filp);
+}
+
+/*
+ * Function name: gih_src_work
+ * 
+ * Function prototype:
+ *     static void gih_src_work(struct work_struct * work);
+ *     
+ * Description: 
+ *     Work function of the refills of the playback source, on the sync 
+ *     workqueue, queued by the outputs. Reads the source into all the free
+ *     space of the data ring, GIH_SRC_CHUNK bytes per read and publishing 
+ *     each one as a feeder would, so the output can take it meanwhile. At
+ *     the end of the source, it starts over with GIH_SRC_F_LOOP, otherwise 
+ *     the refills stop.
+ *     
+ * Arguments:
+ *     @work: the src_work of the gih device.
+ *     
+ * Side Effects:
+ *     Takes wrt_lock, the refill is the only producer of the data ring.
+ *     
+ * Error Condition: 
+ *     A failed read prints a message, the next output tries again. An empty
+ *     source is at its end, even looped.
+ *     
+ * Return: 
+ *     None.
+ */
+static void gih_src_work(struct work_struct * work) {
+
+    gih_dev * gih = container_of(work, gih_dev, src_work);
+    struct __kfifo * fifo = &gih->data_buf.kfifo;
+    unsigned int free;
+    int ret;
+
+    mutex_lock(&gih->wrt_lock);
+
+    while (gih->src_filp && !gih->src_eof && (free = gih_ring_free(gih))) {
+
+        ret = file_read_kfifo(gih->src_filp, &gih->src_pos, &gih->data_buf,
+            min_t(unsigned int, free, GIH_SRC_CHUNK));
+
+        if (ret < 0) {
+            printk_ratelimited(KERN_ALERT "[gih] ERROR reading source: "
+                "%d\n", ret);
+            break;
+        }
+
+        if (ret == 0) {
+            if ((gih->source_flags & GIH_SRC_F_LOOP) && gih->src_pos)
+                gih->src_pos = 0;
+            else
+                gih->src_eof = TRUE;
+            continue;
+        }
+
+        fifo->in += ret;
+        smp_store_release(&gih->ring_ctrl->head, fifo->in);
+
+        trace_gih_write_enqueued(gih->index, ret, 
+            fifo->in - READ_ONCE(fifo->out));
+        stat_add(gih->stats, GIH_STAT_BYTES_IN, ret);
+    }
+
+    mutex_unlock(&gih->wrt_lock);
+}
+
+/*
+ * Function name: gih_intr
+ * 
+ * Function prototype:
+ *     static irqreturn_t gih_intr(int irq, void * data);
+ *     
+ * Description: 
+ *     Interrupt handler of the gih device. Top half will record a log of when 
+ *     interrupt had happened and put a pending event (interrupt time, sequence
+ *     number and byte budget) on the event queue, so every interrupt gets its
+ *     own output. The output timer is armed with an absolute deadline of 
+ *     interrupt time + delay; once the deadline is hit, the timer queues the 
+ *     work of sending output data on the workqueue.
+ *     
+ * Arguments:
+ *     @irq:  Unused, GIH_IRQ_NONE from the software trigger.
+ *     @data: the gih instance which registered the irq
+ *     
+ * Side Effects:
+ *     Write a log to the intr_log device. Queues an event and arms the output
+ *     timer; with staging on, kicks the output to stage the event.
+ *     
+ * Error Condition: 
+ *     If the event queue is full the interrupt is dropped and a warning is 
+ *     printed. Otherwise if any happened there would be undefined behavior.
+ *     
+ * Return: 
+ *     IRQ_HANDLED on success.
+ */
+static irqreturn_t gih_intr(int irq, void * data) {
+    /* queue event, arm output timer, write log */
+    gih_dev * gih = data;
+    struct log intr_log; 
+    struct gih_event evt;
+
+    evt.stamp = ktime_get();
+    log_stamp(gih, &intr_log, evt.stamp);
+
+    evt.seq = gih->logs[INTR_LOG_MINOR].irq_count++;
+    evt.log_stamp = intr_log.stamp;
+    evt.budget = gih->write_size;
+
+    trace_gih_irq_caught(gih->index, evt.seq);
+    stat_inc(gih->stats, GIH_STAT_IRQS);
+
+    if (kfifo_put(&gih->events, evt)) {
+        gih_arm_timer(gih, ktime_add(evt.stamp, READ_ONCE(gih->delay)));
+
+        /* the first pending event, have the output stage it right away */
+        if (gih->stage && kfifo_len(&gih->events) == 1)
+            gih_kick(gih);
+    }
+    else {
+        trace_gih_overflow(gih->index, GIH_OVF_EVENT, evt.seq);
+        stat_inc(gih->stats, GIH_STAT_IRQS_MISSED);
+        printk_ratelimited(KERN_ALERT "[gih] WARNING: event queue is full, "
+            "interrupt %lu dropped.\n", evt.seq);
+    }
+
+    intr_log.byte_sent = -1; 
+    intr_log.irq_count = evt.seq;
+
+    log_push(&gih->logs[INTR_LOG_MINOR], &intr_log);
+
+    /* perhaps also try kernel thread, given the work function in this way */
+
+    return IRQ_HANDLED;
+}
+
+/*
+ * Function name: gih_timer_fn
+ * 
+ * Function prototype:
+ *     static enum hrtimer_restart gih_timer_fn(struct hrtimer * timer);
+ *     
+ * Description: 
+ *     Callback of the output timer, runs when the deadline set by gih_intr()
+ *     is hit. Queues the output work on the workqueue, or wakes up the 
+ *     kthread engine. Runs in interrupt context, so nothing here may sleep.
+ *     
+ * Arguments:
+ *     @timer: the output timer of the gih device.
+ *     
+ * Side Effects:
+ *     The output work is queued on the work queue, or the engine kicked.
+ *     
+ * Error Condition: 
+ *     If the work (or kick) is still pending from the previous deadline, the
+ *     output is coalesced into it.
+ *     
+ * Return: 
+ *     HRTIMER_NORESTART, timer is re-armed by the next interrupt or by the 
+ *     work function.
+ */
+static enum hrtimer_restart gih_timer_fn(struct hrtimer * timer) {
+
+    gih_dev * gih = container_of(timer, gih_dev, timer);
+
+    gih_kick(gih);
+
+    return HRTIMER_NORESTART;
+}
+
+/*
+ * Function name: gih_kick
+ * 
+ * Function prototype:
+ *     static void gih_kick(gih_dev * gih);
+ *     
+ * Description: 
+ *     Has the output run gih_drain(): queues the output work on the 
+ *     workqueue, or wakes up the kthread engine. The work is queued on the
+ *     CPU the kick comes from, or on out_cpu if that one is off the node 
+ *     of the device. Never sleeps.
+ *     
+ * Arguments:
+ *     @gih: the gih instance
+ *     
+ * Side Effects:
+ *     The output work is queued on the work queue, or the engine kicked.
+ *     
+ * Error Condition: 
+ *     A kick while one is still pending is coalesced into it.
+ *     
+ * Return: 
+ *     None.
+ */
+static void gih_kick(gih_dev * gih) {
+
+    if (gih->engine_task) {
+        atomic_set(&gih->engine_kick, 1);
+        wake_up_process(gih->engine_task);
+    }
+    else if (gih->out_node == NUMA_NO_NODE || 
+             cpu_to_node(raw_smp_processor_id()) == gih->out_node)
+        queue_work(gih->irq_wq, &gih->work);
+    else
+        queue_work_on(gih->out_cpu, gih->irq_wq, &gih->work);
+}
+
+/*
+ * Function name: gih_arm_timer
+ * 
+ * Function prototype:
+ *     static void gih_arm_timer(gih_dev * gih, ktime_t deadline);
+ *     
+ * Description: 
+ *     Arms the output timer for @deadline, unless it's already armed for an
+ *     earlier deadline. Called from both the interrupt handler and the work 
+ *     function, the check-and-arm is done under timer_lock so the timer always
+ *     ends up armed for the earliest pending event.
+ *     
+ * Arguments:
+ *     @gih: the gih instance
+ *     @deadline: absolute monotonic time the output should happen.
+ *     
+ * Side Effects:
+ *     Output timer is (re-)armed.
+ *     
+ * Error Condition: 
+ *     None. A deadline in the past fires the timer right away. Nothing is
+ *     armed once the timer is turned off by gih_timer_off().
+ *     
+ * Return: 
+ *     None.
+ */
+static void gih_arm_timer(gih_dev * gih, ktime_t deadline) {
+
+    unsigned long flags;
+
+    spin_lock_irqsave(&gih->timer_lock, flags);
+
+    if (gih->timer_on && (!hrtimer_is_queued(&gih->timer) || 
+        ktime_before(deadline, hrtimer_get_expires(&gih->timer))))
+        hrtimer_start(&gih->timer, deadline, HRTIMER_MODE_ABS);
+
+    spin_unlock_irqrestore(&gih->timer_lock, flags);
+}
+
+/*
+ * Function name: gih_timer_off
+ * 
+ * Function prototype:
+ *     static void gih_timer_off(gih_dev * gih);
+ *     
+ * Description: 
+ *     Cancels the output timer for good: it can't be re-armed by an output 
+ *     still draining until the device is started again.
+ *     
+ * Arguments:
+ *     @gih: the gih instance
+ *     
+ * Side Effects:
+ *     Output timer is cancelled, waiting for a running callback.
+ *     
+ * Error Condition: 
+ *     None.
+ *     
+ * Return: 
+ *     None.
+ */
+static void gih_timer_off(gih_dev * gih) {
+
+    unsigned long flags;
+
+    spin_lock_irqsave(&gih->timer_lock, flags);
+    gih->timer_on = FALSE;
+    spin_unlock_irqrestore(&gih->timer_lock, flags);
+
+    hrtimer_cancel(&gih->timer);
+}
+
+/*
+ * Function name: gih_trigger
+ * 
+ * Function prototype:
+ *     static int gih_trigger(gih_dev * gih, const struct gih_trigger * trig);
+ *     
+ * Description: 
+ *     GIH_IOC_TRIGGER, synthetic interrupts for tests and benchmarks. Fires 
+ *     @trig->burst interrupts right away if @trig->period_ns is 0, otherwise
+ *     (re-)starts the trigger timer with the period, burst and count of 
+ *     @trig. Any trigger timer running is stopped first.
+ *     
+ * Arguments:
+ *     @gih: the gih instance
+ *     @trig: the trigger, already copied from user space
+ *     
+ * Side Effects:
+ *     Interrupts go through gih_intr(), see there.
+ *     
+ * Error Condition: 
+ *     A device not running, or running with an irq line, returns -EINVAL; so
+ *     do a period below GIH_TRIG_MIN_PERIOD and a burst above 
+ *     GIH_TRIG_MAX_BURST, or 0 with a period. Caller needs to hold cfg_lock.
+ *     
+ * Return: 
+ *     0 on success, -ERRORCODE on failure.
+ */
+static int gih_trigger(gih_dev * gih, const struct gih_trigger * trig) {
+
+    if (!gih->setup || gih->irq != GIH_IRQ_NONE) {
+        printk(KERN_ALERT "[gih] ERROR triggering: device needs to be "
+            "running without an irq.\n");
+        return -EINVAL;
+    }
+
+    if (trig->burst > GIH_TRIG_MAX_BURST || (trig->period_ns && 
+        (trig->period_ns < GIH_TRIG_MIN_PERIOD || trig->burst == 0))) {
+        printk(KERN_ALERT "[gih] ERROR: trigger period needs to be at least "
+            "%d ns, burst in [1, %d].\n", GIH_TRIG_MIN_PERIOD, 
+            GIH_TRIG_MAX_BURST);
+        return -EINVAL;
+    }
+
+    hrtimer_cancel(&gih->trig_timer);
+
+    if (trig->period_ns == 0) {
+        gih_trig_fire(gih, trig->burst);
+        return 0;
+    }
+
+    gih->trig_period = ns_to_ktime(trig->period_ns);
+    gih->trig_burst  = trig->burst;
+    gih->trig_left   = trig->count;
+    hrtimer_start(&gih->trig_timer, gih->trig_period, HRTIMER_MODE_REL);
+
+    if (GIH_DEBUG) 
+        printk(KERN_ALERT "[gih] trigger every %llu ns, burst %u, count %u\n",
+            trig->period_ns, trig->burst, trig->count);
+
+    return 0;
+}
+
+/*
+ * Function name: gih_trig_fire
+ * 
+ * Function prototype:
+ *     static void gih_trig_fire(gih_dev * gih, unsigned int n);
+ *     
+ * Description: 
+ *     Fires @n software interrupts back to back, calling gih_intr() with
+ *     local interrupts disabled like the irq line would.
+ *     
+ * Arguments:
+ *     @gih: the gih instance
+ *     @n: number of interrupts
+ *     
+ * Side Effects:
+ *     See gih_intr(). Local interrupts are off for the whole burst.
+ *     
+ * Error Condition: 
+ *     None. Interrupts the event queue can't hold are dropped by gih_intr().
+ *     
+ * Return: 
+ *     None.
+ */
+static void gih_trig_fire(gih_dev * gih, unsigned int n) {
+
+    unsigned long flags;
+
+    /* the ioctl and the trigger timer may run on two CPUs at once */
+    spin_lock_irqsave(&gih->trig_lock, flags);
+    while (n--)
+        gih_intr(GIH_IRQ_NONE, gih);
+    spin_unlock_irqrestore(&gih->trig_lock, flags);
+}
+
+/*
+ * Function name: gih_trig_fn
+ * 
+ * Function prototype:
+ *     static enum hrtimer_restart gih_trig_fn(struct hrtimer * timer);
+ *     
+ * Description: 
+ *     Callback of the trigger timer, fires a burst of software interrupts 
+ *     and forwards the timer by a period until count periods are done. 
+ *     Periods missed because the callback ran late are skipped, not fired 
+ *     late.
+ *     
+ * Arguments:
+ *     @timer: the trigger timer of the gih device.
+ *     
+ * Side Effects:
+ *     See gih_trig_fire().
+ *     
+ * Error Condition: 
+ *     None.
+ *     
+ * Return: 
+ *     HRTIMER_RESTART while periods are left, HRTIMER_NORESTART otherwise.
+ */
+static enum hrtimer_restart gih_trig_fn(struct hrtimer * timer) {
+
+    gih_dev * gih = container_of(timer, gih_dev, trig_timer);
+
+    gih_trig_fire(gih, gih->trig_burst);
+
+    if (gih->trig_left && --gih->trig_left == 0)
+        return HRTIMER_NORESTART;
+
+    hrtimer_forward_now(timer, gih->trig_period);
+    return HRTIMER_RESTART;
+}
+
+/*
+ * Function name: gih_trig_stop
+ * 
+ * Function prototype:
+ *     static void gih_trig_stop(gih_dev * gih);
+ *     
+ * Description: 
+ *     Stops the trigger timer, if any.
+ *     
+ * Arguments:
+ *     @gih: the gih instance
+ *     
+ * Side Effects:
+ *     Trigger timer is cancelled, waiting for a running callback.
+ *     
+ * Error Condition: 
+ *     None.
+ *     
+ * Return: 
+ *     None.
+ */
+static void gih_trig_stop(gih_dev * gih) {
+
+    hrtimer_cancel(&gih->trig_timer);
+}
+
+
+/* log device function definitions */
+
+/*
+ * Function name: log_open
+ * 
+ * Function prototype:
+ *     static int log_open(struct inode * inode, struct file * filp);
+ *     
+ * Description: 
+ *     Open the log device mounted at /dev, for reading logs. Retrieves the 
+ *     minor number to identify which log device have been opened.
+ *     
+ * Arguments:
+ *     @inode: inode pointer of the log char device 
+ *     @filp:  file pointer of the log char device 
+ *     
+ * Side Effects:
+ *     Sets the private_data field of @filp to a new reader of the log device
+ *     in text format, with room to merge all the rings of the device, its 
+ *     cursors at the oldest logs held, and adds it to the readers of the 
+ *     device; reset the offset into the file. Any number of files may read
+ *     the device at the same time, each gets all the logs.
+ *     
+ * Error Condition: 
+ *     If the reader can't be allocated will return -ENOMEM
+ *     
+ * Return: 
+ *     0 on success, -ERRORCODE on failure.
+ */
+static int log_open(struct inode * inode, struct file * filp) {
+
+    unsigned int minor = iminor(inode);
+    log_dev * device = 
+        &gih_module.devices[minor / NUM_LOG_DEV]->logs[minor % NUM_LOG_DEV];
+    log_reader * reader;
+    struct log_ring * ring;
+    unsigned int n = device->percpu ? nr_cpu_ids : 1;
+    unsigned int in;
+    int cpu;
+
+    reader = kzalloc(sizeof(log_reader), GFP_KERNEL);
+    if (reader) {
+        reader->cursor = kcalloc(n, sizeof(unsigned int), GFP_KERNEL);
+        reader->merge  = kmalloc_array(n, sizeof(int), GFP_KERNEL);
+    }
+
+    if (!reader || !reader->cursor || !reader->merge) {
+        if (reader) {
+            kfree(reader->cursor);
+            kfree(reader->merge);
+        }
+        kfree(reader);
+        return -ENOMEM;
+    }
+
+    reader->device  = device;
+    reader->format  = GIH_LOG_FMT_TEXT;
+    reader->batch   = LOG_DEF_BATCH;
+
+    mutex_lock(&device->dev_open);
+
+    /* from the oldest log still held, as a reader that kept up */
+    for_each_log_ring(cpu, device) {
+        ring = per_cpu_ptr(device->rings, cpu);
+        in = smp_load_acquire(&ring->in);
+        reader->cursor[cpu] = in - min(in, ring->mask);
+    }
+
+    list_add(&reader->node, &device->readers);
+    mutex_unlock(&device->dev_open);
+
+    filp->private_data = reader;
+    filp->f_pos = 0;
+
+    if (GIH_DEBUG) printk(KERN_ALERT "[log] Log device %u opened\n", minor);
+
+    return 0;
+}
+
+/*
+ * Function name: log_close
+ * 
+ * Function prototype:
+ *     static int log_close(struct inode * inode, struct file * filp);
+ *     
+ * Description: 
+ *     Close the opened log device.
+ *     
+ * Arguments:
+ *     @inode: inode pointer of the log char device 
+ *     @filp:  file pointer of the log char device 
+ *     
+ * Side Effects:
+ *     Removes the reader from the readers of the device, 
+ *     frees the reader and clears the private_data filed of @filp.
+ *     
+ * Error Condition: 
+ *     None, if any happens will result in undefined behavior.
+ *     
+ * Return: 
+ *     0 on success
+ */
+static int log_close(struct inode * inode, struct file * filp) {
+
+    unsigned int minor = iminor(inode);
+    log_reader * reader = filp->private_data;
+
+    mutex_lock(&reader->device->dev_open);
+    list_del(&reader->node);
+    mutex_unlock(&reader->device->dev_open);
+
+    kfree(reader->cursor);
+    kfree(reader->merge);
+    kfree(reader);
+    filp->private_data = NULL;
+
+    if (GIH_DEBUG) printk(KERN_ALERT "[log] Log device %u released\n", minor);
+    return 0;
+}
+
+/*
+ * Function name: log_read
+ * 
+ * Function prototype:
+ *     static ssize_t log_read(struct file * filp, 
+ *                             char __user * buf, 
+ *                             size_t len, 
+ *                             loff_t * offset);
+ *     
+ * Description: 
+ *     Read the logs stored in the log device. Reading moves the cursors of
+ *     this file only, the logs stay for the other readers of the device 
+ *     until the writer overwrites them. The rings of a
+ *     per CPU log device are merged by time (see log_merge_next()), so the 
+ *     logs come out in order whichever CPUs they were taken on. Depending on
+ *     the format of the reader (see log_ioctl()), logs are either formatted 
+ *     into text lines by log_read_text(), or copied out as binary records by
+ *     log_read_bin().
+ *     
+ * Arguments:
+ *     @filp: file pointer to the log device
+ *     @buf:  output buffer to write to 
+ *     @len:  length of the data to read. 
+ *     @offset: offset into the log device, used to mark reading finish. 
+ *     
+ * Side Effects:
+ *     The cursors of the reader pass the logs read, and the logs it was 
+ *     lapped on, see log_lapped().
+ *     
+ * Error Condition: 
+ *     See log_read_text() and log_read_bin().
+ *     
+ * Return: number of bytes outputted from log device.
+ *     
+ */
+static ssize_t log_read(struct file * filp, 
+                        char __user * buf, 
+                        size_t len, 
+                        loff_t * offset) {
+
+    log_reader * reader = filp->private_data;
+
+    if (reader->format == GIH_LOG_FMT_BIN)
+        return log_read_bin(reader, buf, len);
+
+    return log_read_text(reader, buf, len, offset);
+}
+
+/*
+ * Function name: log_read_text
+ * 
+ * Function prototype:
+ *     static ssize_t log_read_text(log_reader * reader,
+ *                                  char __user * buf, 
+ *                                  size_t len, 
+ *                                  loff_t * offset);
+ *     
+ * Description: 
+ *     Read the logs stored in the log device as text, one line per log. Each
+ *     read will extract all the logs stored in the device. 
+ *     
+ * Arguments:
+ *     @reader: the reader of the log device to read from
+ *     @buf:  output buffer to write to 
+ *     @len:  length of the data to read. Should be set to the maximum possible
+ *            amount of logs stored.
+ *     @offset: offset into the log device, used to mark reading finish. 
+ *     
+ * Side Effects:
+ *     The cursors of the reader pass the logs read. 
+ *     
+ * Error Condition: 
+ *     If buf is somehow not big enough, partial reading will occur, and may 
+ *     result in log information disappearing. Make sure the buf (len) is big 
+ *     enough for reading from log.
+ *     (Recommended set this value to LOG_STR_BUF_SZ * the log ring size, 
+ *     see gih.h)
+ *     
+ * Return: number of bytes outputted from log device.
+ *     
+ */
+static ssize_t log_read_text(log_reader * reader, 
+                             char __user * buf, 
+                             size_t len, 
+                             loff_t * offset) {
+
+    log_dev * device = reader->device;
+    size_t amount_log;
+    size_t finished_log; 
+
+    int log_len;
+    char line[LOG_STR_BUF_SZ];
+
+    union log_rec rec;
+    int cpu;
+
+    if (*offset != 0) {return 0;}
+
+    amount_log = log_merge_start(reader);
+
+    if (GIH_DEBUG) printk(KERN_ALERT "[log] Reading from log device %d, "
+            "with %zu entries.\n", MINOR(device->dev_num), amount_log);
+
+    /* this function doesn't do much of checking, 
+       try to make enough read size in user-land 
+       otherwise data may be truncated */
+
+    for (finished_log = 0; 
+         finished_log < amount_log && len > 0; 
+         finished_log++) {
+
+        /* only taken out once it fits */
+        if ((cpu = log_merge_next(reader, &rec)) < 0) break;
+
+        log_len = log_sprint(device, &rec, line, sizeof(line));
+
+        if (log_len > len) break;
+
+        if (copy_to_user(buf, line, log_len)) 
+            return *offset ? *offset : -EFAULT;
+
+        reader->cursor[cpu]++;
+
+        len -= log_len;
+        *offset += log_len;
+        buf += log_len;
+    }
+    return *offset;
+}
+
+/*
+ * Function name: log_read_bin
+ * 
+ * Function prototype:
+ *     static ssize_t log_read_bin(log_reader * reader,
+ *                                 char __user * buf, 
+ *                                 size_t len);
+ *     
+ * Description: 
+ *     Read the logs stored in the log device as binary struct log records,
+ *     or struct event_log ones of the event log (see gih.h, version 
+ *     GIH_LOG_VERSION). When a single ring holds logs, 
+ *     as when one CPU takes all the interrupts, they are copied straight 
+ *     from the ring to @buf (see log_read_ring()); otherwise the 
+ *     rings are merged by time, LOG_MERGE_CHUNK logs per copy. Unlike the 
+ *     text format, every read returns the logs currently available, so the 
+ *     device can be read continuously.
+ *     
+ * Arguments:
+ *     @reader: the reader of the log device to read from
+ *     @buf:  output buffer to write to 
+ *     @len:  length of the data to read. Only whole records are read.
+ *     
+ * Side Effects:
+ *     The cursors of the reader pass the logs read. 
+ *     
+ * Error Condition: 
+ *     @len smaller than one record will return -EINVAL.
+ *     Faulting @buf will return -EFAULT, or the bytes copied before the 
+ *     fault; merged logs of the faulting copy are lost.
+ *     
+ * Return: number of bytes outputted from log device, a multiple of the 
+ *     record size, 0 if there's no log.
+ *     
+ */
+static ssize_t log_read_bin(log_reader * reader, 
+                            char __user * buf, 
+                            size_t len) {
+
+    log_dev * device = reader->device;
+    ssize_t copied = 0;
+    unsigned int n;
+    char chunk[LOG_MERGE_CHUNK * sizeof(union log_rec)];
+    int cpu;
+
+    if (len < device->rec_size) {return -EINVAL;}
+
+    len -= len % device->rec_size;
+
+    log_merge_start(reader);
+
+    if (reader->n_merge == 1) {
+        copied = log_read_ring(reader, reader->merge[0], buf, len);
+        if (copied < 0) {return copied;}
+    }
+    else while (copied < len) {
+
+        for (n = 0; n < LOG_MERGE_CHUNK && 
+             copied + (n + 1) * device->rec_size <= len; n++) {
+            cpu = log_merge_next(reader, chunk + n * device->rec_size);
+            if (cpu < 0) break;
+            reader->cursor[cpu]++;
+        }
+
+        if (!n) break;
+
+        if (copy_to_user(buf + copied, chunk, n * device->rec_size)) 
+            return copied ? copied : -EFAULT;
+
+        copied += n * device->rec_size;
+    }
+
+    if (GIH_DEBUG) 
+        printk(KERN_ALERT "[log] %zd bytes read from log device %d\n", 
+            copied, MINOR(device->dev_num));
+
+    return copied;
+}
+
+/*
+ * Function name: log_ioctl
+ * 
+ * Function prototype:
+ *     static long log_ioctl(struct file * filp, 
+ *                           unsigned int cmd, 
+ *                           unsigned long arg);
+ *     
+ * Description: 
+ *     Configures an opened log device file: 
+ *         -GIH_LOG_IOC_FORMAT sets the output format of this file, being 
+ *          GIH_LOG_FMT_TEXT (the default) or GIH_LOG_FMT_BIN.
+ *         -GIH_LOG_IOC_VERSION returns the version of the binary record.
+ *         -GIH_LOG_IOC_BATCH sets the number of logs for this file to poll
+ *          readable, LOG_DEF_BATCH on open.
+ *         -GIH_LOG_IOC_DROPS returns the number of logs this file lost to 
+ *          being lapped by the writer, see log_lapped().
+ *         -GIH_LOG_IOC_TAIL moves this file past all the logs held, so 
+ *          that it only reads the logs pushed from now on.
+ *     
+ * Arguments:
+ *     @filp: file pointer of the log char device
+ *     @cmd:  ioctl command to be performed
+ *     @arg:  argument passed to a specified ioctl 
+ *     
+ * Side Effects:
+ *     On GIH_LOG_IOC_FORMAT, the format of the reader is set to arg.
+ *     On GIH_LOG_IOC_BATCH, the batch of the reader is set to arg.
+ *     On GIH_LOG_IOC_TAIL, the cursors of the reader are moved to the head.
+ *     
+ * Error Condition: 
+ *     Unknown commands or format, or a batch not in [1, log ring size] will 
+ *     result in -EINVAL.
+ *     
+ * Return: 
+ *     GIH_LOG_VERSION on success, the number of logs lost for 
+ *     GIH_LOG_IOC_DROPS; -ERRORCODE on failure.
+ */
+static long log_ioctl(struct file * filp, 
+                      unsigned int cmd, 
+                      unsigned long arg) {
+
+    log_reader * reader = filp->private_data;
+    int cpu;
+
+    switch (cmd) {
+
+        /* output format of this reader */
+        case GIH_LOG_IOC_FORMAT:
+            if ((int)arg != GIH_LOG_FMT_TEXT && (int)arg != GIH_LOG_FMT_BIN) {
+                printk(KERN_ALERT "[log] ERROR: unknown log format %d\n", 
+                    (int)arg);
+                return -EINVAL;
+            }
 
-    udelay(gih.sleep_msec * 1000 - TIME_DELTA);
+            reader->format = (int)arg;
+
+            if (GIH_DEBUG) 
+                printk(KERN_ALERT "[log] Log device %d format set to %d\n", 
+                    MINOR(reader->device->dev_num), reader->format);
+            break;
+
+
+        /* version of the binary record */
+        case GIH_LOG_IOC_VERSION:
+            break;
+
+
+        /* poll threshold of this reader */
+        case GIH_LOG_IOC_BATCH:
+            if ((unsigned int)arg == 0 || (unsigned int)arg > 
+                per_cpu_ptr(reader->device->rings, 0)->mask + 1) {
+                printk(KERN_ALERT "[log] ERROR: batch %u out of range\n", 
+                    (unsigned int)arg);
+                return -EINVAL;
+            }
+
+            reader->batch = (unsigned int)arg;
+            break;
+
+
+        /* logs this reader lost */
+        case GIH_LOG_IOC_DROPS:
+            return min_t(u64, reader->dropped, LONG_MAX);
+
+
+        /* skip the logs held, read only what comes next */
+        case GIH_LOG_IOC_TAIL:
+            for_each_log_ring(cpu, reader->device)
+                reader->cursor[cpu] = smp_load_acquire(
+                    &per_cpu_ptr(reader->device->rings, cpu)->in);
+            break;
+
+
+        default:
+            return -EINVAL;
+    }
+
+    return GIH_LOG_VERSION;
+}
+
+/*
+ * Function name: log_poll
+ * 
+ * Function prototype:
+ *     static unsigned int log_poll(struct file * filp, poll_table * wait);
+ *     
+ * Description: 
+ *     poll/select/epoll on a log device. The file is readable once it has at
+ *     least batch logs to read (GIH_LOG_IOC_BATCH), so a consumer can 
+ *     harvest logs in batches instead of polling on a timer. The writer 
+ *     can't look at every reader, it wakes the pollers up once wake_at logs
+ *     were pushed: a poller that isn't readable lowers wake_at to where it 
+ *     will be, and checks again after, so that a log pushed meanwhile is 
+ *     never missed (the writer checks wake_at after pushing).
+ *     
+ * Arguments:
+ *     @filp: file pointer of the log char device
+ *     @wait: poll table
+ *     
+ * Side Effects:
+ *     The caller is added to the read_wait queue of the log device, wake_at
+ *     of the device may be lowered.
+ *     
+ * Error Condition: 
+ *     None.
+ *     
+ * Return: 
+ *     POLLIN | POLLRDNORM if readable, 0 otherwise.
+ */
+static unsigned int log_poll(struct file * filp, poll_table * wait) {
+
+    log_reader * reader = filp->private_data;
+    log_dev * device = reader->device;
+    unsigned int pushed;
+    unsigned int count;
+    unsigned int wake_at;
+    unsigned int old, prev;
+
+    poll_wait(filp, &device->read_wait, wait);
+
+    pushed = log_pushed(device);
+    count  = log_count(reader);
+    if (count >= reader->batch) {return POLLIN | POLLRDNORM;}
+
+    /* pushed before counted, the wake up is early rather than late */
+    wake_at = pushed + reader->batch - count;
+    old = READ_ONCE(device->wake_at);
+    while ((int)(wake_at - old) < 0) {
+        prev = cmpxchg(&device->wake_at, old, wake_at);
+        if (prev == old) break;
+        old = prev;
+    }
+
+    smp_mb();
+    if (log_count(reader) >= reader->batch) 
+        return POLLIN | POLLRDNORM;
+
+    return 0;
+}
+
+/*
+ * Function name: log_stamp
+ * 
+ * Function prototype:
+ *     static void log_stamp(gih_dev * gih, struct log * log, ktime_t now);
+ *     
+ * Description: 
+ *     Records the current time of the log clock of @gih into @log. With the
+ *     monotonic clock @now, already read by the caller, is used as is, so 
+ *     the log and the histograms agree and the clock is read once.
+ *     
+ * Arguments:
+ *     @gih: instance the log belongs to
+ *     @log: log to be stamped
+ *     @now: ktime_get() of the caller
+ *     
+ * Side Effects:
+ *     The time field of @log is set.
+ *     
+ * Error Condition: 
+ *     None.
+ *     
+ * Return: 
+ *     None.
+ */
+static void log_stamp(gih_dev * gih, struct log * log, ktime_t now) {
+
+    if (gih->log_clock == GIH_LOG_CLOCK_RAW)
+        log->stamp = ktime_get_raw_ns();
+    else
+        log->stamp = ktime_to_ns(now);
+}
+
+/*
+ * Function name: log_push
+ * 
+ * Function prototype:
+ *     static void log_push(log_dev * device, const void * log);
+ *     
+ * Description: 
+ *     Puts @log on the log ring of @device, and wakes up the pollers once 
+ *     wake_at logs were pushed (see log_poll()). A per CPU device is logged 
+ *     into the ring of the current CPU and must be called with preemption 
+ *     disabled, as from the interrupt handler; other devices have a single 
+ *     writer per device. The ring is broadcast: the log is written once 
+ *     whatever the number of readers, over the oldest log of a full ring,
+ *     the readers never hold the writer back.
+ *     
+ * Arguments:
+ *     @device: the log device
+ *     @log:    the log, a record of the device (see log_dev.rec_size)
+ *     
+ * Side Effects:
+ *     A poller of @device may be woken up.
+ *     
+ * Error Condition: 
+ *     If the ring is full, its oldest log is overwritten, lost for the 
+ *     readers that hadn't read it yet.
+ *     
+ * Return: 
+ *     None.
+ */
+static void log_push(log_dev * device, const void * log) {
+
+    struct log_ring * ring = device->percpu ? 
+        this_cpu_ptr(device->rings) : per_cpu_ptr(device->rings, 0);
+    unsigned int in = ring->in;
+    unsigned int pushed;
+
+    memcpy(ring->data + (in & ring->mask) * device->rec_size, log, 
+        device->rec_size);
+
+    /* the log is in before it's counted, and counted before the next log 
+       overwrites a slot, see log_peek() */
+    smp_store_release(&ring->in, in + 1);
+    smp_wmb();
+
+    /* other CPUs' rings are only looked at for a waiting poller */
+    if (wq_has_sleeper(&device->read_wait)) {
+        pushed = log_pushed(device);
+        if ((int)(pushed - READ_ONCE(device->wake_at)) >= 0) {
+            /* until the woken pollers set it again */
+            WRITE_ONCE(device->wake_at, pushed + INT_MAX);
+            wake_up_interruptible(&device->read_wait);
+        }
+    }
+}
+
+/*
+ * Function name: log_ring_alloc
+ * 
+ * Function prototype:
+ *     static int log_ring_alloc(log_dev * device, unsigned int n);
+ *     
+ * Description: 
+ *     (Re)allocates the log rings of @device to hold @n logs each, rounded up
+ *     to a power of 2. vmalloc-ed, large log rings are fine. A per CPU 
+ *     device has a ring for every possible CPU, so that all interrupts can
+ *     still be logged when they all go to the same CPU, each on the node of
+ *     its CPU; the ring of a single writer is on the node of the device.
+ *     
+ * Arguments:
+ *     @device: the log device
+ *     @n:      number of logs a ring holds
+ *     
+ * Side Effects:
+ *     The old log rings, if any, are freed with all the logs in them.
+ *     
+ * Error Condition: 
+ *     @n out of [LOG_FIFO_MIN_SZ, LOG_FIFO_MAX_SZ] returns -EINVAL, failed 
+ *     allocation returns -ENOMEM, the old rings are kept on failure. Nothing 
+ *     may be logging to or reading from @device meanwhile.
+ *     
+ * Return: 
+ *     0 on success, -ERRORCODE on failure.
+ */
+static int log_ring_alloc(log_dev * device, unsigned int n) {
+
+    void ** bufs;
+    struct log_ring * ring;
+    int cpu;
+    int error = 0;
+
+    if (n < LOG_FIFO_MIN_SZ || n > LOG_FIFO_MAX_SZ) {return -EINVAL;}
+    n = roundup_pow_of_two(n);
+
+    bufs = kcalloc(nr_cpu_ids, sizeof(void *), GFP_KERNEL);
+    if (!bufs) {return -ENOMEM;}
+
+    /* all the new rings first, so that the old ones are kept on failure */
+    for_each_log_ring(cpu, device) {
+        bufs[cpu] = vmalloc_node(n * device->rec_size, 
+            device->percpu ? cpu_to_node(cpu) : device->node);
+        if (!bufs[cpu]) {
+            printk(KERN_ALERT "[log] ERROR: allocate log ring of %u logs "
+                "failed\n", n);
+            error = -ENOMEM;
+            break;
+        }
+    }
+
+    for_each_log_ring(cpu, device) {
+        if (error) {
+            vfree(bufs[cpu]);
+            continue;
+        }
+
+        ring = per_cpu_ptr(device->rings, cpu);
+        vfree(ring->data);
+        ring->data = bufs[cpu];
+        ring->mask = n - 1;
+        ring->in   = 0;
+    }
+
+    kfree(bufs);
+    return error;
+}
+
+/*
+ * Function name: log_ring_move
+ * 
+ * Function prototype:
+ *     static int log_ring_move(log_dev * device, int node);
+ *     
+ * Description: 
+ *     Moves the ring of @device, a device of a single writer, onto @node. 
+ *     The logs are copied over, nothing is lost.
+ *     
+ * Arguments:
+ *     @device: the log device, not per CPU
+ *     @node:   the node, NUMA_NO_NODE for anywhere
+ *     
+ * Side Effects:
+ *     The ring's memory and the node of @device are replaced.
+ *     
+ * Error Condition: 
+ *     Failed allocation returns -ENOMEM, the ring stays where it is. Nothing
+ *     may be logging to or reading from @device meanwhile.
+ *     
+ * Return: 
+ *     0 on success, -ERRORCODE on failure.
+ */
+static int log_ring_move(log_dev * device, int node) {
+
+    struct log_ring * ring = per_cpu_ptr(device->rings, 0);
+    size_t size = (ring->mask + 1) * device->rec_size;
+    void * data;
+
+    data = vmalloc_node(size, node);
+    if (!data) {return -ENOMEM;}
+
+    memcpy(data, ring->data, size);
+    vfree(ring->data);
+    ring->data   = data;
+    device->node = node;
+
+    return 0;
+}
+
+/*
+ * Function name: log_pushed
+ * 
+ * Function prototype:
+ *     static unsigned int log_pushed(log_dev * device);
+ *     
+ * Description: 
+ *     Number of logs ever pushed to all the rings of @device, running 
+ *     freely, as log_ring.in.
+ *     
+ * Arguments:
+ *     @device: the log device
+ *     
+ * Side Effects:
+ *     None.
+ *     
+ * Error Condition: 
+ *     Logs pushed meanwhile may or may not be counted.
+ *     
+ * Return: 
+ *     The number of logs.
+ */
+static unsigned int log_pushed(log_dev * device) {
+
+    unsigned int pushed = 0;
+    int cpu;
+
+    for_each_log_ring(cpu, device)
+        pushed += READ_ONCE(per_cpu_ptr(device->rings, cpu)->in);
+
+    return pushed;
+}
+
+/*
+ * Function name: log_count
+ * 
+ * Function prototype:
+ *     static unsigned int log_count(log_reader * reader);
+ *     
+ * Description: 
+ *     Number of logs @reader has to read in all the rings of its device. A
+ *     ring it was lapped on counts as full.
+ *     
+ * Arguments:
+ *     @reader: the reader of the log device
+ *     
+ * Side Effects:
+ *     None.
+ *     
+ * Error Condition: 
+ *     Logs pushed meanwhile may or may not be counted.
+ *     
+ * Return: 
+ *     The number of logs.
+ */
+static unsigned int log_count(log_reader * reader) {
+
+    struct log_ring * ring;
+    unsigned int count = 0;
+    int cpu;
+
+    for_each_log_ring(cpu, reader->device) {
+        ring = per_cpu_ptr(reader->device->rings, cpu);
+        count += min(READ_ONCE(ring->in) - reader->cursor[cpu], 
+            ring->mask + 1);
+    }
+
+    return count;
+}
+
+/*
+ * Function name: log_lapped
+ * 
+ * Function prototype:
+ *     static unsigned int log_lapped(log_reader * reader, int cpu, 
+ *                                    unsigned int in);
+ *     
+ * Description: 
+ *     Moves the cursor of @reader in ring @cpu past the logs the writer 
+ *     overwrote, or may be overwriting, by the time @in logs were pushed: 
+ *     the log of index in - size is the one the writer writes next, so the
+ *     logs left to the reader are the newest size - 1.
+ *     
+ * Arguments:
+ *     @reader: the reader of the log device
+ *     @cpu:    the ring
+ *     @in:     log_ring.in read by the caller
+ *     
+ * Side Effects:
+ *     The logs lost are added to the drops of @reader and of the device.
+ *     
+ * Error Condition: 
+ *     None.
+ *     
+ * Return: 
+ *     The number of logs lost, 0 if @reader wasn't lapped.
+ */
+static unsigned int log_lapped(log_reader * reader, int cpu, unsigned int in) {
+
+    log_dev * device = reader->device;
+    unsigned int mask = per_cpu_ptr(device->rings, cpu)->mask;
+    unsigned int lost;
+
+    if (in - reader->cursor[cpu] <= mask) {return 0;}
+
+    lost = in - mask - reader->cursor[cpu];
+    reader->cursor[cpu] += lost;
+    reader->dropped += lost;
+
+    trace_gih_overflow(MINOR(device->dev_num), GIH_OVF_LOG, lost);
+    stat_add(device->stats, device->drop_stat, lost);
+
+    return lost;
+}
+
+/*
+ * Function name: log_peek
+ * 
+ * Function prototype:
+ *     static bool log_peek(log_reader * reader, int cpu, void * log);
+ *     
+ * Description: 
+ *     Copies out the log at the cursor of @reader in ring @cpu. The writer 
+ *     doesn't wait for the readers, so the log is checked to still be there
+ *     once copied, the copy is taken again of the next log if it was 
+ *     overwritten meanwhile.
+ *     
+ * Arguments:
+ *     @reader: the reader of the log device
+ *     @cpu:    the ring
+ *     @log:    the log, copied out, rec_size bytes
+ *     
+ * Side Effects:
+ *     The cursor is moved past the logs @reader was lapped on, see 
+ *     log_lapped(); the log stays to be read, the caller moves the cursor
+ *     once it's taken.
+ *     
+ * Error Condition: 
+ *     None.
+ *     
+ * Return: 
+ *     true if @log is set, false if the ring has no log left to @reader.
+ */
+static bool log_peek(log_reader * reader, int cpu, void * log) {
+
+    log_dev * device = reader->device;
+    struct log_ring * ring = per_cpu_ptr(device->rings, cpu);
+    unsigned int in;
+
+    do {
+        in = smp_load_acquire(&ring->in);
+        if (in == reader->cursor[cpu]) {return false;}
+        log_lapped(reader, cpu, in);
+
+        memcpy(log, ring->data + 
+            (reader->cursor[cpu] & ring->mask) * device->rec_size, 
+            device->rec_size);
+
+        smp_rmb();
+    } while (log_lapped(reader, cpu, READ_ONCE(ring->in)));
+
+    return true;
+}
+
+/*
+ * Function name: log_read_ring
+ * 
+ * Function prototype:
+ *     static ssize_t log_read_ring(log_reader * reader, int cpu, 
+ *                                  char __user * buf, size_t len);
+ *     
+ * Description: 
+ *     Copies the logs of ring @cpu straight to @buf, as binary records, with
+ *     at most two copies for the wrap of the ring. As in log_peek(), the 
+ *     copy is checked once done and taken again from the new cursor if the
+ *     writer lapped @reader meanwhile.
+ *     
+ * Arguments:
+ *     @reader: the reader of the log device
+ *     @cpu:    the ring
+ *     @buf:    output buffer to write to 
+ *     @len:    length of @buf, a multiple of the record size
+ *     
+ * Side Effects:
+ *     The cursor of @reader passes the logs copied.
+ *     
+ * Error Condition: 
+ *     Faulting @buf will return -EFAULT, the cursor isn't moved.
+ *     
+ * Return: 
+ *     Number of bytes copied, a multiple of the record size.
+ */
+static ssize_t log_read_ring(log_reader * reader, int cpu, 
+                             char __user * buf, size_t len) {
+
+    unsigned int size = reader->device->rec_size;
+    struct log_ring * ring = per_cpu_ptr(reader->device->rings, cpu);
+    unsigned int in, n, off, first;
+
+    do {
+        in = smp_load_acquire(&ring->in);
+        log_lapped(reader, cpu, in);
+
+        n = min_t(size_t, in - reader->cursor[cpu], len / size);
+        off = reader->cursor[cpu] & ring->mask;
+        first = min(n, ring->mask + 1 - off);
+
+        if (copy_to_user(buf, ring->data + off * size, first * size) ||
+            copy_to_user(buf + first * size, ring->data, (n - first) * size))
+            return -EFAULT;
+
+        smp_rmb();
+    } while (log_lapped(reader, cpu, READ_ONCE(ring->in)));
+
+    reader->cursor[cpu] += n;
+    return n * size;
+}
+
+/*
+ * Function name: log_merge_start
+ * 
+ * Function prototype:
+ *     static unsigned int log_merge_start(log_reader * reader);
+ *     
+ * Description: 
+ *     Starts a read of @reader: the rings of its device holding logs not 
+ *     read by @reader are taken into the merge of the read. Logs pushed to
+ *     the other rings meanwhile are left for the next read.
+ *     
+ * Arguments:
+ *     @reader: the reader of the log device
+ *     
+ * Side Effects:
+ *     The merge of @reader is set.
+ *     
+ * Error Condition: 
+ *     None.
+ *     
+ * Return: 
+ *     The number of logs to read in the merged rings, as log_count().
+ */
+static unsigned int log_merge_start(log_reader * reader) {
 
-    if (DEBUG) printk(KERN_ALERT "[gih] calling write\n");
-    out = file_write_kfifo(gih.dest_filp, &gih.data_buf, n_out_byte);
-    if (DEBUG) printk(KERN_ALERT "[gih] finished write\n");
+    log_dev * device = reader->device;
+    struct log_ring * ring;
+    unsigned int count = 0;
+    unsigned int len;
+    int cpu;
 
-    atomic_sub(out, &gih.data_wait);
+    reader->n_merge = 0;
 
-    if (DEBUG) {
-        printk(KERN_ALERT "[gih] %zu bytes read from gih.\n", out);
-        printk(KERN_ALERT "[gih] data_buf kfifo length is %d", 
-            kfifo_len(&gih.data_buf));
-        printk(KERN_ALERT "[gih] data_wait is %d", atomic_read(&gih.data_wait));
+    for_each_log_ring(cpu, device) {
+        ring = per_cpu_ptr(device->rings, cpu);
+        if ((len = READ_ONCE(ring->in) - reader->cursor[cpu])) {
+            reader->merge[reader->n_merge++] = cpu;
+            count += min(len, ring->mask + 1);
+        }
     }
 
-    file_sync(gih.dest_filp);
+    return count;
+}
 
-    mutex_unlock(&gih.wrt_lock);
+/*
+ * Function name: log_merge_next
+ * 
+ * Function prototype:
+ *     static int log_merge_next(log_reader * reader, void * log);
+ *     
+ * Description: 
+ *     k-way merge of the rings of a read: finds the oldest log at the 
+ *     cursors of @reader in the merged rings. Each ring is in time order, 
+ *     having one writer that stamps right before it logs, so the logs come
+ *     out all in time order across the rings. Rings found empty are dropped
+ *     from the merge; a read usually merges very few rings, the CPUs the 
+ *     interrupt was delivered to, so the rings are simply scanned.
+ *     
+ * Arguments:
+ *     @reader: the reader of the log device, see log_merge_start()
+ *     @log:    the oldest log, copied out, rec_size bytes
+ *     
+ * Side Effects:
+ *     The log stays to be read, move the cursor of the returned ring once
+ *     taken.
+ *     
+ * Error Condition: 
+ *     None.
+ *     
+ * Return: 
+ *     The ring of @log, -1 once all the merged rings are empty.
+ */
+static int log_merge_next(log_reader * reader, void * log) {
 
-    if (DEBUG) 
-        printk(KERN_ALERT "[gih] %zu bytes written out to dest file.\n", out);
+    union log_rec head;
+    u64 stamp = 0;
+    int oldest = -1;
+    int cpu;
+    unsigned int i = 0;
 
-    entry.byte_sent = -1,
-    entry.irq_count = log_devices[WQ_N_LOG_MINOR].irq_count++;
-    kfifo_in(&wq_n_buf, &entry, 1);
+    while (i < reader->n_merge) {
+        cpu = reader->merge[i];
 
-    if (DEBUG) printk(KERN_ALERT "[log] WQN element num %u\n", 
-        (unsigned int)kfifo_len(&wq_n_buf));
+        if (!log_peek(reader, cpu, &head)) {
+            reader->merge[i] = reader->merge[--reader->n_merge];
+            continue;
+        }
 
-    exit.byte_sent = out;
-    exit.irq_count = log_devices[WQ_X_LOG_MINOR].irq_count++;
-    
-    do_gettimeofday(&exit.time);
-    kfifo_in(&wq_x_buf, &exit, 1);
+        if (oldest < 0 || head.stamp < stamp) {
+            oldest = cpu;
+            stamp  = head.stamp;
+            memcpy(log, &head, reader->device->rec_size);
+        }
+        i++;
+    }
 
-    if (DEBUG) printk(KERN_ALERT "[log] WQX element num %u\n", 
-        (unsigned int)kfifo_len(&wq_x_buf));
+    return oldest;
+}
 
-    if (DEBUG) printk(KERN_ALERT "[gih] Exiting work queue function...\n");
+/*
+ * Function name: log_sprint
+ * 
+ * Function prototype:
+ *     static int log_sprint(log_dev * device, const union log_rec * rec, 
+ *                           char * line, size_t size);
+ *     
+ * Description: 
+ *     Formats record @rec of @device into a text line. All the lines start 
+ *     with the fixed width time of the record and the interrupt count, 
+ *     "[sssssssssss.nnnnnnnnn] interrupt count: N |"; event log lines add
+ *     the output start and end, in ns after the interrupt.
+ *     
+ * Arguments:
+ *     @device: the log device of @rec
+ *     @rec:    the record
+ *     @line:   buffer of the line
+ *     @size:   size of @line
+ *     
+ * Side Effects:
+ *     @line is set, NUL terminated.
+ *     
+ * Error Condition: 
+ *     The line is truncated to @size.
+ *     
+ * Return: 
+ *     Length of the line, as snprintf().
+ */
+static int log_sprint(log_dev * device, const union log_rec * rec, 
+                      char * line, size_t size) {
+
+    u64 sec;
+    u32 nsec;
+
+    sec = div_u64_rem(rec->stamp, NSEC_PER_SEC, &nsec);
+
+    if (device->rec_size == sizeof(struct event_log))
+        return snprintf(line, size, 
+            "[%010llu.%09u] interrupt count: %u | start: +%llu ns | "
+            "end: +%llu ns | write size: %d\n", sec, nsec,
+            rec->event.irq_count, 
+            rec->event.start_stamp - rec->event.irq_stamp,
+            rec->event.end_stamp - rec->event.irq_stamp,
+            rec->event.byte_sent);
+
+    return snprintf(line, size, 
+        "[%010llu.%09u] interrupt count: %u | write size: %d\n", sec, nsec,
+        rec->log.irq_count, rec->log.byte_sent);
 }
 
 /*
- * Function name: gih_intr
+ * Function name: hist_open
  * 
  * Function prototype:
- *     static irqreturn_t gih_intr(int irq, void * data);
+ *     static int hist_open(struct inode * inode, struct file * filp);
  *     
  * Description: 
- *     Interrupt handler of the gih device. Top half will record a log of when 
- *     interrupt had happened; bottom half will queue the work of sending output
- *     data on the workqueue.
+ *     Opens a histogram file of debugfs, gih/gihN/<stage>.
  *     
  * Arguments:
- *     @irq
- *     @data
- *     Unused.
+ *     @inode: inode of the debugfs file, its private data is the 
+ *             struct gih_hist_file
+ *     @filp:  file pointer of the debugfs file
  *     
  * Side Effects:
- *     Write a log to the intr_log device.
+ *     The file is set up to be read by hist_show().
  *     
  * Error Condition: 
- *     Not really, if any happened there would be undefined behavior.
+ *     Errors of single_open() are returned.
  *     
  * Return: 
- *     IRQ_HANDLED on success.
+ *     0 on success, -ERRORCODE on failure.
  */
-static irqreturn_t gih_intr(int irq, void * data) {
-    /* enqueue work, write log */
-    struct log intr_log; 
+static int hist_open(struct inode * inode, struct file * filp) {
+    return single_open(filp, hist_show, inode->i_private);
+}
 
-    if (DEBUG) printk(KERN_ALERT "[gih] INTERRUPT CAUGHT.\n");
+/*
+ * Function name: hist_show
+ * 
+ * Function prototype:
+ *     static int hist_show(struct seq_file * m, void * v);
+ *     
+ * Description: 
+ *     Prints one histogram, added up over all the CPUs: count, min, max, 
+ *     mean, p50, p99 and p99.9 in ns, then every non empty bucket as its 
+ *     lower and upper bound and count. Percentiles are the upper bound of 
+ *     their bucket.
+ *     
+ * Arguments:
+ *     @m: the seq file, its private data is the struct gih_hist_file
+ *     @v: Unused.
+ *     
+ * Side Effects:
+ *     None.
+ *     
+ * Error Condition: 
+ *     Failing to allocate the sum of the buckets returns -ENOMEM. The 
+ *     histogram may be updated while read, so the summary and the buckets
+ *     may be off by the values recorded meanwhile.
+ *     
+ * Return: 
+ *     0 on success, -ERRORCODE on failure.
+ */
+static int hist_show(struct seq_file * m, void * v) {
 
-    do_gettimeofday(&intr_log.time);
+    struct gih_hist_file * file = m->private;
+    struct gih_hist * h;
+    u64 * bucket;
+    u64 count = 0;
+    s64 min = 0, max = 0, sum = 0;
+    unsigned int b;
+    int cpu;
 
-    queue_work(gih.irq_wq, &gih.work);
+    bucket = kcalloc(HIST_BUCKETS, sizeof(u64), GFP_KERNEL);
+    if (!bucket) {return -ENOMEM;}
 
-    intr_log.byte_sent = -1; 
-    intr_log.irq_count = log_devices[INTR_LOG_MINOR].irq_count++;
+    for_each_possible_cpu(cpu) {
+        h = &per_cpu_ptr(file->gih->hist, cpu)->stage[file->stage];
 
-    kfifo_in(&ilog_buf, &intr_log, 1);
+        if (!READ_ONCE(h->count)) {continue;}
 
-    if (DEBUG) printk(KERN_ALERT "[log] Falling out: INT element num %u\n", 
-        (unsigned int)kfifo_len(&ilog_buf));
+        if (!count || h->min < min) min = h->min;
+        if (!count || h->max > max) max = h->max;
+        count += h->count;
+        sum   += h->sum;
 
-    /* perhaps also try kernel thread, given the work function in this way */
+        for (b = 0; b < HIST_BUCKETS; b++)
+            bucket[b] += h->bucket[b];
+    }
 
-    return IRQ_HANDLED;
+    seq_printf(m, "count: %llu\n", count);
+    seq_printf(m, "min: %lld ns\n", min);
+    seq_printf(m, "max: %lld ns\n", max);
+    seq_printf(m, "mean: %lld ns\n", count ? div64_s64(sum, count) : 0);
+    seq_printf(m, "p50: %lld ns\n", 
+        hist_percentile(bucket, count, 5000, min, max));
+    seq_printf(m, "p99: %lld ns\n", 
+        hist_percentile(bucket, count, 9900, min, max));
+    seq_printf(m, "p99.9: %lld ns\n", 
+        hist_percentile(bucket, count, 9990, min, max));
+
+    seq_puts(m, "buckets (lower ns, upper ns, count):\n");
+    for (b = 0; b < HIST_BUCKETS; b++)
+        if (bucket[b])
+            seq_printf(m, "%lld %lld %llu\n", hist_lower(b), hist_upper(b),
+                bucket[b]);
+
+    kfree(bucket);
+    return 0;
 }
 
+/*
+ * Function name: hist_write
+ * 
+ * Function prototype:
+ *     static ssize_t hist_write(struct file * filp, 
+ *                               const char __user * buf, 
+ *                               size_t count, 
+ *                               loff_t * f_pos);
+ *     
+ * Description: 
+ *     Writing anything to a histogram file resets the histogram, e.g.
+ *     "echo 0 > /sys/kernel/debug/gih/gih0/irq_to_start".
+ *     
+ * Arguments:
+ *     @filp:  file pointer of the debugfs file
+ *     @buf:   Unused.
+ *     @count: number of bytes written
+ *     @f_pos: Unused.
+ *     
+ * Side Effects:
+ *     The histogram is emptied on all the CPUs.
+ *     
+ * Error Condition: 
+ *     See hist_reset().
+ *     
+ * Return: 
+ *     @count.
+ */
+static ssize_t hist_write(struct file * filp, 
+                          const char __user * buf, 
+                          size_t count, 
+                          loff_t * f_pos) {
+
+    struct gih_hist_file * file = 
+        ((struct seq_file *)filp->private_data)->private;
 
-/* log device function definitions */
+    hist_reset(file->gih->hist, file->stage);
+
+    return count;
+}
 
 /*
- * Function name: log_open
+ * Function name: stat_show
  * 
  * Function prototype:
- *     static int log_open(struct inode * inode, struct file * filp);
+ *     static ssize_t stat_show(struct device * dev, 
+ *                              struct device_attribute * attr, char * buf);
  *     
  * Description: 
- *     Open the log device mounted at /dev, for reading logs. Retrieves the 
- *     minor number to identify which log device have been opened.
+ *     Reads a drop accounting counter of sysfs, e.g.
+ *     "cat /sys/class/gih/gih0/stats/bytes_full".
  *     
  * Arguments:
- *     @inode: inode pointer of the log char device 
- *     @filp:  file pointer of the log char device 
+ *     @dev:  the gih class device, its driver data is the gih instance
+ *     @attr: the counter, a dev_ext_attribute holding the GIH_STAT_*
+ *     @buf:  page to print the counter to
  *     
  * Side Effects:
- *     Locks the opening lock of the opened device;
- *     sets the private_data field of @filp to the log device structure;
- *     reset the offset into the file.
+ *     None.
  *     
  * Error Condition: 
- *     If the device is already opened will return -EBUSY
+ *     See stat_sum().
  *     
  * Return: 
- *     0 on success, -EBUSY if the device have been opened. 
+ *     Number of characters printed.
  */
-static int log_open(struct inode * inode, struct file * filp) {
+static ssize_t stat_show(struct device * dev, 
+                         struct device_attribute * attr, char * buf) {
 
-    unsigned int minor = iminor(inode);
+    gih_dev * gih = dev_get_drvdata(dev);
+    int stat = (long)container_of(attr, struct dev_ext_attribute, attr)->var;
 
-    if (!mutex_trylock(&log_devices[minor].dev_open)) {return -EBUSY;}
+    return sprintf(buf, "%llu\n", stat_sum(gih->stats, stat));
+}
 
-    filp->private_data = &log_devices[minor];
-    filp->f_pos = 0;
+/*
+ * Function name: lead_show
+ * 
+ * Function prototype:
+ *     static ssize_t lead_show(struct device * dev, 
+ *                              struct device_attribute * attr, char * buf);
+ *     
+ * Description: 
+ *     Reads the lead of the output timer in use, in ns, e.g.
+ *     "cat /sys/class/gih/gih0/lead_ns". See GIH_LEAD_ADAPT.
+ *     
+ * Arguments:
+ *     @dev:  the gih class device, its driver data is the gih instance
+ *     @attr: Unused.
+ *     @buf:  page to print the lead to
+ *     
+ * Side Effects:
+ *     None.
+ *     
+ * Error Condition: 
+ *     None.
+ *     
+ * Return: 
+ *     Number of characters printed.
+ */
+static ssize_t lead_show(struct device * dev, 
+                         struct device_attribute * attr, char * buf) {
 
-    if (DEBUG) printk(KERN_ALERT "[log] Log device %u opened\n", minor);
+    gih_dev * gih = dev_get_drvdata(dev);
 
-    return 0;
+    return sprintf(buf, "%lld\n", (long long)READ_ONCE(gih->lead_ns));
 }
 
 /*
- * Function name: log_close
+ * Function name: debug_set / debug_get
  * 
  * Function prototype:
- *     static int log_close(struct inode * inode, struct file * filp);
+ *     static int debug_set(const char * val, const struct kernel_param * kp);
+ *     static int debug_get(char * buffer, const struct kernel_param * kp);
  *     
  * Description: 
- *     Close the opened log device.
+ *     Setter and getter of the "debug" module parameter, which turns the 
+ *     verbose logging (GIH_DEBUG) on and off by flipping its static key.
  *     
  * Arguments:
- *     @inode: inode pointer of the log char device 
- *     @filp:  file pointer of the log char device 
+ *     @val:    new value, a boolean ("0", "1", "y", "n", ...)
+ *     @buffer: page to print the current value to
+ *     @kp:     Unused.
  *     
  * Side Effects:
- *     Unlocks the opening lock of the device, 
- *     clears the private_data filed of @filp.
+ *     debug_set() patches all the GIH_DEBUG branches in or out.
  *     
  * Error Condition: 
- *     None, if any happens will result in undefined behavior.
+ *     debug_set() returns -EINVAL for a value that's not a boolean.
  *     
  * Return: 
- *     0 on success
+ *     debug_set(): 0 on success, -ERRORCODE on failure. 
+ *     debug_get(): number of characters printed.
  */
-static int log_close(struct inode * inode, struct file * filp) {
+static int debug_set(const char * val, const struct kernel_param * kp) {
 
-    unsigned int minor = iminor(inode);
-    mutex_unlock(&log_devices[minor].dev_open);
+    bool on;
+    int error = kstrtobool(val, &on);
 
-    filp->private_data = NULL;
+    if (error) {return error;}
+
+    if (on)
+        static_branch_enable(&gih_debug_key);
+    else
+        static_branch_disable(&gih_debug_key);
 
-    if (DEBUG) printk(KERN_ALERT "[log] Log device %u released\n", minor);
     return 0;
 }
 
+static int debug_get(char * buffer, const struct kernel_param * kp) {
+    return sprintf(buffer, "%d\n", GIH_DEBUG ? 1 : 0);
+}
+
 /*
- * Function name: log_read
+ * Function name: gih_init
  * 
  * Function prototype:
- *     static ssize_t log_read(struct file * filp, 
- *                             char __user * buf, 
- *                             size_t len, 
- *                             loff_t * offset);
+ *     static int __init gih_init(void);
  *     
  * Description: 
- *     Read the logs stored in the log device. Since the logs are stored in 
- *     kfifo structure, reading will dequeue the stored entry. Each read will 
- *     extract all the logs stored in the device. 
+ *     Initializer of the gih module. Sets up the char device number regions 
+ *     and classes shared by all instances, sets up every gih instance with 
+ *     its log devices (see gih_setup_instance()), then adds the char 
+ *     devices so they can be opened.
  *     
  * Arguments:
- *     @filp: file pointer to the log device
- *     @buf:  output buffer to write to 
- *     @len:  length of the data to read. Should be set to the maximum possible
- *            amount of logs stored.
- *     @offset: offset into the log device, used to mark reading finish. 
+ *     None.
  *     
  * Side Effects:
- *     Reading will clear the log entries, by design. 
+ *     On success, the following fields are set to their correct value:
+ *         In gih_mod gih_module: 
+ *              unsigned int count;
+ *              dev_t dev_num;
+ *              dev_t log_dev_num;
+ *              struct class * gih_class;               
+ *              struct class * log_class;               
+ *              struct cdev gih_cdev;          
+ *              struct cdev log_cdev;         
+ *              gih_dev ** devices;        
  *     
  * Error Condition: 
- *     If buf is somehow not big enough, partial reading will occur, and may 
- *     result in log information disappearing. Make sure the buf (len) is big 
- *     enough for reading from log.
- *     (Recommended set this value to LOG_STR_BUF_SZ * LOG_FIFO_SZ, see gih.h)
- *     
- * Return: number of bytes outputted from log device.
+ *     Number of instances out of [1, GIH_MAX_INSTANCES] will return -EINVAL.
+ *     If any allocation fails, will undo whatever was done, return the 
+ *     appropriate error code and terminate the program.
  *     
+ * Return: 
+ *     0 on success, -ERRORCODE otherwise
  */
-static ssize_t log_read(struct file * filp, 
-                        char __user * buf, 
-                        size_t len, 
-                        loff_t * offset) {
-
-    size_t amount_log;
-    size_t finished_log; 
+static int __init gih_init(void) {
 
-    size_t log_len;
+    int error;
+    unsigned int i;
 
-    log_dev device;
-    struct log log;
+    if (instances < 1 || instances > GIH_MAX_INSTANCES) {
+        printk(KERN_ALERT "[gih] ERROR: number of instances needs to be in "
+            "[1, %d]\n", GIH_MAX_INSTANCES);
+        return -EINVAL;
+    }
+    gih_module.count = instances;
 
-    if (*offset != 0) {return 0;}
+    gih_module.devices = kcalloc(gih_module.count, sizeof(gih_dev *), 
+        GFP_KERNEL);
+    if (!gih_module.devices) {return -ENOMEM;}
 
-    device = *(log_dev*)filp->private_data;
-    amount_log = kfifo_len(device.buffer);
+    /* allocate Maj/Min for gih */
+    error = alloc_chrdev_region(&gih_module.dev_num, 0, gih_module.count, 
+        GIH_DEV);
+    if (error) {
+        printk(KERN_ALERT "[gih] ERROR: allocate dev num failed\n");
+        goto free_devices;
+    }
 
-    if (DEBUG) printk(KERN_ALERT "[log] Reading from log device %d, "
-            "with %zu entries.\n", MINOR(device.dev_num), amount_log);
+    /* allocate Maj/min for log */
+    error = alloc_chrdev_region(&gih_module.log_dev_num, 
+            0, gih_module.count * NUM_LOG_DEV, LOG_DEV);
+    if (error) {
+        printk(KERN_ALERT "[log] ERROR: allocate dev num failed\n");
+        goto free_gih_region;
+    }
 
-    /* this function doesn't do much of checking, 
-       try to make enough read size in user-land 
-       otherwise data may be truncated */
+    /* classes for the device nodes */
+    gih_module.gih_class = class_create(THIS_MODULE, GIH_DEV);
+    if (IS_ERR(gih_module.gih_class)) {
+        error = PTR_ERR(gih_module.gih_class);
+        goto free_log_region;
+    }
 
-    for (finished_log = 0; 
-         finished_log < amount_log && len > 0; 
-         finished_log++) {
+    gih_module.log_class = class_create(THIS_MODULE, LOG_DEV);
+    if (IS_ERR(gih_module.log_class)) {
+        error = PTR_ERR(gih_module.log_class);
+        goto free_gih_class;
+    }
 
-        kfifo_out(device.buffer, &log, 1);
+    /* debugfs, for the histograms; the module works without it */
+    gih_module.debug_dir = debugfs_create_dir(DEBUG_DIR, NULL);
+    if (IS_ERR_OR_NULL(gih_module.debug_dir)) {
+        printk(KERN_ALERT "[gih] WARNING: no debugfs, histograms are not "
+            "available\n");
+        gih_module.debug_dir = NULL;
+    }
 
-        // if (DEBUG) {
-        //     printk(KERN_ALERT "[log] out: bsent %zd, "
-        //         "ict %lu, time s %ld, time ms %ld\n",
-        //         *(ssize_t*)&log,
-        //         *(unsigned long*)((void*)&log+sizeof(ssize_t)),
-        //         *(long*)(&log+sizeof(ssize_t)+sizeof(unsigned long)),
-        //         *(long*)(&log+sizeof(ssize_t)+sizeof(unsigned long)+ 
-        //             sizeof(long)));
-        // }
+    /* all the instances, before they can be opened */
+    for (i = 0; i < gih_module.count; i++) {
+        error = gih_setup_instance(i);
+        if (error) {
+            printk(KERN_ALERT "[gih] ERROR: setup instance %u failed\n", i);
+            goto free_instances;
+        }
+    }
 
-        log_len = snprintf(buf, len - 1, 
-            "[%010ld.%06ld] interrupt count: %lu | write size: %zd\n", 
-            log.time.tv_sec, log.time.tv_usec,
-            log.irq_count, log.byte_sent);
+    /* initialize/add the cdev of gih */
+    cdev_init(&gih_module.gih_cdev, &gih_fops);
+    error = cdev_add(&gih_module.gih_cdev, gih_module.dev_num, 
+        gih_module.count);
+    if (error) {
+        printk(KERN_ALERT "[gih] ERROR: add cdev failed\n");
+        goto free_instances;
+    }
 
-        if (log_len < 0) return log_len;
-        if (log_len >= len) break;      /* for safety... */
+    /* initialize/add the cdev of log */
+    cdev_init(&gih_module.log_cdev, &log_fops);
+    error = cdev_add(&gih_module.log_cdev, gih_module.log_dev_num, 
+        gih_module.count * NUM_LOG_DEV);
+    if (error) {
+        printk(KERN_ALERT "[log] ERROR: add cdev failed\n");
+        goto free_gih_cdev;
+    }
 
-        len -= log_len;
-        *offset += log_len;
-        buf += log_len;
+    printk(KERN_ALERT "[gih] [log] gih module loaded, %u instance(s).\n",
+        gih_module.count);
+
+    if (GIH_DEBUG) {
+        printk(KERN_ALERT "[gih] GIH: Major: %d, Minor: %d-%d\n",
+                MAJOR(gih_module.dev_num), MINOR(gih_module.dev_num),
+                MINOR(gih_module.dev_num) + gih_module.count - 1);
+        printk(KERN_ALERT "[log] Log: Major: %d, Minor: %d-%d\n", 
+                MAJOR(gih_module.log_dev_num), 
+                MINOR(gih_module.log_dev_num),
+                MINOR(gih_module.log_dev_num) + 
+                    gih_module.count * NUM_LOG_DEV - 1);
     }
-    buf[*offset] = '\0';
-    return *offset;
+
+    return 0;
+
+free_gih_cdev:
+    cdev_del(&gih_module.gih_cdev);
+free_instances:
+    for (i = 0; i < gih_module.count; i++)
+        if (gih_module.devices[i])
+            gih_remove_instance(gih_module.devices[i]);
+    debugfs_remove_recursive(gih_module.debug_dir);
+    class_destroy(gih_module.log_class);
+free_gih_class:
+    class_destroy(gih_module.gih_class);
+free_log_region:
+    unregister_chrdev_region(gih_module.log_dev_num, 
+        gih_module.count * NUM_LOG_DEV);
+free_gih_region:
+    unregister_chrdev_region(gih_module.dev_num, gih_module.count);
+free_devices:
+    kfree(gih_module.devices);
+    return error;
 }
 
 /*
- * Function name: gih_init
+ * Function name: gih_setup_instance
  * 
  * Function prototype:
- *     static int __init gih_init(void);
+ *     static int gih_setup_instance(unsigned int index);
  *     
  * Description: 
- *     Initializer of the gih module. Sets up the char device number region,
- *     initializes the necessary char devices, and mount them under /dev.
- *     Sets up the device structure of gih and all 3 log devices.
- *     Initializes all the locks involved in the module
+ *     Allocates and sets up gih instance @index: its data ring, event queue,
+ *     output timer and locks, plus its log devices, and creates the device 
+ *     nodes /dev/gih<index> and /dev/gihlog<index>.<log type>. Instances 
+ *     share no state with each other.
  *     
  * Arguments:
- *     None.
+ *     @index: instance number, which is also its minor number
  *     
  * Side Effects:
- *     On success, the following fields are set to their correct value:
- *         In gih_dev gih: 
+ *     On success, gih_module.devices[@index] is set to the new instance.
+ *     The following fields of it are set to their correct value:
+ *         In gih_dev: 
+ *              unsigned int index;
  *              dev_t dev_num;
- *              struct class * gih_class;               
  *              struct device * gih_device;
+ *              struct hrtimer timer;
  *              struct mutex dev_open;          
  *              struct mutex wrt_lock;          
- *              struct cdev gih_cdev;          
- *              struct cdev log_cdev;         
+ *              struct workqueue_struct * sync_wq;
+ *              struct delayed_work sync_work;
+ *              struct gih_hists __percpu * hist;
+ *              struct dentry * debug_dir;
  *              struct kfifo data_buf;        
- *         In each log_dev[i]:
+ *              struct gih_ring_ctrl * ring_ctrl;        
+ *              events;
+ *         In each of its logs[i]:
  *              dev_t dev_num;              
- *              struct kfifo * buffer;      
- *              struct class * log_class;    
+ *              rings;      
  *              struct device * log_device; 
  *              struct mutex dev_open;     
  *     
  * Error Condition: 
- *     If any allocation fails, will return the appropriate error code and
- *     terminate the program.
+ *     If any allocation fails, will return the appropriate error code, a 
+ *     partially set up instance is left in gih_module.devices[@index] for 
+ *     gih_remove_instance().
  *     
  * Return: 
  *     0 on success, -ERRORCODE otherwise
  */
-static int __init gih_init(void) {
+static int gih_setup_instance(unsigned int index) {
 
     int error;
-    int gih_major;
-    int log_major;
+    unsigned int i;
+    gih_dev * gih;
+    log_dev * device;
+    char name[16];                  /* debugfs directory name */
 
-    /* data buffer of gih */
-    INIT_KFIFO(data_buf);
-    gih.data_buf = *(struct kfifo *)&data_buf;
+    gih = kzalloc(sizeof(gih_dev), GFP_KERNEL);
+    if (!gih) {return -ENOMEM;}
 
-    /* I tried to do initialize these 3 kfifos here, but the program won't 
-       compile... They're initialized at the beginning of this program. */
-    log_devices[INTR_LOG_MINOR].buffer = (struct kfifo *)&ilog_buf;
-    log_devices[WQ_N_LOG_MINOR].buffer = (struct kfifo *)&wq_n_buf;
-    log_devices[WQ_X_LOG_MINOR].buffer = (struct kfifo *)&wq_x_buf;
+    gih_module.devices[index] = gih;
+    gih->index   = index;
+    gih->dev_num = MKDEV(MAJOR(gih_module.dev_num), index);
 
-    /* allocate Maj/Min for gih */
-    error = alloc_chrdev_region(&gih.dev_num, 0, 1, GIH_DEV);
-    if (error) {
-        printk(KERN_ALERT "[gih] ERROR: allocate dev num failed\n");
-        return error;
+    /* output timer, deadlines are absolute monotonic time */
+    hrtimer_init(&gih->timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
+    gih->timer.function = gih_timer_fn;
+    spin_lock_init(&gih->timer_lock);
+
+    /* software trigger, periods are relative */
+    hrtimer_init(&gih->trig_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+    gih->trig_timer.function = gih_trig_fn;
+    spin_lock_init(&gih->trig_lock);
+
+    /* pending event queue */
+    INIT_KFIFO(gih->events);
+
+    /* initialize the mutexs */
+    mutex_init(&gih->dev_open);
+    mutex_init(&gih->wrt_lock);
+    mutex_init(&gih->cfg_lock);
+
+    /* output engine, the workqueue unless configured */
+    gih->engine  = GIH_ENGINE_WQ;
+    gih->rt_prio = GIH_DEF_RT_PRIO;
+    gih->cpu     = GIH_CPU_ANY;
+    atomic_set(&gih->engine_kick, 0);
+
+    /* placed nowhere in particular unless configured */
+    gih->node      = GIH_NODE_ANY;
+    gih->ring_node = NUMA_NO_NODE;
+    gih->out_node  = NUMA_NO_NODE;
+
+    /* output destination, a file unless configured */
+    gih->sink.type = GIH_SINK_FILE;
+    gih->sink.node = NUMA_NO_NODE;
+    gih->sink.ring_node = NUMA_NO_NODE;
+    mutex_init(&gih->sink.ring_lock);
+    atomic_set(&gih->sink.mapped, 0);
+    init_waitqueue_head(&gih->sink.read_wait);
+
+    /* durability of the destination, synced on its own workqueue */
+    gih->sync     = GIH_DEF_SYNC;
+    gih->sync_arg = GIH_DEF_SYNC_ARG;
+    INIT_DELAYED_WORK(&gih->sync_work, gih_sync_work);
+    INIT_WORK(&gih->src_work, gih_src_work);
+    gih->sync_wq = alloc_workqueue(SYNC_WQ_NAME_FMT, WQ_UNBOUND, 1, index);
+    if (!gih->sync_wq) {return -ENOMEM;}
+
+    /* completions of the aio sink are reaped there as well */
+    INIT_WORK(&gih->aio_work, gih_aio_work);
+    init_waitqueue_head(&gih->sink.aio_wait);
+    atomic_set(&gih->sink.aio_busy, 0);
+    gih->sink.aio_wq   = gih->sync_wq;
+    gih->sink.aio_work = &gih->aio_work;
+
+    /* drop accounting, per CPU, in sysfs with the device node */
+    gih->stats = alloc_percpu(struct gih_stats);
+    if (!gih->stats) {return -ENOMEM;}
+
+    /* latency histograms, per CPU, and their debugfs files */
+    gih->hist = alloc_percpu(struct gih_hists);
+    if (!gih->hist) {return -ENOMEM;}
+
+    if (gih_module.debug_dir) {
+        snprintf(name, sizeof(name), GIH_DEV_FMT, index);
+        gih->debug_dir = debugfs_create_dir(name, gih_module.debug_dir);
+
+        for (i = 0; i < NUM_HIST && !IS_ERR_OR_NULL(gih->debug_dir); i++) {
+            gih->hist_files[i].gih   = gih;
+            gih->hist_files[i].stage = i;
+            debugfs_create_file(hist_names[i], S_IRUGO | S_IWUSR, 
+                gih->debug_dir, &gih->hist_files[i], &hist_fops);
+        }
+
+        if (IS_ERR(gih->debug_dir)) {gih->debug_dir = NULL;}
     }
-    gih_major = MAJOR(gih.dev_num);
 
-    /* initialize/add the cdev of gih */
-    cdev_init(&gih.gih_cdev, &gih_fops);
-    error = cdev_add(&gih.gih_cdev, gih.dev_num, 1);
-    if (error) {
-        printk(KERN_ALERT "[gih] ERROR: add cdev failed\n");
+    /* logs stamped by the monotonic clock unless configured */
+    gih->log_clock = GIH_LOG_CLOCK_MONO;
+
+    /* raw bytes in the data ring unless configured */
+    gih->mode = GIH_MODE_BYTES;
+    gih->frame_limit = 0;
+    gih->stage = FALSE;
+
+    /* fixed lead of the output timer unless configured */
+    gih->lead_mode     = GIH_LEAD_FIXED;
+    gih->lead_usec     = TIME_DELTA;
+    gih->lead_min_usec = 0;
+    gih->lead_max_usec = GIH_DEF_LEAD_MAX;
+    gih->lead_ns       = (s64)TIME_DELTA * NSEC_PER_USEC;
+
+    /* poll */
+    gih->low_wat = GIH_DEF_LOW_WAT;
+    init_waitqueue_head(&gih->wrt_wait);
+
+    /* data buffer of gih, one control page followed by the ring, mappable
+       to user space */
+    atomic_set(&gih->mapped, 0);
+    error = gih_ring_alloc(gih, ring_size);
+    if (error) {return error;}
+
+    /* create device node */
+    gih->gih_device = device_create_with_groups(gih_module.gih_class, NULL, 
+        gih->dev_num, gih, gih_groups, GIH_DEV_FMT, index);
+    if (IS_ERR(gih->gih_device)) {
+        error = PTR_ERR(gih->gih_device);
+        gih->gih_device = NULL;
         return error;
     }
 
-    /* allocate Maj/min for log */
-    error = alloc_chrdev_region(&log_devices[INTR_LOG_MINOR].dev_num, 
-            0, 3, LOG_DEV);
-    if (error) {
-        printk(KERN_ALERT "[log] ERROR: allocate dev num failed\n");
-        return error;
+    /* log devices of this instance */
+    for (i = 0; i < NUM_LOG_DEV; i++) {
+
+        device = &gih->logs[i];
+        device->dev_num = MKDEV(MAJOR(gih_module.log_dev_num), 
+            index * NUM_LOG_DEV + i);
+        mutex_init(&device->dev_open);
+        INIT_LIST_HEAD(&device->readers);
+        init_waitqueue_head(&device->read_wait);
+        device->stats = gih->stats;
+        device->drop_stat = GIH_STAT_LOG_DROPS + i;
+
+        /* interrupts may be delivered on any CPU, outputs are serialized */
+        device->percpu = (i == INTR_LOG_MINOR);
+        device->rec_size = (i == EVENT_LOG_MINOR || i == AIO_LOG_MINOR) ? 
+            sizeof(struct event_log) : sizeof(struct log);
+        device->node = NUMA_NO_NODE;
+        device->rings = alloc_percpu(struct log_ring);
+        if (!device->rings) {return -ENOMEM;}
+
+        error = log_ring_alloc(device, log_size);
+        if (error) {return error;}
+
+        device->log_device = device_create(gih_module.log_class, 
+            gih->gih_device, device->dev_num, device, 
+            LOG_DEV_FMT, index, i);
+        if (IS_ERR(device->log_device)) {
+            error = PTR_ERR(device->log_device);
+            device->log_device = NULL;
+            return error;
+        }
     }
-    log_major = MAJOR(log_devices[INTR_LOG_MINOR].dev_num);
 
-    log_devices[WQ_N_LOG_MINOR].dev_num = MKDEV(log_major, WQ_N_LOG_MINOR);
-    log_devices[WQ_X_LOG_MINOR].dev_num = MKDEV(log_major, WQ_X_LOG_MINOR);
+    return 0;
+}
+
+/*
+ * Function name: gih_remove_instance
+ * 
+ * Function prototype:
+ *     static void gih_remove_instance(gih_dev * gih);
+ *     
+ * Description: 
+ *     Destroys and deallocates gih instance @gih, also when it was only 
+ *     partially set up by gih_setup_instance().
+ *     
+ * Arguments:
+ *     @gih: the gih instance
+ *     
+ * Side Effects:
+ *     Device nodes of @gih are removed, all its memory is freed and 
+ *     gih_module.devices[] is cleared.
+ *     
+ * Error Condition: 
+ *     Not callable if the device is still open.
+ *     
+ * Return: 
+ *     None
+ */
+static void gih_remove_instance(gih_dev * gih) {
+
+    unsigned int i;
+    int cpu;
+    log_dev * device;
 
-    /* initialize/add the cdev of gih */
-    cdev_init(&gih.log_cdev, &log_fops);
-    error = cdev_add(&gih.log_cdev, log_devices[INTR_LOG_MINOR].dev_num, 3);
-    if (error) {
-        printk(KERN_ALERT "[log] ERROR: add cdev failed\n");
-        return error;
+    /* destroy the log devices */
+    for (i = 0; i < NUM_LOG_DEV; i++) {
+        device = &gih->logs[i];
+
+        if (device->log_device)
+            device_destroy(gih_module.log_class, device->dev_num);
+
+        if (device->rings) {
+            for_each_log_ring(cpu, device)
+                vfree(per_cpu_ptr(device->rings, cpu)->data);
+            free_percpu(device->rings);
+        }
+        mutex_destroy(&device->dev_open);
     }
 
-    /* create device nodes */
-    gih.gih_class = class_create(THIS_MODULE, GIH_DEV);
-    gih.gih_device = device_create(gih.gih_class, NULL, 
-        gih.dev_num, &gih, GIH_DEV);
-
-    log_devices[INTR_LOG_MINOR].log_class = class_create(THIS_MODULE, LOG_DEV);
-    log_devices[WQ_N_LOG_MINOR].log_class = 
-    log_devices[WQ_X_LOG_MINOR].log_class =
-        log_devices[INTR_LOG_MINOR].log_class;
-
-    log_devices[INTR_LOG_MINOR].log_device = 
-        device_create(log_devices[INTR_LOG_MINOR].log_class, 
-                gih.gih_device,
-                log_devices[INTR_LOG_MINOR].dev_num, 
-                &log_devices[INTR_LOG_MINOR],
-                LOG_DEV_FMT, INTR_LOG_MINOR);
-
-    log_devices[WQ_N_LOG_MINOR].log_device = 
-        device_create(log_devices[WQ_N_LOG_MINOR].log_class, 
-                gih.gih_device,
-                log_devices[WQ_N_LOG_MINOR].dev_num, 
-                &log_devices[WQ_N_LOG_MINOR],
-                LOG_DEV_FMT, WQ_N_LOG_MINOR);
-
-     log_devices[WQ_X_LOG_MINOR].log_device = 
-        device_create(log_devices[WQ_X_LOG_MINOR].log_class, 
-                gih.gih_device,
-                log_devices[WQ_X_LOG_MINOR].dev_num, 
-                &log_devices[WQ_X_LOG_MINOR],
-                LOG_DEV_FMT, WQ_X_LOG_MINOR);
+    if (gih->gih_device)
+        device_destroy(gih_module.gih_class, gih->dev_num);
 
-    /* initialize the mutexs */
-    mutex_init(&gih.dev_open);
-    mutex_init(&gih.wrt_lock);
-    mutex_init(&log_devices[INTR_LOG_MINOR].dev_open);
-    mutex_init(&log_devices[WQ_N_LOG_MINOR].dev_open);
-    mutex_init(&log_devices[WQ_X_LOG_MINOR].dev_open);
+    vfree(gih->ring_ctrl);
+    sink_free(&gih->sink);
 
-    printk(KERN_ALERT "[gih] [log] gih module loaded.\n");
+    debugfs_remove_recursive(gih->debug_dir);
+    free_percpu(gih->hist);
+    free_percpu(gih->stats);
 
-    if (DEBUG) {
-        printk(KERN_ALERT "[gih] GIH: Major: %d, Minor: %d\n",
-                gih_major, MINOR(gih.dev_num));
-        printk(KERN_ALERT "[log] Intr log: Major: %d, Minor: %d\n", 
-                log_major, MINOR(log_devices[INTR_LOG_MINOR].dev_num));
-        printk(KERN_ALERT "[log] WQ_N log: Major: %d, Minor: %d\n", 
-                log_major, MINOR(log_devices[WQ_N_LOG_MINOR].dev_num));
-        printk(KERN_ALERT "[log] WQ_X log: Major: %d, Minor: %d\n", 
-                log_major, MINOR(log_devices[WQ_X_LOG_MINOR].dev_num));
-    }
+    if (gih->sync_wq)
+        destroy_workqueue(gih->sync_wq);
 
-    return error;
+    /* destroy the mutexs */
+    mutex_destroy(&gih->dev_open);
+    mutex_destroy(&gih->wrt_lock);
+    mutex_destroy(&gih->cfg_lock);
 
+    gih_module.devices[gih->index] = NULL;
+    kfree(gih);
 }
 
 /*
@@ -1005,7 +5155,7 @@ static int __init gih_init(void) {
  *     
  * Description: 
  *     Exit function of the gih module. Destroys and deallocates whatever 
- *     needs to be. 
+ *     needs to be, for every instance. 
  *     
  * Arguments:
  *     None
@@ -1022,31 +5172,26 @@ static int __init gih_init(void) {
  */
 static void __exit gih_exit(void) {
 
-    /* destroy the device nodes */
-    device_destroy(log_devices[INTR_LOG_MINOR].log_class,
-            log_devices[INTR_LOG_MINOR].dev_num);
-    device_destroy(log_devices[WQ_N_LOG_MINOR].log_class,
-            log_devices[WQ_N_LOG_MINOR].dev_num);
-    device_destroy(log_devices[WQ_X_LOG_MINOR].log_class,
-            log_devices[WQ_X_LOG_MINOR].dev_num);
-    class_destroy(log_devices[INTR_LOG_MINOR].log_class);
+    unsigned int i;
 
-    device_destroy(gih.gih_class, gih.dev_num);
-    class_destroy(gih.gih_class);
+    /* no more opening */
+    cdev_del(&gih_module.gih_cdev);
+    cdev_del(&gih_module.log_cdev);
 
-    /* release the registered device region */
-    unregister_chrdev_region(gih.dev_num, 1);
-    unregister_chrdev_region(log_devices[INTR_LOG_MINOR].dev_num, 3);
+    /* destroy the instances and their device nodes */
+    for (i = 0; i < gih_module.count; i++)
+        gih_remove_instance(gih_module.devices[i]);
 
-    cdev_del(&gih.gih_cdev);
-    cdev_del(&gih.log_cdev);
+    debugfs_remove_recursive(gih_module.debug_dir);
+    class_destroy(gih_module.log_class);
+    class_destroy(gih_module.gih_class);
 
-    /* destroy the mutexs */
-    mutex_destroy(&gih.dev_open);
-    mutex_destroy(&gih.wrt_lock);
-    mutex_destroy(&log_devices[INTR_LOG_MINOR].dev_open);
-    mutex_destroy(&log_devices[WQ_N_LOG_MINOR].dev_open);
-    mutex_destroy(&log_devices[WQ_X_LOG_MINOR].dev_open);
+    /* release the registered device region */
+    unregister_chrdev_region(gih_module.dev_num, gih_module.count);
+    unregister_chrdev_region(gih_module.log_dev_num, 
+        gih_module.count * NUM_LOG_DEV);
+
+    kfree(gih_module.devices);
 
     printk(KERN_ALERT "[gih] [log] gih module unloaded.\n");
 }
@@ -15,17 +15,36 @@ MODULE_LICENSE("Dual BSD/GPL");
 #define TRUE 1
 #define FALSE 0
 
-#define DEBUG 1
+/* 
+ * verbose logging, off unless turned on with the "debug" module parameter,
+ * at load or at run time (/sys/module/gih/parameters/debug). It's behind a 
+ * static key, so it costs nothing while off. For a timeline of the 
+ * interrupts and outputs, use the tracepoints (gih_trace.h) instead.
+ */
+DECLARE_STATIC_KEY_FALSE(gih_debug_key);
+#define GIH_DEBUG static_branch_unlikely(&gih_debug_key)
 
 /* device names */
 #define GIH_DEV         "gih"       /* device that accepts user input */
+#define GIH_DEV_FMT     "gih%u"     /* formatted version, by instance */
 #define LOG_DEV         "gihlog"    /* logging device for interrupt happen */
-#define LOG_DEV_FMT     "gihlog%d"  /* formatted version */
+#define LOG_DEV_FMT     "gihlog%u.%u" /* formatted version, by instance and 
+                                         log type */
+
+/* number of gih instances, each one has its own irq line, destination, data 
+   ring, output and log devices */
+#define GIH_DEF_INSTANCES 1
+#define GIH_MAX_INSTANCES 32
 
-/* minor number for all logging devices */
+/* log type of the logging devices of an instance, the minor number of a log
+   device is instance * NUM_LOG_DEV + log type */
 #define INTR_LOG_MINOR 0
 #define WQ_N_LOG_MINOR 1
 #define WQ_X_LOG_MINOR 2
+#define EVENT_LOG_MINOR 3           /* one record per interrupt output */
+#define AIO_LOG_MINOR  4            /* one record per write of the aio sink,
+                                       as it completes */
+#define NUM_LOG_DEV    5
 
 /* gih ioctl */
 #define GIH_IOC 'G'
@@ -39,65 +58,638 @@ MODULE_LICENSE("Dual BSD/GPL");
 #define GIH_IOC_CONFIG_START    _IO (GIH_IOC, 5)
 #define GIH_IOC_CONFIG_STOP     _IO (GIH_IOC, 6)
 #define GIH_IOC_CONFIG_MISS     _IOW(GIH_IOC, 7, int)
+#define GIH_IOC_CONFIG_RING_SZ  _IOW(GIH_IOC, 8, size_t)
+#define GIH_IOC_CONFIG_LOG_SZ   _IOW(GIH_IOC, 9, unsigned int)
+#define GIH_IOC_CONFIG          _IOW(GIH_IOC, 10, struct gih_config)
+#define GIH_IOC_CONFIG_LOW_WAT  _IOW(GIH_IOC, 11, unsigned int)
+#define GIH_IOC_TRIGGER         _IOW(GIH_IOC, 12, struct gih_trigger)
+
+/*
+ * ioctl operations on log devices, they apply to the opened file only.
+ */
+#define GIH_LOG_IOC_FORMAT      _IOW(GIH_IOC, 16, int)
+#define GIH_LOG_IOC_VERSION     _IO (GIH_IOC, 17)
+#define GIH_LOG_IOC_BATCH       _IOW(GIH_IOC, 18, unsigned int)
+#define GIH_LOG_IOC_DROPS       _IO (GIH_IOC, 19)
+#define GIH_LOG_IOC_TAIL        _IO (GIH_IOC, 20)
+
+/* 
+ * poll thresholds: the gih device is writable once the data ring has at least
+ * low water bytes free, a log device file readable once it has at least 
+ * batch logs to read.
+ */
+#define GIH_DEF_LOW_WAT 1
+#define LOG_DEF_BATCH   1
+
+/* log output formats */
+#define GIH_LOG_FMT_TEXT 0          /* one formatted line per log */
+#define GIH_LOG_FMT_BIN  1          /* raw struct log/event_log records */
+
+/* 
+ * individual log, contains a time and a irq identifier. 
+ * This is also the record of the binary log format, keep it packed with 
+ * fixed size fields and bump GIH_LOG_VERSION on any change, of this or of
+ * struct event_log.
+ */
+#define GIH_LOG_VERSION 3
 
-/* individual log, contains a timespec and a irq identifier */
 struct log {
-    ssize_t byte_sent;              /* number of bytes sent this time
+    __u64 stamp;                    /* time of the log, ns of the log clock */
+    __u32 irq_count;                /* irq identifier, wraps at 2^32 */
+    __s32 byte_sent;                /* number of bytes sent this time
                                        only set by wqlogx device */
-    unsigned long irq_count;        /* irq identifier */
-    struct timeval time;            /* time of the log */
+} __attribute__((packed));
+
+/* 
+ * record of the event log, the whole timeline of one interrupt written once 
+ * its output is done. Interrupts dropped on a full event queue have none, 
+ * they show as gaps in irq_count.
+ */
+struct event_log {
+    __u64 irq_stamp;                /* time of the interrupt, ns of the log 
+                                       clock */
+    __u64 start_stamp;              /* time the output started */
+    __u64 end_stamp;                /* time the output ended */
+    __u32 irq_count;                /* irq identifier, as in struct log */
+    __s32 byte_sent;                /* number of bytes sent */
+} __attribute__((packed));
+
+/* any record of a log device, all start with their time stamp */
+union log_rec {
+    __u64 stamp;
+    struct log log;
+    struct event_log event;
 };
 
-/* FIFO buffer for logging devices */
-#define LOG_FIFO_SZ 8192                        /* buffer size of FIFO */
+/* 
+ * clocks of the log stamps. Both count from boot and are not stepped by 
+ * settimeofday; the monotonic clock is still slewed by NTP, the raw clock is
+ * not and measures jitter in the rate of the hardware counter.
+ */
+#define GIH_LOG_CLOCK_MONO 0        /* ktime_get_ns() */
+#define GIH_LOG_CLOCK_RAW  1        /* ktime_get_raw_ns() */
+
+/* FIFO buffer for logging devices, sizes are in number of logs and rounded
+   up to a power of 2. The interrupt log has a ring of this size per CPU */
+#define LOG_FIFO_SZ 8192                        /* default size of FIFO */
+#define LOG_FIFO_MIN_SZ 64                      /* min size of FIFO */
+#define LOG_FIFO_MAX_SZ (1<<22)                 /* max size of FIFO */
 #define LOG_STR_BUF_SZ 256                      /* max len for log string */
-DEFINE_KFIFO(ilog_buf, struct log, LOG_FIFO_SZ);    
-DEFINE_KFIFO(wq_n_buf, struct log, LOG_FIFO_SZ);
-DEFINE_KFIFO(wq_x_buf, struct log, LOG_FIFO_SZ);
+#define LOG_MERGE_CHUNK 16                      /* logs merged per copy */
+
+/* 
+ * a log ring with a single writer. Rings are per CPU, so the writer of a 
+ * ring never shares its cache lines with the writer of another one.
+ */
+struct log_ring {
+    void * data;                    /* mask + 1 records of rec_size */
+    unsigned int mask;              /* number of records - 1, a power of 2 */
+    unsigned int in;                /* logs ever pushed, runs freely; the 
+                                       log of index i is at i & mask */
+};
 
 /* log device structure */
 typedef struct log_dev {
     unsigned long irq_count;        /* total number of irq caught; in N & X
                                        devices they represent number of 
-                                       not missed irq */
+                                       outputs done */
     dev_t dev_num;                  /* device number */
-    struct kfifo * buffer;          /* FIFO buffer */
-    struct class * log_class;       /* for sysfs, log class */
+    unsigned int rec_size;          /* size of a record, struct log or 
+                                       struct event_log */
+    bool percpu;                    /* logged on any CPU, into the ring of 
+                                       that CPU; else only the ring of CPU 0
+                                       is used, by a single writer */
+    int node;                       /* of the ring of a single writer, 
+                                       NUMA_NO_NODE for anywhere */
+    struct log_ring __percpu * rings;
+                                    /* log rings, in time order each */
     struct device * log_device;     /* for sysfs, log device */
-    struct mutex dev_open;          /* device can only open once a time*/
+    struct mutex dev_open;          /* guards readers, and the rings against
+                                       resizing */
+    struct list_head readers;       /* opened files, log_reader.node */
+    unsigned int wake_at;           /* logs pushed at which pollers are 
+                                       woken up, see log_poll() */
+    wait_queue_head_t read_wait;    /* pollers waiting for batch logs */
+    struct gih_stats __percpu * stats;
+                                    /* counters of the instance */
+    int drop_stat;                  /* counter of the logs lost to lapped 
+                                       readers, GIH_STAT_LOG_DROPS + log type */
 } log_dev;
 
-/* gih device structure */
-#define DATA_FIFO_SZ (1<<20)        /* 1MB */
-DECLARE_KFIFO(data_buf, unsigned char, DATA_FIFO_SZ);
+/* 
+ * an opened log device file. The rings are broadcast: the writer never 
+ * waits for the readers and overwrites the oldest logs, each reader follows
+ * with a cursor of its own per ring and loses what it was lapped on.
+ */
+typedef struct log_reader {
+    log_dev * device;               /* log device being read */
+    int format;                     /* GIH_LOG_FMT_* of this reader */
+    unsigned int batch;             /* readable at this many logs */
+    unsigned int * cursor;          /* next log to read of each ring, as 
+                                       log_ring.in */
+    int * merge;                    /* CPUs of the non-empty rings of the 
+                                       read */
+    unsigned int n_merge;           /* number of rings in merge */
+    u64 dropped;                    /* logs lost to being lapped */
+    struct list_head node;          /* in log_dev.readers */
+} log_reader;
+
+/* CPUs that have a log ring in @device, see log_dev.percpu */
+#define for_each_log_ring(cpu, device)                                      \
+    for ((cpu) = -1;                                                        \
+         (cpu) = (device)->percpu ?                                         \
+             cpumask_next((cpu), cpu_possible_mask) : (cpu) + 1,            \
+         (cpu) < ((device)->percpu ? nr_cpu_ids : 1);)
+
+/* data ring of the gih device, sizes are in bytes and rounded up to a 
+   power of 2 */
+#define DATA_FIFO_SZ (1<<20)        /* 1MB, default */
+#define DATA_FIFO_MIN_SZ PAGE_SIZE  /* one page */
+#define DATA_FIFO_MAX_SZ (1<<30)    /* 1GB */
+
+/* 
+ * control page of the data ring, first page of the gih mmap; the data ring 
+ * follows at data_off. Indices run freely, the data of index i is at 
+ * data_off + (i & (size - 1)), head - tail is the amount of data in the ring.
+ * The ring is single producer / single consumer without locks: head is only 
+ * written by the producer (gih_write_iter() or a mmap feeder) and tail only 
+ * by the output, both published with release and read with acquire. Each 
+ * index has a cache line pair of its own, GIH_RING_HEAD_OFF and 
+ * GIH_RING_TAIL_OFF into the page, so that publishing one doesn't take the 
+ * line of the other away from the other side (adjacent line prefetch pairs
+ * up 64 byte lines).
+ */
+#define GIH_RING_VERSION 2
+#define GIH_RING_HEAD_OFF 128
+#define GIH_RING_TAIL_OFF 256
+
+/* 
+ * data modes. In byte mode an output takes up to write_size bytes of the 
+ * data ring, wherever that ends. In frame mode the ring holds frames, a 
+ * __u32 length (native endian) followed by that many bytes: each buffer 
+ * written, each iovec of a writev(), is one frame, and a mmap feeder writes
+ * the length itself and only publishes head past whole frames. An output 
+ * then takes whole frames, lengths included, up to write_size bytes and up 
+ * to frame_limit frames, but at least one frame however large; a frame is 
+ * never split between two outputs. Changing the mode empties the ring.
+ */
+#define GIH_MODE_BYTES    0
+#define GIH_MODE_FRAMES   1
+#define GIH_FRAME_HDR_SZ  sizeof(__u32)
+
+struct gih_ring_ctrl {
+    __u32 version;                  /* layout version of this page */
+    __u32 data_off;                 /* offset of the data ring in the map */
+    __u32 size;                     /* size of the data ring, power of 2 */
+    __u8 pad_head[GIH_RING_HEAD_OFF - 3 * sizeof(__u32)];
+    __u32 head;                     /* producer index, written by feeder */
+    __u8 pad_tail[GIH_RING_TAIL_OFF - GIH_RING_HEAD_OFF - sizeof(__u32)];
+    __u32 tail;                     /* consumer index, written by gih */
+};
 
 #define IRQ_NAME "gih irq handler"
 #define IRQ_WQ_NAME "irq work queue"
 #define PATH_MAX_LEN 128            /* Just a file name... should be enough */
 
+/* 
+ * batched configuration, GIH_IOC_CONFIG. Only the fields selected in mask are
+ * applied; all of them are validated before any is committed, so either the
+ * whole configuration is taken or nothing changes. Bump GIH_CONFIG_VERSION 
+ * on any change of the layout.
+ */
+#define GIH_CONFIG_VERSION 11
+
+/* fields of struct gih_config */
+#define GIH_CFG_IRQ      (1 << 0)
+#define GIH_CFG_DELAY_T  (1 << 1)
+#define GIH_CFG_WRT_SZ   (1 << 2)
+#define GIH_CFG_PATH     (1 << 3)
+#define GIH_CFG_MISS     (1 << 4)
+#define GIH_CFG_ENGINE   (1 << 5)   /* engine, rt_prio and cpu */
+#define GIH_CFG_SYNC     (1 << 6)   /* sync and sync_arg */
+#define GIH_CFG_SINK     (1 << 7)   /* sink and sink_flags */
+#define GIH_CFG_LOG_CLOCK (1 << 8)
+#define GIH_CFG_MODE     (1 << 9)   /* mode and frame_limit */
+#define GIH_CFG_STAGE    (1 << 10)
+#define GIH_CFG_LEAD     (1 << 11)  /* lead_mode and the lead bounds */
+#define GIH_CFG_SOURCE   (1 << 12)  /* source and source_flags */
+#define GIH_CFG_NODE     (1 << 13)
+#define GIH_CFG_ALL      (GIH_CFG_IRQ | GIH_CFG_DELAY_T | GIH_CFG_WRT_SZ | \
+                          GIH_CFG_PATH | GIH_CFG_MISS | GIH_CFG_ENGINE | \
+                          GIH_CFG_SYNC | GIH_CFG_SINK | GIH_CFG_LOG_CLOCK | \
+                          GIH_CFG_MODE | GIH_CFG_STAGE | GIH_CFG_LEAD | \
+                          GIH_CFG_SOURCE | GIH_CFG_NODE)
+
+/* flags of struct gih_config */
+#define GIH_CFG_F_START  (1 << 0)   /* start the device once applied */
+#define GIH_CFG_F_ALL    (GIH_CFG_F_START)
+
+struct gih_config {
+    __u32 version;                  /* GIH_CONFIG_VERSION */
+    __u32 mask;                     /* GIH_CFG_* fields to apply */
+    __u32 flags;                    /* GIH_CFG_F_* */
+    __s32 irq;                      /* irq line */
+    __u32 delay_msec;               /* delay time in milliseconds */
+    __u32 keep_missed;              /* keep missed data or not */
+    __u64 write_size;               /* bytes to output on each interrupt */
+    __s32 engine;                   /* GIH_ENGINE_* running the output */
+    __s32 rt_prio;                  /* SCHED_FIFO priority, kthread engine */
+    __s32 cpu;                      /* CPU of the kthread engine, or 
+                                       GIH_CPU_ANY / GIH_CPU_IRQ */
+    __s32 node;                     /* GIH_NODE_* or the NUMA node of the
+                                       rings and the output */
+    __u32 sync;                     /* GIH_SYNC_* of the destination */
+    __u32 sync_arg;                 /* outputs or milliseconds, by sync */
+    __u32 sink;                     /* GIH_SINK_* of the destination */
+    __u32 sink_flags;               /* GIH_SINK_F_* */
+    __u32 log_clock;                /* GIH_LOG_CLOCK_* of the log stamps */
+    __u32 mode;                     /* GIH_MODE_* of the data ring */
+    __u32 frame_limit;              /* frames per output, 0 for no limit */
+    __u32 stage;                    /* stage the payload ahead, 0 or 1 */
+    __u32 lead_mode;                /* GIH_LEAD_* of the output timer */
+    __u32 lead_usec;                /* lead, or the first one to adapt */
+    __u32 lead_min_usec;            /* bounds of an adapting lead */
+    __u32 lead_max_usec;
+    __u32 source_flags;             /* GIH_SRC_F_* */
+    char path[PATH_MAX_LEN];        /* destination, NUL terminated, a path 
+                                       or "a.b.c.d:port", by sink */
+    char source[PATH_MAX_LEN];      /* file played back into the data ring,
+                                       NUL terminated, "" for none */
+};
+
+/* 
+ * output engines. The workqueue engine runs the output on a shared kworker; 
+ * the kthread engine runs it on a dedicated SCHED_FIFO kernel thread of the 
+ * instance, optionally pinned to one CPU, so that nothing of lower priority 
+ * can delay the output.
+ */
+#define GIH_ENGINE_WQ      0
+#define GIH_ENGINE_KTHREAD 1
+
+#define GIH_DEF_RT_PRIO   50        /* default priority of the kthread */
+#define GIH_CPU_ANY       (-1)      /* kthread not pinned */
+#define GIH_CPU_IRQ       (-2)      /* pinned to the first CPU of the irq's
+                                       affinity, when started */
+#define ENGINE_NAME_FMT   "gih%u_out"
+
+/* 
+ * NUMA placement, GIH_CFG_NODE (see place.h). On every start the node is 
+ * resolved, GIH_NODE_IRQ to the node of the irq's affinity at that point;
+ * the data ring, the rings of the output (the log rings but the interrupt 
+ * one, the output ring and the aio buffers) are then moved to it, and the
+ * output runs on its CPUs: the kthread engine is bound to them unless 
+ * pinned to a CPU, and the output work is queued on one of them when the 
+ * timer fires on another node. What a ring holds is kept across a move; a
+ * mapped data ring or a log device opened stays where it is. The interrupt
+ * log rings are on the node of their own CPU, whatever the placement.
+ */
+#define GIH_NODE_ANY      (-1)      /* no placement, as allocated */
+#define GIH_NODE_IRQ      (-2)      /* the node of the irq, when started */
+
+/* 
+ * software trigger, GIH_IOC_TRIGGER: synthetic interrupts that go through 
+ * gih_intr() like the ones of the irq line, for tests and benchmarks. With 
+ * period_ns 0, burst interrupts are fired right away by the ioctl; otherwise
+ * the trigger timer fires burst interrupts back to back every period_ns, 
+ * count times, or until replaced or stopped if count is 0. period_ns and 
+ * burst both 0 stop the trigger timer. The trigger needs a device running 
+ * without an irq line, irq GIH_IRQ_NONE, so the event queue keeps a single 
+ * producer; -1 is left to user space for "unset".
+ */
+#define GIH_IRQ_NONE        (-2)    /* no irq line, software trigger only */
+#define GIH_TRIG_MIN_PERIOD 10000   /* ns, 100kHz */
+#define GIH_TRIG_MAX_BURST  EVT_FIFO_SZ
+
+struct gih_trigger {
+    __u64 period_ns;                /* 0 to fire once, from the ioctl */
+    __u32 burst;                    /* interrupts fired each time */
+    __u32 count;                    /* periods to fire, 0 for no limit */
+};
+
+/* 
+ * durability policy of the destination file. The output never syncs the 
+ * file itself, syncs are done on the sync workqueue of the instance, so only
+ * the write is on the timed path.
+ */
+#define GIH_SYNC_NEVER    0         /* never synced by gih */
+#define GIH_SYNC_EVERY    1         /* after every sync_arg outputs */
+#define GIH_SYNC_PERIOD   2         /* every sync_arg milliseconds */
+#define GIH_SYNC_CLOSE    3         /* on stop and close only */
+
+#define GIH_DEF_SYNC      GIH_SYNC_EVERY
+#define GIH_DEF_SYNC_ARG  1
+#define SYNC_WQ_NAME_FMT  "gih%u_sync"
+
+/* 
+ * output sinks, where the output sends the data to (see sink.h). The file 
+ * sink writes to the file at path; the udp sink sends datagrams of at most 
+ * GIH_UDP_DGRAM_SZ bytes from a kernel socket connected to path, 
+ * "a.b.c.d:port"; the mmap sink copies into an output ring that a user 
+ * reader maps at offset GIH_MMAP_OUT_OFF of the gih device, with the layout 
+ * of the data ring but the roles of head and tail swapped (gih produces).
+ */
+#define GIH_SINK_FILE     0
+#define GIH_SINK_UDP      1
+#define GIH_SINK_MMAP     2
+#define GIH_SINK_AIO      3
+
+#define GIH_UDP_DGRAM_SZ  1472          /* fits an ethernet frame */
+#define GIH_MMAP_OUT_OFF  0x60000000UL  /* past the largest data ring map */
+
+/* 
+ * the aio sink writes the file at path as the file sink does, but with 
+ * asynchronous kiocbs: an output copies its payload into a free buffer of a 
+ * pool of GIH_AIO_DEPTH, allocated at start, submits it and returns; the 
+ * completions are collected on the sync workqueue into the aio log device, 
+ * issue and completion time of every write. An output finding no free 
+ * buffer sends nothing, its data is left in the data ring. A write takes at 
+ * most the write size (and the ring size), rounded up to pages. With 
+ * GIH_SINK_F_DIRECT the file is opened O_DIRECT and writes are whole 
+ * GIH_AIO_ALIGN blocks, what's left over goes with the next output and the
+ * last of it on close, without O_DIRECT; the write size needs to be at 
+ * least a block, and frame mode is not supported. Without it, most 
+ * filesystems complete the buffered write in the submission already.
+ */
+#define GIH_SINK_F_DIRECT (1 << 0)
+#define GIH_SINK_F_ALL    (GIH_SINK_F_DIRECT)
+
+#define GIH_AIO_DEPTH     16            /* writes in flight, at most */
+#define GIH_AIO_ALIGN     4096          /* block of a direct write */
+
+/* a write of the aio sink, one buffer of the pool */
+struct gih_aio {
+    struct kiocb iocb;              /* the write, ki_pos is its offset */
+    struct gih_sink * sink;         /* sink of the write */
+    void * buf;                     /* the payload, page aligned */
+    struct bio_vec * bvec;          /* pages of buf */
+    size_t len;                     /* bytes to write */
+    long res;                       /* bytes written or -ERRORCODE */
+    unsigned long seq;              /* interrupt of the output */
+    u64 irq_stamp;                  /* its time, ns of the log clock */
+    u64 issued;                     /* submission */
+    u64 completed;                  /* completion */
+    bool done;                      /* completed, set with release */
+};
+
+/* sink of the output, owned by the output while the device is running */
+typedef struct gih_sink {
+    int type;                       /* GIH_SINK_* */
+    struct file * filp;             /* file sink */
+    struct socket * sock;           /* udp sink, connected */
+    struct gih_ring_ctrl * ring;    /* mmap sink, control page + ring, kept 
+                                       while mapped */
+    unsigned int ring_size;         /* size of the output ring */
+    int ring_node;                  /* node of the output ring */
+    unsigned int head;              /* producer index of the output ring */
+    struct mutex ring_lock;         /* allocation against mapping of ring */
+    atomic_t mapped;                /* number of mappings of the ring */
+    wait_queue_head_t read_wait;    /* pollers waiting for output data */
+    unsigned int flags;             /* GIH_SINK_F_* */
+    struct gih_aio * aio;           /* aio sink, the pool of writes */
+    size_t aio_size;                /* size of a buffer of the pool */
+    unsigned int aio_head;          /* writes submitted, by the output */
+    unsigned int aio_tail;          /* writes reaped */
+    loff_t aio_pos;                 /* file offset of the next write */
+    atomic_t aio_busy;              /* writes not completed */
+    wait_queue_head_t aio_wait;     /* waiting for aio_busy to drop to 0 */
+    bool aio_raw;                   /* stamps of the raw clock */
+    int node;                       /* of the output ring and the aio 
+                                       buffers, NUMA_NO_NODE for anywhere */
+    struct workqueue_struct * aio_wq;
+    struct work_struct * aio_work;  /* reaps completions, queued on aio_wq
+                                       by each of them */
+} gih_sink;
+
 #define TIME_DELTA 200               /* time correction value, wait time will
                                        be reduced by this TIME_DELTA microsec
                                        to account for internal delays */ 
 
+/* 
+ * lead of the output timer, GIH_CFG_LEAD: the timer fires this long before 
+ * interrupt time + delay, for the time from the timer to the output start. 
+ * GIH_LEAD_FIXED keeps it at lead_usec, TIME_DELTA unless configured. 
+ * GIH_LEAD_ADAPT starts from lead_usec and then follows the overhead 
+ * measured on every output, timer deadline to output start, as an EWMA of 
+ * weight 1/2^GIH_LEAD_SHIFT within [lead_min_usec, lead_max_usec]. The lead 
+ * in use is read only in sysfs, /sys/class/gih/gihN/lead_ns.
+ */
+#define GIH_LEAD_FIXED    0
+#define GIH_LEAD_ADAPT    1
+#define GIH_LEAD_SHIFT    3
+#define GIH_DEF_LEAD_MAX  (10 * TIME_DELTA)
+#define GIH_LEAD_MAX_USEC USEC_PER_SEC /* cap of any lead */
+
+/* 
+ * latency histograms of the output, per instance and per CPU (see hist.h),
+ * in debugfs as gih/gihN/<stage>; reading gives the summary and the 
+ * buckets, writing anything resets. Buckets are log-linear, HIST_SUB linear 
+ * buckets per power of 2 nanoseconds, so any value is known within 1/16; 
+ * magnitudes are capped at 2^HIST_MAX_BITS ns (~68 s). Histograms are 
+ * signed, negative values fill the lower half of the buckets.
+ */
+#define HIST_IRQ_START   0          /* interrupt to output start */
+#define HIST_START_END   1          /* output start to output end */
+#define HIST_DEADLINE    2          /* output start minus interrupt + delay */
+#define NUM_HIST         3
+
+#define HIST_SUB_BITS    4
+#define HIST_SUB         (1 << HIST_SUB_BITS)
+#define HIST_MAX_BITS    36
+#define HIST_MAG         ((HIST_MAX_BITS - HIST_SUB_BITS + 1) * HIST_SUB)
+#define HIST_BUCKETS     (2 * HIST_MAG)
+
+#define DEBUG_DIR        "gih"      /* debugfs directory of the module */
+
+struct gih_hist {
+    u64 count;                      /* number of values */
+    s64 min;                        /* smallest value, if count */
+    s64 max;                        /* largest value, if count */
+    s64 sum;                        /* sum of the values, for the mean */
+    u32 bucket[HIST_BUCKETS];       /* counts, by hist_index() */
+};
+
+/* histograms of one CPU */
+struct gih_hists {
+    struct gih_hist stage[NUM_HIST];
+};
+
+/* a histogram file in debugfs */
+struct gih_hist_file {
+    struct gih_dev * gih;           /* instance of the histogram */
+    int stage;                      /* HIST_* */
+};
+
+/*
+ * drop accounting, per instance and per CPU (see stats.h), read only in 
+ * sysfs as /sys/class/gih/gihN/stats/<counter>, the sum over the CPUs. The
+ * counters only grow, from the load of the module on. Bytes put into the 
+ * ring by a mmap feeder are not seen by write() and not in bytes_in.
+ */
+#define GIH_STAT_IRQS        0      /* interrupts caught */
+#define GIH_STAT_IRQS_MISSED 1      /* interrupts dropped, full event queue */
+#define GIH_STAT_EMITS       2      /* outputs done */
+#define GIH_STAT_SHORT       3      /* outputs the sink took only part of, 
+                                       or failed */
+#define GIH_STAT_BYTES_IN    4      /* bytes taken by write(), with the 
+                                       frame headers */
+#define GIH_STAT_BYTES_OUT   5      /* bytes taken by the sink */
+#define GIH_STAT_BYTES_FULL  6      /* bytes refused by write(), full ring */
+#define GIH_STAT_BYTES_DISC  7      /* bytes dropped unsent, keep_missed 0 */
+#define GIH_STAT_BYTES_LOST  8      /* bytes dropped by the output: bad 
+                                       frames, the rest of a frame cut short,
+                                       unsent on close */
+#define GIH_STAT_LOG_DROPS   9      /* logs lapped readers lost, one counter
+                                       per log device from here on */
+#define NUM_GIH_STAT         (GIH_STAT_LOG_DROPS + NUM_LOG_DEV)
+
+/* counters of one CPU */
+struct gih_stats {
+    u64 count[NUM_GIH_STAT];
+};
+
+/* 
+ * playback source, GIH_CFG_SOURCE: the data ring is filled from a file by 
+ * the module instead of by a feeder. The ring is filled from the start of 
+ * the file when the device starts, and refilled on the sync workqueue as 
+ * the outputs free space, GIH_SRC_CHUNK bytes per read, so that the reads 
+ * stay sequential and the page cache reads ahead of them; the file is read 
+ * ahead twice as far as by default. With GIH_SRC_F_LOOP the file starts over
+ * at its end, otherwise the outputs come short once it's all sent. Writing 
+ * to the device and mapping the data ring are refused while playing back, 
+ * keep_missed doesn't apply.
+ */
+#define GIH_SRC_F_LOOP    (1 << 0)
+#define GIH_SRC_F_ALL     (GIH_SRC_F_LOOP)
+
+#define GIH_SRC_CHUNK     (1 << 18)     /* bytes read at most at once */
+
+/* pending output event, one per interrupt caught */
+#define EVT_FIFO_SZ 1024            /* max number of pending events */
+
+/* 
+ * staged payload, GIH_CFG_STAGE. The output settles the payload of the 
+ * oldest pending event as soon as the event is queued, during its delay 
+ * rather than after: the bytes (or frames) it takes from the data ring, and
+ * for the mmap sink the copy into the output ring, past the published head.
+ * At the deadline only the sink call is left, for the mmap sink just the 
+ * publish of head. The payload is what the data ring held when staged.
+ */
+struct gih_stage {
+    bool ready;                     /* staged, for event seq */
+    bool copied;                    /* already in the sink, to commit */
+    unsigned long seq;              /* sequence number of the event */
+    size_t len;                     /* bytes of the output */
+};
+
+struct gih_event {
+    ktime_t stamp;                  /* time of the interrupt */
+    unsigned long seq;              /* sequence number of the interrupt */
+    u64 log_stamp;                  /* time of the interrupt, log clock */
+    size_t budget;                  /* max number of bytes to output */
+};
+
 typedef struct gih_dev {
     bool setup;                        /* if the device has been setup */
     bool keep_missed;                  /* keep the missing data on write? */
     int irq;                           /* irq line to be registered */
     unsigned int sleep_msec;           /* time to sleep */
     size_t write_size;                 /* how much to write each time */
+    unsigned int index;                /* instance number, minor number */
     dev_t dev_num;                     /* device number */
+    ktime_t delay;                     /* deadline offset from interrupt */
+    struct hrtimer timer;              /* output timer, armed on interrupt */
+    spinlock_t timer_lock;             /* serializes arming of the timer */
+    bool timer_on;                     /* timer may be armed, under 
+                                          timer_lock */
+    struct hrtimer trig_timer;         /* software trigger, periodic */
+    spinlock_t trig_lock;              /* serializes software interrupts */
+    ktime_t trig_period;               /* period of the trigger timer */
+    unsigned int trig_burst;           /* interrupts fired each period */
+    unsigned int trig_left;            /* periods left, 0 for no limit */
     struct workqueue_struct * irq_wq;  /* work queue */
-    struct file * dest_filp;           /* destination file pointer */
-    struct class * gih_class;          /* for sysfs, class */
+    gih_sink sink;                     /* output destination */
     struct device * gih_device;        /* for sysfs, device */
-    atomic_t data_wait;                /* number of data on wait */
+    atomic_t mapped;                   /* number of mappings of data ring */
     struct work_struct work;           /* work to be put in the queue */
+    int engine;                        /* GIH_ENGINE_* */
+    int rt_prio;                       /* priority of the kthread engine */
+    int cpu;                           /* CPU of the kthread engine */
+    int node;                          /* GIH_NODE_* or the node to place 
+                                          on, as configured */
+    int ring_node;                     /* node the data ring is on, 
+                                          NUMA_NO_NODE for anywhere */
+    int out_node;                      /* node the output runs on since the
+                                          start, NUMA_NO_NODE for any */
+    int out_cpu;                       /* CPU of out_node the output work 
+                                          is queued on off the node */
+    struct task_struct * engine_task;  /* kthread engine, while running */
+    atomic_t engine_kick;              /* output due, set by the timer */
+    int sync;                          /* GIH_SYNC_* */
+    unsigned int sync_arg;             /* outputs or msec between syncs */
+    unsigned int sync_count;           /* outputs since last sync, owned by
+                                          the output */
+    struct workqueue_struct * sync_wq; /* syncs of the destination file */
+    struct delayed_work sync_work;     /* sync, queued by output or itself */
+    struct work_struct aio_work;       /* completions of the aio sink, on 
+                                          the sync workqueue */
     struct mutex dev_open;             /* dev can only be opening once */
-    struct mutex wrt_lock;             /* mutex to protect write to file */
-    struct cdev gih_cdev;              /* gih char device */
-    struct cdev log_cdev;              /* log char device */
-    struct kfifo data_buf;             /* buffer of data */
+    struct mutex wrt_lock;             /* serializes the producers, never 
+                                          taken by the output */
+    struct mutex cfg_lock;             /* serializes the configuration */
+    unsigned int low_wat;              /* writable at this much free space */
+    wait_queue_head_t wrt_wait;        /* pollers waiting for free space */
+    struct kfifo data_buf ____cacheline_aligned_in_smp;
+                                       /* buffer of data, in is owned by
+                                          the producer, out by the output */
+    unsigned int discard_to;           /* drop data before this index */
+    unsigned int discard_seq;          /* bumped by producer on discard */
+    unsigned int discard_seen;         /* last discard_seq the output took */
+    struct gih_ring_ctrl * ring_ctrl;  /* control page + data ring memory */
+    int log_clock;                     /* GIH_LOG_CLOCK_* */
+    int mode;                          /* GIH_MODE_*, changed with wrt_lock
+                                          held and the ring emptied */
+    unsigned int frame_limit;          /* frames per output, 0 no limit */
+    bool stage;                        /* stage the payload ahead */
+    int lead_mode;                     /* GIH_LEAD_* */
+    unsigned int lead_usec;            /* lead, or the first to adapt */
+    unsigned int lead_min_usec;        /* bounds of an adapting lead */
+    unsigned int lead_max_usec;
+    s64 lead_ns;                       /* lead in use, delay is set by it */
+    s64 lead_avg;                      /* EWMA of the overhead in ns, scaled
+                                          by 2^GIH_LEAD_SHIFT, output only */
+    struct gih_stage staged;           /* the next payload, owned by the 
+                                          output */
+    DECLARE_KFIFO(events, struct gih_event, EVT_FIFO_SZ)
+        ____cacheline_aligned_in_smp;
+                                       /* pending events, filled by the irq
+                                          handler, drained by the output */
     char path[PATH_MAX_LEN];           /* destination file path */
+    char source[PATH_MAX_LEN];         /* playback source, "" for none */
+    unsigned int source_flags;         /* GIH_SRC_F_* */
+    struct file * src_filp;            /* playback source, while running */
+    loff_t src_pos;                    /* offset of the next read */
+    bool src_eof;                      /* all of the source read */
+    struct work_struct src_work;       /* refill of the data ring, on the 
+                                          sync workqueue */
+    log_dev logs[NUM_LOG_DEV];         /* logging devices, by log type */
+    struct gih_hists __percpu * hist;  /* latency histograms, per CPU */
+    struct gih_hist_file hist_files[NUM_HIST];
+                                       /* debugfs files of the histograms */
+    struct gih_stats __percpu * stats; /* drop accounting, per CPU */
+    struct dentry * debug_dir;         /* debugfs directory, gihN */
 } gih_dev;
 
+/* module wide structure, shared by all the instances */
+typedef struct gih_mod {
+    unsigned int count;                /* number of instances */
+    dev_t dev_num;                     /* first gih device number */
+    dev_t log_dev_num;                 /* first log device number */
+    struct class * gih_class;          /* for sysfs, gih class */
+    struct class * log_class;          /* for sysfs, log class */
+    struct cdev gih_cdev;              /* gih char device, all instances */
+    struct cdev log_cdev;              /* log char device, all instances */
+    gih_dev ** devices;                /* instances, by minor number */
+    struct dentry * debug_dir;         /* debugfs directory, NULL if none */
+} gih_mod;
+
 #endif
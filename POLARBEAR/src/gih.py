@@ -13,47 +13,185 @@ import sys
 from sys import stderr
 from sys import stdout
 import os
+import mmap
+import select
+import stat
+import struct
 import subprocess
 import gih_config
 
+# numpy is only needed for iterLogArrays()
+try:
+    import numpy
+except ImportError:
+    numpy = None
+
 class Gih(object):
     """User land gih device control interface.
 
+    Each object controls one gih instance, /dev/gih<instance>, and its log
+    devices /dev/gihlog<instance>.<log>. The module is loaded once for all
+    instances.
+
     Attributes:
-        irq {number} -- irq number that the gih device is capturing.
+        instance {number} -- which gih instance this object controls
+        engine {number} -- output engine, ENGINE_WQ or ENGINE_KTHREAD
+        rtPrio {number} -- SCHED_FIFO priority of the kthread engine
+        cpu {number} -- CPU the kthread engine is pinned to, or CPU_ANY /
+                        CPU_IRQ (the CPU the irq is steered to)
+        node {number} -- NUMA node of the rings and the output, NODE_ANY or
+                         NODE_IRQ (the node the irq is steered to)
+        sync {number} -- durability of the output file, one of SYNC_*
+        syncArg {number} -- outputs (SYNC_EVERY) or milliseconds 
+                            (SYNC_PERIOD) between syncs
+        sink {number} -- where the output goes, SINK_FILE (path), SINK_UDP 
+                         (datagrams to path, 'a.b.c.d:port') or SINK_MMAP
+                         (an output ring read with readOutput()) or 
+                         SINK_AIO (path, written asynchronously)
+        direct {bool} -- if SINK_AIO writes with O_DIRECT
+        logClock {number} -- clock of the log timestamps, LOG_CLOCK_MONO or
+                             LOG_CLOCK_RAW
+        mode {number} -- data mode, MODE_BYTES (an output takes up to
+                         wrtSize bytes) or MODE_FRAMES (each buffer written
+                         is a frame, outputs take whole frames only)
+        frameLimit {number} -- frames per output in MODE_FRAMES, 0 for no
+                               limit
+        stage {bool} -- if the payload of an output is staged during its
+                        delay, leaving only the sink call to the deadline
+        leadMode {number} -- lead of the output timer, LEAD_FIXED (lead) or
+                             LEAD_ADAPT (follows the measured overhead)
+        lead {number} -- lead in us, or the first one to adapt
+        leadMin {number} -- lower bound of an adapting lead, in us
+        leadMax {number} -- upper bound of an adapting lead, in us
+        irq {number} -- irq number that the gih device is capturing, or
+                        IRQ_NONE for interrupts of trigger() only
         delayTime {number} -- delay time before send data upon receive interrupt
         wrtSize {number} -- size of data to send out on each interrupt
         outputPath {number} -- path of the output file
         configured {boolean} -- if the device is configured
 
     Variables:
-        __isLoaded {boolean} -- if the module was loaded.
+        __isLoaded {boolean} -- if the module was loaded (shared)
+        __modPath {str} -- gih module path (shared)
+        __instances {number} -- number of instances the module was loaded with
         __isOpened {boolean} -- if the gih device file is opened
         __setup {boolean} -- if the device has been setup (is running)
         __gihFile {file} -- gih device file
-        __modPath {str} -- gih module path
+        __gihDevice {str} -- device node of this gih instance
+        __intrLog {str} -- device node of "interrupt happened" log
+        __wqNLog {str} -- device node of "entering workqueue" log
+        __wqXLog {str} -- device node of "exiting workqueue" log
+        __eventLog {str} -- device node of the event log, one record of the
+                            whole timeline per interrupt
+        __aioLog {str} -- device node of the aio log, one record per write
+                          of SINK_AIO as it completes
         __fd {number} -- file descriptor of the gih device
+        __ring {mmap} -- mapping of the data ring, None if not mapped
+        __ringOff {number} -- offset of the data ring in the mapping
+        __ringSize {number} -- size of the data ring in byte
+        __out {mmap} -- mapping of the output ring, None if not mapped
+        __logSize {number} -- size of each log ring in number of logs
 
     Constants:
-        __GIH_DEVICE {str} -- device node of gih device
-        __INTR_LOG {str} -- device node of "interrupt happened" log
-        __WQ_N_LOG {str} -- device node of "entering workqueue" log
-        __WQ_X_LOG {str} -- device node of "exiting workqueue" log
-        __MAX_ALL_LOG_SIZE {number} -- max read size of all logs
+        __GIH_DEVICE {str} -- device node of gih device, by instance
+        __LOG_DEVICE {str} -- device node of log device, by instance and log
+                              (0 interrupt, 1 entering wq, 2 exiting wq,
+                              3 events)
+        __LOG_STR_SIZE {number} -- max size of a text log line
+        __NCPU {number} -- number of CPUs, the interrupt log has a ring each
+        __CFG_FIELDS {dict} -- configure() keywords, to their config mask bit
+        __CFG_REQUIRED {tuple} -- configure() keywords needed to start
+        __CFG_F_START {number} -- configure() flag to start the device
+        __RING_CTRL {str} -- struct format of the head of the data ring
+                             control page (version, data offset, size)
+        __RING_HEAD {number} -- offset of the producer index in control page
+        __RING_TAIL {number} -- offset of the consumer index in control page
+        __OUT_OFF {number} -- mmap offset of the output ring of SINK_MMAP
+        __HIST_FILE {str} -- debugfs file of a histogram, by instance and
+                             stage
+        __STATS_DIR {str} -- sysfs directory of the counters, by instance
+        __LEAD_FILE {str} -- sysfs file of the lead in use, by instance
+        __LOG_FMT_BIN {number} -- binary output format of the log devices
+        __LOG_VERSION {number} -- version of the binary log record
+        __LOG_RECORD {Struct} -- binary log record, fields are
+                                 (stampNs, irqCount, byteSent)
+        __EVENT_RECORD {Struct} -- binary event log record, fields are
+                                   (irqNs, startNs, endNs, irqCount,
+                                   byteSent)
+        __LOG_READ_SIZE {number} -- read size for binary logs
     """
 
+    IRQ_NONE       = -2
+    ENGINE_WQ      = 0
+    ENGINE_KTHREAD = 1
+    CPU_ANY        = -1
+    CPU_IRQ        = -2
+    NODE_ANY       = -1
+    NODE_IRQ       = -2
+
+    SYNC_NEVER     = 0
+    SYNC_EVERY     = 1
+    SYNC_PERIOD    = 2
+    SYNC_CLOSE     = 3
+
+    SINK_FILE      = 0
+    SINK_UDP       = 1
+    SINK_MMAP      = 2
+    SINK_AIO       = 3
+
+    LOG_CLOCK_MONO = 0
+    LOG_CLOCK_RAW  = 1
+
+    MODE_BYTES     = 0
+    MODE_FRAMES    = 1
+
+    LEAD_FIXED     = 0
+    LEAD_ADAPT     = 1
+
+    HIST_IRQ_START = 'irq_to_start'
+    HIST_START_END = 'start_to_end'
+    HIST_DEADLINE  = 'deadline_error'
+
     __isLoaded = False
+    __modPath  = ''
+    __instances = 0
     __isOpened = False
     __setup    = False
     __gihFile  = None
-    __modPath  = ''
     __fd       = -1
-
-    __GIH_DEVICE = '/dev/gih'
-    __INTR_LOG   = '/dev/gihlog0'
-    __WQ_N_LOG   = '/dev/gihlog1'
-    __WQ_X_LOG   = '/dev/gihlog2'
-    __MAX_ALL_LOG_SIZE = 256 * 8192
+    __ring     = None
+    __ringOff  = 0
+    __ringSize = 0
+    __logSize  = 8192
+
+    __GIH_DEVICE = '/dev/gih{:d}'
+    __LOG_DEVICE = '/dev/gihlog{:d}.{:d}'
+    __LOG_STR_SIZE = 256
+    __NCPU         = os.sysconf('SC_NPROCESSORS_CONF')
+    __CFG_FIELDS   = {'irq': 1 << 0, 'delayTime': 1 << 1, 'wrtSize': 1 << 2,
+                      'path': 1 << 3, 'keepMissed': 1 << 4,
+                      'engine': 1 << 5, 'rtPrio': 1 << 5, 'cpu': 1 << 5,
+                      'sync': 1 << 6, 'syncArg': 1 << 6, 'sink': 1 << 7,
+                      'direct': 1 << 7,
+                      'logClock': 1 << 8, 'mode': 1 << 9,
+                      'frameLimit': 1 << 9, 'stage': 1 << 10,
+                      'leadMode': 1 << 11, 'lead': 1 << 11,
+                      'leadMin': 1 << 11, 'leadMax': 1 << 11,
+                      'source': 1 << 12, 'loop': 1 << 12, 'node': 1 << 13}
+    __CFG_REQUIRED = ('irq', 'delayTime', 'wrtSize', 'path', 'keepMissed')
+    __CFG_F_START  = 1 << 0
+    __RING_CTRL  = '=III'
+    __RING_HEAD  = 128
+    __RING_TAIL  = 256
+    __OUT_OFF    = 0x60000000
+    __HIST_FILE  = '/sys/kernel/debug/gih/gih{:d}/{:s}'
+    __STATS_DIR  = '/sys/class/gih/gih{:d}/stats'
+    __LEAD_FILE  = '/sys/class/gih/gih{:d}/lead_ns'
+    __LOG_FMT_BIN   = 1
+    __LOG_VERSION   = 3
+    __LOG_RECORD    = struct.Struct('=QIi')
+    __EVENT_RECORD  = struct.Struct('=QQQIi')
+    __LOG_READ_SIZE = 16 * 8192
 
 
 
@@ -63,11 +201,14 @@ class Gih(object):
                  wrtSize = -1,
                  keepMissed = -1,
                  path = '',
-                 gihPath = 'gih.ko'):
+                 gihPath = 'gih.ko',
+                 instance = 0,
+                 instances = 1):
         """Create a new gih object
 
         Creates a new gih object with specified parameters. If the gih module
-        is not loaded, will load the module.
+        is not loaded, will load the module with @instances instances, each
+        object then opens its own @instance.
         Attributes are set to -1 or empty to denote "unset", if not specified.
         This function will not finish configuration regardless of
         if all parameters are set.
@@ -80,36 +221,74 @@ class Gih(object):
             keepMissed {number} -- behavior on missed data, -1 for not set
                                     (default: {-1})
             gihPath {str} -- path of the kernel module
+            instance {number} -- gih instance to control (default: {0})
+            instances {number} -- number of instances to load the module with,
+                                  if it's not loaded (default: {1})
         """
+        self.instance = instance
+        self.__gihDevice = Gih.__GIH_DEVICE.format(instance)
+        self.__intrLog   = Gih.__LOG_DEVICE.format(instance, 0)
+        self.__wqNLog    = Gih.__LOG_DEVICE.format(instance, 1)
+        self.__wqXLog    = Gih.__LOG_DEVICE.format(instance, 2)
+        self.__eventLog  = Gih.__LOG_DEVICE.format(instance, 3)
+        self.__aioLog    = Gih.__LOG_DEVICE.format(instance, 4)
+
+        self.irq        = irq
+        self.delayTime  = delayTime
+        self.wrtSize    = wrtSize
+        self.keepMissed = keepMissed
+        self.path       = path
+        self.engine     = Gih.ENGINE_WQ
+        self.rtPrio     = 50
+        self.cpu        = Gih.CPU_ANY
+        self.sync       = Gih.SYNC_EVERY
+        self.syncArg    = 1
+        self.sink       = Gih.SINK_FILE
+        self.direct     = False
+        self.logClock   = Gih.LOG_CLOCK_MONO
+        self.mode       = Gih.MODE_BYTES
+        self.frameLimit = 0
+        self.stage      = False
+        self.leadMode   = Gih.LEAD_FIXED
+        self.lead       = 200
+        self.leadMin    = 0
+        self.leadMax    = 2000
+        self.source     = ''
+        self.loop       = False
+        self.node       = Gih.NODE_ANY
+        self.__out      = None
+
         if not Gih.__isLoaded:
-            if not Gih.load(gihPath):
+            if not Gih.load(gihPath, max(instances, instance + 1)):
                 return
 
-        if not Gih.__isOpened:
-            if not Gih.open():
+        if not self.__isOpened:
+            if not self.open():
                 return
 
-        Gih.__setup = False
+        self.__setup = False
 
-        self.irq = irq
+        # everything that's set goes in one configuration call
+        fields = {}
         if irq != -1:
-            self.configureIRQ(irq)
-
-        self.delayTime = delayTime
+            fields['irq'] = irq
         if delayTime != -1:
-            self.configureDelayTime(delayTime)
-
-        self.wrtSize = wrtSize
+            fields['delayTime'] = delayTime
         if wrtSize != -1:
-            self.configureWrtSize(wrtSize)
-
-        self.keepMissed = keepMissed
+            fields['wrtSize'] = wrtSize
         if keepMissed != -1:
-            self.configureMissed(keepMissed)
-
-        self.path = path
+            fields['keepMissed'] = keepMissed
         if path != '':
-            self.configurePath(path)
+            fields['path'] = path
+
+        self.irq        = -1
+        self.delayTime  = -1
+        self.wrtSize    = -1
+        self.keepMissed = -1
+        self.path       = ''
+
+        if fields:
+            self.configure(**fields)
 
 
 
@@ -117,7 +296,8 @@ class Gih(object):
         """Set the irq number for gih to capture.
 
         Arguments:
-            irq {number} -- irq number for gih to capture
+            irq {number} -- irq number for gih to capture, or IRQ_NONE for
+                            interrupts of trigger() only
 
         Returns:
             number -- on success, return the set irq number; otherwise -1
@@ -126,20 +306,21 @@ class Gih(object):
             print('Error: module is not loaded.', file = stderr)
             return -1
 
-        if not Gih.__isOpened:
+        if not self.__isOpened:
             print('Error: device needs to be opened prior to configuration.',\
                 file = stderr)
             return -1
 
-        if Gih.__setup:
+        if self.__setup:
             print('Error: device is running.', file = stderr)
             return -1
 
-        if type(irq) != int or irq <= 0:
-            print('Error: irq needs to be a positive integer.', file = stderr)
+        if type(irq) != int or (irq <= 0 and irq != Gih.IRQ_NONE):
+            print('Error: irq needs to be a positive integer or IRQ_NONE.',
+                    file = stderr)
             return -1
 
-        if gih_config.configure_irq(Gih.__fd, irq) == irq:
+        if gih_config.configure_irq(self.__fd, irq) == irq:
             self.irq = irq
         else:
             self.irq = -1
@@ -161,12 +342,12 @@ class Gih(object):
             print('Error: module is not loaded', file = stderr)
             return -1
 
-        if not Gih.__isOpened:
+        if not self.__isOpened:
             print('Error: device needs to be opened prior to configuration.',\
                 file = stderr)
             return -1
 
-        if Gih.__setup:
+        if self.__setup:
             print('Error: device is running.', file = stderr)
             return -1
 
@@ -175,7 +356,7 @@ class Gih(object):
                 'in milliseconds.', file = stderr)
             return -1
 
-        if gih_config.configure_delay_t(Gih.__fd, delayTime) == delayTime:
+        if gih_config.configure_delay_t(self.__fd, delayTime) == delayTime:
             self.delayTime = delayTime
         else:
             self.delayTime = -1
@@ -197,12 +378,12 @@ class Gih(object):
             print('Error: module is not loaded', file = stderr)
             return -1
 
-        if not Gih.__isOpened:
+        if not self.__isOpened:
             print('Error: device needs to be opened prior to configuration.',\
                 file = stderr)
             return -1
 
-        if Gih.__setup:
+        if self.__setup:
             print('Error: device is running.', file = stderr)
             return -1
 
@@ -211,7 +392,7 @@ class Gih(object):
                     file = stderr)
             return -1
 
-        if gih_config.configure_wrt_sz(Gih.__fd, wrtSize) == wrtSize:
+        if gih_config.configure_wrt_sz(self.__fd, wrtSize) == wrtSize:
             self.wrtSize = wrtSize
         else:
             self.wrtSize = -1
@@ -225,7 +406,8 @@ class Gih(object):
         """Set the path of gih output on each interrupt
 
         Arguments:
-            path {str} -- path of the output file
+            path {str} -- path of the output file, or 'a.b.c.d:port' for
+                          SINK_UDP
 
         Returns:
             bool -- True on success, False otherwise
@@ -234,21 +416,22 @@ class Gih(object):
             print('Error: module is not loaded', file = stderr)
             return -1
 
-        if not Gih.__isOpened:
+        if not self.__isOpened:
             print('Error: device needs to be opened prior to configuration.',\
                 file = stderr)
             return -1
 
-        if Gih.__setup:
+        if self.__setup:
             print('Error: device is running.', file = stderr)
             return -1
 
-        if not os.path.exists(path) or os.path.isdir(path):
+        if self.sink in (Gih.SINK_FILE, Gih.SINK_AIO) and \
+                (not os.path.exists(path) or os.path.isdir(path)):
             print('Error: {:s} does not exist or is a directory.'.format(path),
                     file = stderr)
             return -1
 
-        if gih_config.configure_path(Gih.__fd, path) == len(path):
+        if gih_config.configure_path(self.__fd, path) == len(path):
             self.path = path
             return True
         else:
@@ -277,16 +460,16 @@ class Gih(object):
             print('Error: module is not loaded', file = stderr)
             return -1
 
-        if not Gih.__isOpened:
+        if not self.__isOpened:
             print('Error: device needs to be opened prior to configuration.',\
                 file = stderr)
             return -1
 
-        if Gih.__setup:
+        if self.__setup:
             print('Error: device is running.', file = stderr)
             return -1
 
-        res = gih_config.configure_missed(Gih.__fd, keepMissed)
+        res = gih_config.configure_missed(self.__fd, keepMissed)
 
         if res == 0 or res == 1:
             self.keepMissed = res
@@ -296,6 +479,345 @@ class Gih(object):
         return self.keepMissed
 
 
+    def configure(self, start = False, **fields):
+        """Configure any of irq, delayTime, wrtSize, keepMissed and path in a
+        single call to the device, optionally starting it right after.
+
+        The device validates all given fields before taking any of them, so
+        either all of them are configured or none is.
+
+        Keyword Arguments:
+            start {bool} -- start the device once configured (default: False)
+            irq {number} -- irq number to catch, IRQ_NONE for no irq line
+                            (interrupts come from trigger() only)
+            delayTime {number} -- sleep time before send data in millisecond
+            wrtSize {number} -- size of data to send in byte
+            keepMissed {number} -- keep missed data or not
+            path {str} -- path of output file
+            engine {number} -- output engine, ENGINE_WQ (a shared kworker)
+                               or ENGINE_KTHREAD (a SCHED_FIFO kthread)
+            rtPrio {number} -- priority of the kthread engine, 1 to 99
+            cpu {number} -- CPU of the kthread engine, CPU_ANY or CPU_IRQ
+            node {number} -- NUMA node the device is placed on at every
+                             start: the data ring (unless mapped), the log
+                             rings of the output (unless opened), the
+                             output ring and buffers of the sink, and the
+                             CPUs of the output; NODE_IRQ for the node of
+                             the irq's affinity at start, NODE_ANY (default)
+                             for no placement
+            sync {number} -- when the output file is synced, SYNC_NEVER,
+                             SYNC_EVERY (syncArg outputs), SYNC_PERIOD 
+                             (every syncArg ms) or SYNC_CLOSE (on stop/close)
+            syncArg {number} -- outputs or milliseconds between syncs
+            sink {number} -- destination type, SINK_FILE, SINK_UDP (path
+                             is 'a.b.c.d:port'), SINK_MMAP (no path) or
+                             SINK_AIO: the file at path, written by
+                             asynchronous kiocbs off a pool of buffers, the
+                             completions in log device 4
+            direct {bool} -- SINK_AIO writes with O_DIRECT, whole 4096 byte
+                             blocks (wrtSize at least one block, no
+                             MODE_FRAMES); the tail is written on close
+            logClock {number} -- clock of the log timestamps, LOG_CLOCK_MONO
+                                 or LOG_CLOCK_RAW (not slewed by NTP)
+            mode {number} -- MODE_BYTES, or MODE_FRAMES: every buffer
+                             written is a frame (a native u32 length, then
+                             the bytes) and an output takes whole frames,
+                             up to wrtSize bytes and frameLimit frames but
+                             at least one. A new mode empties the data ring
+            frameLimit {number} -- frames per output, 0 for no limit
+            stage {bool} -- settle the payload of an output during its delay
+                            (and copy it ahead for SINK_MMAP), so only the
+                            sink call is left at the deadline; the payload
+                            is what the data ring holds at the interrupt
+            leadMode {number} -- LEAD_FIXED: the output timer fires lead us
+                                 ahead of interrupt + delay, for the time
+                                 it takes to start the output; LEAD_ADAPT:
+                                 the lead starts at lead and follows the
+                                 overhead measured on every output, within
+                                 [leadMin, leadMax] us (see readLead())
+            lead {number} -- lead in us (default 200)
+            leadMin {number} -- lower bound of an adapting lead (default 0)
+            leadMax {number} -- upper bound of an adapting lead (default
+                                2000)
+            source {str} -- file played back into the data ring by the
+                            module, from its start on every start, instead
+                            of written by a feeder (writing and mapRing()
+                            are refused meanwhile); '' for none
+            loop {bool} -- start the source over at its end, otherwise the
+                           outputs come short once it's all sent
+
+        Returns:
+            bool -- True on success, False otherwise
+        """
+        if not self.__isOpened:
+            print('Error: device needs to be opened prior to configuration.',\
+                file = stderr)
+            return False
+
+        if self.__setup:
+            print('Error: device is running.', file = stderr)
+            return False
+
+        mask = 0
+        for key in fields:
+            if key not in Gih.__CFG_FIELDS:
+                print('Error: unknown configuration {:s}.'.format(key),
+                        file = stderr)
+                return False
+            mask |= Gih.__CFG_FIELDS[key]
+
+        irq        = fields.get('irq', 0)
+        delayTime  = fields.get('delayTime', 0)
+        wrtSize    = fields.get('wrtSize', 1)
+        keepMissed = fields.get('keepMissed', 0)
+        path       = fields.get('path', '')
+        engine     = fields.get('engine', self.engine)
+        rtPrio     = fields.get('rtPrio', self.rtPrio)
+        cpu        = fields.get('cpu', self.cpu)
+        sync       = fields.get('sync', self.sync)
+        syncArg    = fields.get('syncArg', self.syncArg)
+        sink       = fields.get('sink', self.sink)
+        direct     = fields.get('direct', self.direct)
+        logClock   = fields.get('logClock', self.logClock)
+        mode       = fields.get('mode', self.mode)
+        frameLimit = fields.get('frameLimit', self.frameLimit)
+        stage      = fields.get('stage', self.stage)
+        leadMode   = fields.get('leadMode', self.leadMode)
+        lead       = fields.get('lead', self.lead)
+        leadMin    = fields.get('leadMin', self.leadMin)
+        leadMax    = fields.get('leadMax', self.leadMax)
+        source     = fields.get('source', self.source)
+        loop       = fields.get('loop', self.loop)
+        node       = fields.get('node', self.node)
+
+        if type(irq) != int or (irq < 0 and irq != Gih.IRQ_NONE):
+            print('Error: irq needs to be a positive integer or IRQ_NONE.',
+                    file = stderr)
+            return False
+
+        if type(delayTime) != int or delayTime < 0:
+            print('Error: delay time needs to be a non-negative integer '
+                'in milliseconds.', file = stderr)
+            return False
+
+        if type(wrtSize) != int or wrtSize <= 0:
+            print('Error: write size needs to be a positive integer in byte.',
+                    file = stderr)
+            return False
+
+        if sink not in (Gih.SINK_FILE, Gih.SINK_UDP, Gih.SINK_MMAP,
+                        Gih.SINK_AIO):
+            print('Error: unknown sink.', file = stderr)
+            return False
+
+        if 'path' in fields and sink in (Gih.SINK_FILE, Gih.SINK_AIO) and \
+                (not os.path.exists(path) or os.path.isdir(path)):
+            print('Error: {:s} does not exist or is a directory.'.format(path),
+                    file = stderr)
+            return False
+
+        if source and (not os.path.isfile(source)):
+            print('Error: source {:s} is not a file.'.format(source),
+                    file = stderr)
+            return False
+
+        if logClock not in (Gih.LOG_CLOCK_MONO, Gih.LOG_CLOCK_RAW):
+            print('Error: unknown log clock.', file = stderr)
+            return False
+
+        if mode not in (Gih.MODE_BYTES, Gih.MODE_FRAMES):
+            print('Error: unknown data mode.', file = stderr)
+            return False
+
+        if type(frameLimit) != int or frameLimit < 0:
+            print('Error: frame limit needs to be a non-negative integer.',
+                    file = stderr)
+            return False
+
+        if leadMode not in (Gih.LEAD_FIXED, Gih.LEAD_ADAPT):
+            print('Error: unknown lead mode.', file = stderr)
+            return False
+
+        if any(type(x) != int for x in (lead, leadMin, leadMax)) or \
+                not 0 <= leadMin <= lead <= leadMax <= 1000000:
+            print('Error: lead needs to be within [leadMin, leadMax], and '
+                'those within [0, 1000000] us.', file = stderr)
+            return False
+
+        if engine not in (Gih.ENGINE_WQ, Gih.ENGINE_KTHREAD):
+            print('Error: unknown output engine.', file = stderr)
+            return False
+
+        if type(rtPrio) != int or rtPrio < 1 or rtPrio > 99:
+            print('Error: priority needs to be an integer in [1, 99].',
+                    file = stderr)
+            return False
+
+        if type(cpu) != int or cpu < Gih.CPU_IRQ:
+            print('Error: cpu needs to be a CPU number, CPU_ANY or CPU_IRQ.',
+                    file = stderr)
+            return False
+
+        if type(node) != int or node < Gih.NODE_IRQ:
+            print('Error: node needs to be a node number, NODE_ANY or '
+                'NODE_IRQ.', file = stderr)
+            return False
+
+        if sync not in (Gih.SYNC_NEVER, Gih.SYNC_EVERY, Gih.SYNC_PERIOD,
+                        Gih.SYNC_CLOSE):
+            print('Error: unknown sync policy.', file = stderr)
+            return False
+
+        if type(syncArg) != int or syncArg < 0 or \
+                (sync in (Gih.SYNC_EVERY, Gih.SYNC_PERIOD) and syncArg == 0):
+            print('Error: sync interval needs to be a positive integer.',
+                    file = stderr)
+            return False
+
+        # all the configuration we'd need to have to be allowed to start
+        if start:
+            for key in Gih.__CFG_REQUIRED:
+                if key == 'path' and sink == Gih.SINK_MMAP:
+                    continue
+                if key not in fields and \
+                        getattr(self, key) in (-1, ''):
+                    print('{:s} not set!'.format(key), file = stderr)
+                    return False
+
+        flags = Gih.__CFG_F_START if start else 0
+        gih_config.configure_batch(self.__fd, mask, flags, irq, delayTime,
+                                   wrtSize, 1 if keepMissed else 0, path,
+                                   engine, rtPrio, cpu, sync, syncArg, sink,
+                                   logClock, mode, frameLimit,
+                                   1 if stage else 0, leadMode, lead,
+                                   leadMin, leadMax, 1 if direct else 0,
+                                   source, 1 if loop else 0, node)
+
+        for key in fields:
+            setattr(self, key, fields[key])
+        if 'keepMissed' in fields:
+            self.keepMissed = 1 if keepMissed else 0
+        if 'stage' in fields:
+            self.stage = bool(stage)
+        if mask & Gih.__CFG_FIELDS['sink']:
+            self.sink, self.direct = sink, bool(direct)
+        if mask & Gih.__CFG_FIELDS['engine']:
+            self.engine, self.rtPrio, self.cpu = engine, rtPrio, cpu
+        if mask & Gih.__CFG_FIELDS['sync']:
+            self.sync, self.syncArg = sync, syncArg
+        if mask & Gih.__CFG_FIELDS['mode']:
+            self.mode, self.frameLimit = mode, frameLimit
+        if mask & Gih.__CFG_FIELDS['lead']:
+            self.leadMode, self.lead = leadMode, lead
+            self.leadMin, self.leadMax = leadMin, leadMax
+        if mask & Gih.__CFG_FIELDS['source']:
+            self.source, self.loop = source, bool(loop)
+
+        if start:
+            self.__setup = True
+        return True
+
+
+
+    def configureRingSize(self, ringSize):
+        """Reallocate the data ring of the device. Data in the ring is lost.
+
+        Arguments:
+            ringSize {number} -- size of the data ring in byte, the device
+                                 rounds it up to a power of 2
+
+        Returns:
+            number -- on success, return the actual ring size; otherwise -1
+        """
+        if not self.__isOpened:
+            print('Error: device needs to be opened prior to configuration.',\
+                file = stderr)
+            return -1
+
+        if self.__setup:
+            print('Error: device is running.', file = stderr)
+            return -1
+
+        if self.__ring is not None:
+            print('Error: data ring is mapped, call unmapRing() first.',
+                    file = stderr)
+            return -1
+
+        if type(ringSize) != int or ringSize <= 0:
+            print('Error: ring size needs to be a positive integer in byte.',
+                    file = stderr)
+            return -1
+
+        return gih_config.configure_ring_sz(self.__fd, ringSize)
+
+
+
+    def configureLogSize(self, logSize):
+        """Reallocate the log rings of the device. Unread logs are lost,
+        the log devices can't be opened meanwhile.
+
+        Arguments:
+            logSize {number} -- number of logs each log ring holds, the
+                                device rounds it up to a power of 2
+
+        Returns:
+            number -- on success, return the actual log ring size; otherwise -1
+        """
+        if not self.__isOpened:
+            print('Error: device needs to be opened prior to configuration.',\
+                file = stderr)
+            return -1
+
+        if self.__setup:
+            print('Error: device is running.', file = stderr)
+            return -1
+
+        if type(logSize) != int or logSize <= 0:
+            print('Error: log size needs to be a positive integer.',
+                    file = stderr)
+            return -1
+
+        self.__logSize = gih_config.configure_log_sz(self.__fd, logSize)
+        return self.__logSize
+
+
+
+    def configureLowWater(self, lowWater):
+        """Set the low water mark of the device, the device polls writable
+        (select/poll/epoll on fileno()) once its data ring has at least
+        lowWater bytes free. Can be set while running.
+
+        Arguments:
+            lowWater {number} -- free space in byte
+
+        Returns:
+            number -- on success, return the set mark; otherwise -1
+        """
+        if not self.__isOpened:
+            print('Error: device needs to be opened prior to configuration.',\
+                file = stderr)
+            return -1
+
+        if type(lowWater) != int or lowWater <= 0:
+            print('Error: low water mark needs to be a positive integer.',
+                    file = stderr)
+            return -1
+
+        return gih_config.configure_low_wat(self.__fd, lowWater)
+
+
+
+    def fileno(self):
+        """File descriptor of the gih device, to be registered in an event
+        loop for writability, see configureLowWater().
+
+        Returns:
+            number -- file descriptor, -1 if not opened
+        """
+        return self.__fd
+
+
+
     def start(self):
         """Finish configuration of the gih device. Checks error.
 
@@ -306,12 +828,12 @@ class Gih(object):
             print('Error: module is not loaded', file = stderr)
             return False
 
-        if not Gih.__isOpened:
+        if not self.__isOpened:
             print('Error: device needs to be opened prior to start running.',
                     file = stderr)
             return False
 
-        if Gih.__setup:
+        if self.__setup:
             print('Error: device already running.', file = stderr)
             return False
 
@@ -333,15 +855,15 @@ class Gih(object):
             print('Missed data behavior not set!', file = stderr)
             unset = True
 
-        if self.path == '':
+        if self.path == '' and self.sink != Gih.SINK_MMAP:
             print('Output path not set!', file = stderr)
             unset = True
 
         if unset:
             return False
 
-        if gih_config.configure_start(Gih.__fd) == 0:
-            Gih.__setup = True
+        if gih_config.configure_start(self.__fd) == 0:
+            self.__setup = True
             return True
 
 
@@ -355,28 +877,66 @@ class Gih(object):
             print('Error: module is not loaded', file = stderr)
             return -1
 
-        if not Gih.__isOpened:
+        if not self.__isOpened:
             print('Error: device needs to be opened prior to stop running.',
                     file = stderr)
             return -1
 
-        if not Gih.__setup:
+        if not self.__setup:
             print('Error: device not running.', file = stderr)
             return -1
 
-        Gih.__setup = False
+        self.__setup = False
+
+        return (gih_config.configure_stop(self.__fd) == 0)
 
-        return (gih_config.configure_stop(Gih.__fd) == 0)
+
+
+    def trigger(self, period = 0, burst = 1, count = 0):
+        """Fire software interrupts, which go through the same path as the
+        ones of an irq line. The device needs to be running with irq IRQ_NONE.
+
+        Keyword Arguments:
+            period {number} -- period in ns, 0 to fire burst interrupts right
+                               away (default: {0})
+            burst {number} -- interrupts fired back to back each time; with
+                              period 0 as well it stops the periodic trigger
+                              (default: {1})
+            count {number} -- number of periods, 0 until stopped or replaced
+                              (default: {0})
+
+        Returns:
+            bool -- True on success, False otherwise
+        """
+        if not self.__setup:
+            print('Error: device not running.', file = stderr)
+            return False
+
+        if self.irq != Gih.IRQ_NONE:
+            print('Error: trigger needs the device running with IRQ_NONE.',
+                    file = stderr)
+            return False
+
+        try:
+            gih_config.configure_trigger(self.__fd, period, burst, count)
+        except Exception as e:
+            print('Error: {}'.format(e), file = stderr)
+            return False
+
+        return True
 
 
 
-    # TODO: potential unicodeError?
     def write(self, dataStr, block = False):
         """Write data to the gih device. Gih will resent these data out
         on interrupt happening.
 
+        Any buffer object (bytes, bytearray, memoryview, array, contiguous
+        numpy arrays...) is written in place, without a copy, and the GIL
+        is released during the write; text is encoded as ascii.
+
         Arguments:
-            dataStr {str} -- string to be send out to the device
+            dataStr {bytes} -- data to be send out to the device
             block {bool} -- should the write call block if the device is full
 
         Returns:
@@ -386,31 +946,391 @@ class Gih(object):
             print('Error: module is not loaded', file = stderr)
             return -1
 
-        if not Gih.__isOpened:
+        if not self.__isOpened:
             print("Error: device needs to be opened to be written to.")
             return -1
 
-        if not Gih.__setup:
+        if not self.__setup:
             print("Error: device needs to be started prior to writing.")
             return -1
 
+        if self.__ring is not None:
+            return self.writeMapped(dataStr)
+
+        if isinstance(dataStr, type(u'')):
+            dataStr = dataStr.encode('ascii')
+
         try:
-            if block:
-                outByte = Gih.__gihFile.write(dataStr)
-                Gih.__gihFile.flush()
-            else:
-                outByte = os.write(Gih.__fd, dataStr.encode('ascii'))
-            return outByte
+            return gih_config.write(self.__fd, dataStr, 1 if block else 0)
 
-        except PermissionError:
-            print('Error: writing to gih device file failed, ' +
-                   'permission denied. ' +
-                   '(root privilege required for kernel operations).',\
+        except (IOError, OSError) as e:
+            print('Error: writing to gih device file failed, {0}'.format(e),
+                  file = stderr)
+            return -1
+
+
+
+    def writev(self, buffers, block = False):
+        """Write a sequence of buffers to the gih device, in order, with as
+        few syscalls as possible (writev, 64 buffers each) and no copy or
+        join of the buffers in python. The device takes each syscall as one
+        write, so with keepMissed unset, only data before the call is
+        dropped.
+
+        Arguments:
+            buffers {list} -- buffer objects, as taken by write()
+            block {bool} -- should the call block if the device is full
+
+        Returns:
+            number -- number of bytes written to gih on success, -1 otherwise
+        """
+        if not self.__isOpened or not self.__setup:
+            print("Error: device needs to be started prior to writing.",
+                  file = stderr)
+            return -1
+
+        if self.__ring is not None:
+            written = 0
+            for data in buffers:
+                data = Gih.__asBytes(data)
+                n = self.writeMapped(data)
+                written += n
+                if n < len(data):
+                    break
+            return written
+
+        try:
+            return gih_config.writev(self.__fd, buffers, 1 if block else 0)
+
+        except (IOError, OSError) as e:
+            print('Error: writing to gih device file failed, {0}'.format(e),
+                  file = stderr)
+            return -1
+
+
+
+    def writeFrom(self, fd, count, offset = None):
+        """Move data from a file or a pipe into the gih device in the
+        kernel, without reading it into python: splice() for a pipe,
+        sendfile() for a file. Missed data is dropped once for the whole
+        call, as with writev(), though the kernel hands it over a pipe-full
+        at a time. Not in Gih.MODE_FRAMES, nor while the ring is mapped.
+
+        Arguments:
+            fd {number} -- file descriptor of the file or pipe to read
+            count {number} -- bytes to move at most
+            offset {number} -- offset to read the file at, None to read it
+                               from its current offset, which is moved
+                               (default: {None})
+
+        Returns:
+            number -- number of bytes moved on success, 0 at the end of the
+                      input or with the ring full, -1 otherwise
+        """
+        if not self.__isOpened or not self.__setup:
+            print("Error: device needs to be started prior to writing.",
+                  file = stderr)
+            return -1
+
+        try:
+            if stat.S_ISFIFO(os.fstat(fd).st_mode):
+                if not hasattr(os, 'splice'):
+                    print('Error: writing from a pipe needs os.splice().',
+                          file = stderr)
+                    return -1
+                return os.splice(fd, self.__fd, count)
+
+            if not hasattr(os, 'sendfile'):
+                print('Error: writing from a file needs os.sendfile().',
+                      file = stderr)
+                return -1
+            return os.sendfile(self.__fd, fd, offset, count)
+
+        except (IOError, OSError) as e:
+            print('Error: writing to gih device file failed, {0}'.format(e),
                   file = stderr)
             return -1
 
 
 
+    def mapRing(self):
+        """Map the data ring of the gih device into this process.
+
+        Once mapped, data is written in place into the ring and only the
+        producer index is published to the device, which saves the copy and
+        the syscall of a normal write. While mapped, write() goes through the
+        mapping as well.
+
+        Returns:
+            bool -- True on success or already mapped, False otherwise
+        """
+        if not self.__isOpened:
+            print('Error: device needs to be opened prior to mapping.',
+                    file = stderr)
+            return False
+
+        if self.__ring is not None:
+            return True
+
+        try:
+            ctrl = mmap.mmap(self.__fd, mmap.PAGESIZE, mmap.MAP_SHARED,
+                             mmap.PROT_READ | mmap.PROT_WRITE)
+            _, dataOff, size = struct.unpack_from(Gih.__RING_CTRL, ctrl)
+            ctrl.close()
+
+            self.__ring = mmap.mmap(self.__fd, dataOff + size, mmap.MAP_SHARED,
+                                   mmap.PROT_READ | mmap.PROT_WRITE)
+            self.__ringOff  = dataOff
+            self.__ringSize = size
+            return True
+
+        except (IOError, OSError, mmap.error) as e:
+            print('Error: mapping gih data ring failed, {0}'.format(e),
+                file = stderr)
+            return False
+
+
+
+    def unmapRing(self):
+        """Remove the mapping of the data ring, write() will go through the
+        device file again.
+
+        Returns:
+            bool -- True on success or not mapped
+        """
+        if self.__ring is not None:
+            self.__ring.close()
+            self.__ring = None
+        return True
+
+
+
+    def writeMapped(self, data):
+        """Write data in place into the mapped data ring, then publish it to
+        the device. Only as much data as there's free space is written; in
+        MODE_FRAMES, data is one frame, written with its length or not at
+        all.
+
+        Arguments:
+            data {bytes} -- data to be send out, any buffer object; str is
+                            encoded as ascii
+
+        Returns:
+            number -- number of bytes written to the ring, -1 if not mapped
+        """
+        if self.__ring is None:
+            print('Error: data ring is not mapped.', file = stderr)
+            return -1
+
+        data = Gih.__asBytes(data)
+
+        ring = self.__ring
+
+        head, = struct.unpack_from('=I', ring, Gih.__RING_HEAD)
+        tail, = struct.unpack_from('=I', ring, Gih.__RING_TAIL)
+
+        free = self.__ringSize - ((head - tail) & 0xffffffff)
+        n    = min(len(data), free)
+
+        if self.mode == Gih.MODE_FRAMES:
+            if not len(data) or 4 + len(data) > free:
+                return 0
+            self.__ringPut(struct.pack('=I', n), head)
+            head += 4
+
+        self.__ringPut(data[:n], head)
+
+        # publish the data, the device takes it from the next output on
+        struct.pack_into('=I', ring, Gih.__RING_HEAD,
+                         (head + n) & 0xffffffff)
+        return n
+
+
+
+    def __ringPut(self, data, head):
+        """Copy data into the mapped data ring at producer index head,
+        wrapping around its end. Nothing is published."""
+        ring  = self.__ring
+        size  = self.__ringSize
+        off   = self.__ringOff
+        pos   = head & (size - 1)
+        first = min(len(data), size - pos)
+
+        ring[off + pos : off + pos + first] = data[:first]
+        if len(data) > first:
+            ring[off : off + len(data) - first] = data[first:]
+
+
+
+    @staticmethod
+    def __asBytes(data):
+        """View data as a sequence of bytes that slices by byte, without a
+        copy where python allows it.
+
+        Arguments:
+            data {bytes} -- any buffer object, or str encoded as ascii
+
+        Returns:
+            bytes -- a byte memoryview of data (a bytes/str on python 2)
+        """
+        if isinstance(data, type(u'')):
+            data = data.encode('ascii')
+
+        if sys.version_info[0] >= 3:
+            view = memoryview(data)
+            return view if view.format == 'B' and view.ndim == 1 \
+                else view.cast('B')
+
+        if isinstance(data, (bytes, bytearray)):
+            return data
+        return memoryview(data).tobytes()
+
+
+
+    def readOutput(self, size = -1):
+        """Read the output of a SINK_MMAP device from its output ring. The
+        ring is mapped on the first call, after the device was started with
+        SINK_MMAP; poll() on fileno() reports POLLIN while there's output.
+
+        Arguments:
+            size {number} -- max number of bytes to read, -1 for everything
+
+        Returns:
+            bytes -- the output read, None on failure
+        """
+        if not self.__isOpened:
+            print('Error: device needs to be opened prior to reading.',
+                    file = stderr)
+            return None
+
+        try:
+            if self.__out is None:
+                ctrl = mmap.mmap(self.__fd, mmap.PAGESIZE, mmap.MAP_SHARED,
+                                 mmap.PROT_READ, offset = Gih.__OUT_OFF)
+                _, dataOff, ringSize = \
+                    struct.unpack_from(Gih.__RING_CTRL, ctrl)
+                ctrl.close()
+
+                self.__out = mmap.mmap(self.__fd, dataOff + ringSize,
+                                       mmap.MAP_SHARED,
+                                       mmap.PROT_READ | mmap.PROT_WRITE,
+                                       offset = Gih.__OUT_OFF)
+
+        except (IOError, OSError, mmap.error) as e:
+            print('Error: mapping gih output ring failed, {0}'.format(e),
+                file = stderr)
+            return None
+
+        out = self.__out
+        _, off, ringSize = struct.unpack_from(Gih.__RING_CTRL, out)
+        head, = struct.unpack_from('=I', out, Gih.__RING_HEAD)
+        tail, = struct.unpack_from('=I', out, Gih.__RING_TAIL)
+
+        n = (head - tail) & 0xffffffff
+        if size >= 0:
+            n = min(n, size)
+
+        pos   = tail & (ringSize - 1)
+        first = min(n, ringSize - pos)
+        data  = out[off + pos : off + pos + first] + out[off : off + n - first]
+
+        # give the space back to the output
+        struct.pack_into('=I', out, Gih.__RING_TAIL, (tail + n) & 0xffffffff)
+        return data
+
+
+
+    def readHistogram(self, stage, reset = False):
+        """Read a latency histogram of the device from debugfs (debugfs
+        needs to be mounted, root privilege required). All values are in ns.
+
+        Arguments:
+            stage {str} -- HIST_IRQ_START (interrupt to output start),
+                           HIST_START_END (output start to end) or
+                           HIST_DEADLINE (output start minus interrupt time
+                           plus delay, negative if early)
+            reset {bool} -- empty the histogram after reading it
+
+        Returns:
+            dict -- 'count', 'min', 'max', 'mean', 'p50', 'p99', 'p99.9' and
+                    'buckets', a list of (lower, upper, count); None on
+                    failure
+        """
+        path = Gih.__HIST_FILE.format(self.instance, stage)
+        hist = {'buckets': []}
+
+        try:
+            with open(path, 'r') as f:
+                for line in f:
+                    fields = line.split()
+                    if not fields or fields[0] == 'buckets':
+                        continue
+                    if fields[0].endswith(':'):
+                        if len(fields) > 1:
+                            hist[fields[0][:-1]] = int(fields[1])
+                    else:
+                        hist['buckets'].append(tuple(int(x) for x in fields))
+
+            if reset:
+                with open(path, 'w') as f:
+                    f.write('0')
+
+        except (IOError, OSError, ValueError) as e:
+            print('Error: reading histogram {:s} failed, {}'.format(path, e),
+                file = stderr)
+            return None
+
+        return hist
+
+
+
+    def readStats(self):
+        """Read the drop accounting counters of the device from sysfs. The
+        counters only grow, from the load of the module on.
+
+        Returns:
+            dict -- counter name to value: 'irqs', 'irqs_missed', 'emits',
+                    'short_writes', 'bytes_in', 'bytes_out', 'bytes_full',
+                    'bytes_discarded', 'bytes_lost' and 'logN_dropped' for
+                    each log device N; None on failure
+        """
+        path = Gih.__STATS_DIR.format(self.instance)
+        stats = {}
+
+        try:
+            for name in os.listdir(path):
+                with open(os.path.join(path, name), 'r') as f:
+                    stats[name] = int(f.read())
+
+        except (IOError, OSError, ValueError) as e:
+            print('Error: reading counters {:s} failed, {}'.format(path, e),
+                file = stderr)
+            return None
+
+        return stats
+
+
+
+    def readLead(self):
+        """Read the lead of the output timer in use from sysfs, the one
+        adapted so far with LEAD_ADAPT.
+
+        Returns:
+            number -- the lead in ns, None on failure
+        """
+        path = Gih.__LEAD_FILE.format(self.instance)
+
+        try:
+            with open(path, 'r') as f:
+                return int(f.read())
+
+        except (IOError, OSError, ValueError) as e:
+            print('Error: reading lead {:s} failed, {}'.format(path, e),
+                file = stderr)
+            return None
+
+
+
     def __str__(self):
         """Creates a formatted string of the gih object with its status.
 
@@ -419,12 +1339,12 @@ class Gih(object):
         """
 
         return \
-        "========gih device========\n" +\
+        "========gih device {:d}========\n".format(self.instance) +\
         "- Module is {:s}loaded\n".format("" if Gih.__isLoaded else "un") +\
         "- Device is {:s}.\n"\
-            .format("opened" if Gih.__isOpened else "closed") +\
+            .format("opened" if self.__isOpened else "closed") +\
         "- Device is currently{:s} running.\n\n"\
-            .format("" if Gih.__setup else " not") +\
+            .format("" if self.__setup else " not") +\
         "- Configuration status (-1 being not configured):\n" +\
         "     IRQ: {:d}\n".format(self.irq) +\
         "     Delay Time: {:d} millisecond(s)\n".format(self.delayTime) +\
@@ -438,11 +1358,14 @@ class Gih(object):
 
 
     @staticmethod
-    def load(modPath = 'gih.ko'):
+    def load(modPath = 'gih.ko', instances = 1, ringSize = 0, logSize = 0):
         """Load the module if it's not loaded. Need root privilege, and
 
         Arguments:
             modPath {str} -- path of the module. defaulted to a relative path.
+            instances {number} -- number of gih instances to create
+            ringSize {number} -- initial data ring size in byte, 0 for default
+            logSize {number} -- initial log ring size in logs, 0 for default
 
         Returns:
             bool -- True on success loading, False if loaded or failed loading.
@@ -453,13 +1376,20 @@ class Gih(object):
 
         # personally I'd change this one to subprocess.run, which was added in
         # python 3.5. To maintain compatibility, I'll use call here
-        cmd = 'insmod {:s}'.format(modPath)
+        cmd = 'insmod {:s} instances={:d}'.format(modPath, instances)
+        if ringSize > 0:
+            cmd += ' ring_size={:d}'.format(ringSize)
+        if logSize > 0:
+            cmd += ' log_size={:d}'.format(logSize)
         print('Running shell command: \"{:s}\" ...'.format(cmd))
 
         retcode = subprocess.call(cmd, shell=True)
         if retcode == 0:
             Gih.__isLoaded = True
             Gih.__modPath  = modPath
+            Gih.__instances = instances
+            if logSize > 0:
+                Gih.__logSize = logSize
             return True
         else:
             print('Error: module loading failed, shell returned {:d}'.\
@@ -510,12 +1440,11 @@ class Gih(object):
             return False
 
         Gih.unload()
-        Gih.load(Gih.__modPath)
+        Gih.load(Gih.__modPath, Gih.__instances)
 
 
 
-    @staticmethod
-    def open():
+    def open(self):
         """Open the gih device file.
         This device file NEEDS TO BE OPENED while operating.
         However, simply opening the device will not run it, start() needs to be
@@ -532,15 +1461,15 @@ class Gih(object):
             print('Error: module is not loaded', file = stderr)
             return -1
 
-        if Gih.__isOpened:
+        if self.__isOpened:
             print('Error: device already opened.', file = stderr)
             return True
 
         try:
             print('Opening gih device...', file = stderr)
-            Gih.__fd  = os.open(Gih.__GIH_DEVICE, os.O_NONBLOCK | os.O_WRONLY)
-            Gih.__gihFile  = os.fdopen(Gih.__fd, 'w')
-            Gih.__isOpened = True
+            self.__fd  = os.open(self.__gihDevice, os.O_NONBLOCK | os.O_RDWR)
+            self.__gihFile  = os.fdopen(self.__fd, 'w')
+            self.__isOpened = True
             return True
 
         except IOError:
@@ -556,8 +1485,7 @@ class Gih(object):
 
 
 
-    @staticmethod
-    def close():
+    def close(self):
         """Closed the device file.
         This will also stop the gih device from catching interrupts.
 
@@ -570,17 +1498,23 @@ class Gih(object):
             print('Error: module is not loaded', file = stderr)
             return -1
 
-        if not Gih.__isOpened:
+        if not self.__isOpened:
             print('Error: device is not opened.', file = stderr)
             return True
 
         try:
             print('Closing gih device...', file = stderr)
-            Gih.__gihFile.close()
-            Gih.__gihFile  = None
-            Gih.__fd       = -1
-            Gih.__setup    = False
-            Gih.__isOpened = False
+            if self.__ring is not None:
+                self.__ring.close()
+                self.__ring = None
+            if self.__out is not None:
+                self.__out.close()
+                self.__out = None
+            self.__gihFile.close()
+            self.__gihFile  = None
+            self.__fd       = -1
+            self.__setup    = False
+            self.__isOpened = False
             return True
 
         except:
@@ -589,30 +1523,29 @@ class Gih(object):
 
 
 
-    @staticmethod
-    def remove():
+    def remove(self):
         """Shutdown the gih device, wrapper method for both close and unload.
 
         Returns:
             bool -- True on success, False otherwise
         """
-        if Gih.close():
+        if self.close():
             Gih.unload()
             return True
         return False
 
 
 
-    @staticmethod
-    def readIntrLogs():
-        """Read logs recorded at interrupt happening from the gihlog0 device
+    def readIntrLogs(self):
+        """Read logs recorded at interrupt happening from the gihlog<instance>.0 device
 
         Returns:
             list -- list of all logs currently in the file (as strings)
         """
         try:
-            with open(Gih.__INTR_LOG, 'r') as logdev:
-                allContent = logdev.read(Gih.__MAX_ALL_LOG_SIZE)
+            with open(self.__intrLog, 'r') as logdev:
+                allContent = logdev.read(Gih.__LOG_STR_SIZE * self.__logSize *
+                                         Gih.__NCPU)
                 logLines = [s + ' at interrupt happening' \
                             for s in allContent.split('\n')]
                 return logLines[:-1]
@@ -629,16 +1562,15 @@ class Gih(object):
 
 
 
-    @staticmethod
-    def readWQNLogs():
-        """Read logs recorded at entering workqueue from the gihlog1 device
+    def readWQNLogs(self):
+        """Read logs recorded at entering workqueue from the gihlog<instance>.1 device
 
         Returns:
             list -- list of all logs currently in the file (as strings)
         """
         try:
-            with open(Gih.__WQ_N_LOG, 'r') as logdev:
-                allContent = logdev.read(Gih.__MAX_ALL_LOG_SIZE)
+            with open(self.__wqNLog, 'r') as logdev:
+                allContent = logdev.read(Gih.__LOG_STR_SIZE * self.__logSize)
                 logLines = [s + ' at entering workqueue' \
                             for s in allContent.split('\n')]
                 return logLines[:-1]
@@ -656,16 +1588,15 @@ class Gih(object):
 
 
 
-    @staticmethod
-    def readWQXLogs():
-        """Read logs recorded at existing workqueue from the gihlog2 device
+    def readWQXLogs(self):
+        """Read logs recorded at existing workqueue from the gihlog<instance>.2 device
 
         Returns:
             list -- list of all logs currently in the file (as strings)
         """
         try:
-            with open(Gih.__WQ_X_LOG, 'r') as logdev:
-                allContent = logdev.read(Gih.__MAX_ALL_LOG_SIZE)
+            with open(self.__wqXLog, 'r') as logdev:
+                allContent = logdev.read(Gih.__LOG_STR_SIZE * self.__logSize)
                 logLines = [s + ' at exiting workqueue' \
                             for s in allContent.split('\n')]
                 return logLines[:-1]
@@ -682,10 +1613,10 @@ class Gih(object):
 
 
 
-    @staticmethod
-    def readAllLogs(sortKey = 'type'):
-        """Read all logs from all three devices, and return a sorted list of
-        all the logs.
+    def readAllLogs(self, sortKey = 'type'):
+        """Read all logs from the interrupt and workqueue devices, and return
+        a sorted list of all the logs. readEventLogs() gives the same
+        timeline with one record per interrupt, without merging anything.
 
         Keyword Arguments:
             sortKey {str} -- sorting key for the logs (default: {'type'})
@@ -698,9 +1629,9 @@ class Gih(object):
             list -- sorted list of logs
         """
         # performance issues here when interrupts are frequent.
-        allLogs = Gih.readIntrLogs()
-        allLogs.extend(Gih.readWQNLogs())
-        allLogs.extend(Gih.readWQXLogs())
+        allLogs = self.readIntrLogs()
+        allLogs.extend(self.readWQNLogs())
+        allLogs.extend(self.readWQXLogs())
 
         # okay, python don't have a switch statement...
         # type: sort by which log device were they from
@@ -711,10 +1642,9 @@ class Gih(object):
         elif sortKey == 'time':
             return sorted(allLogs, key = lambda x: x.split(']')[0])
 
-        # sort according to interrupt count. Notice that with current
-        # implementation, all 3 log devices have their own interrupt count
-        # therefore this is NOT in the actual order if there's interrupt
-        # missed. This should be stable w/ respect to type
+        # sort according to interrupt count. All 3 log devices record the
+        # sequence number of the interrupt that caused the log, so this is
+        # in the actual order. This should be stable w/ respect to type
         # this is also slow.
         elif sortKey == 'count':
             return sorted(allLogs, key = lambda x: int(x.split()[3]))
@@ -725,3 +1655,331 @@ class Gih(object):
             return allLogs
 
 
+
+    def openLog(self, logDev, batch = 1, tail = False):
+        """Open a log device for an event loop. The log device is set to
+        binary format and polls readable once it has at least batch logs to
+        read; read it with os.read() and decode with decodeLogs(). Close it
+        with os.close() when done. Any number of files may read the same
+        log device, each gets all the logs: a file that falls a whole log
+        ring behind skips the logs it was lapped on, see logDrops().
+
+        Arguments:
+            logDev {number} -- which log device to open, 0 for interrupt
+                               happening, 1 for entering workqueue, 2 for
+                               exiting workqueue, 3 for events and 4 for
+                               the writes of SINK_AIO (decode both with
+                               decodeEventLogs())
+            batch {number} -- number of logs to poll readable (default: {1})
+            tail {bool} -- skip the logs the device holds, read only the
+                           logs to come (default: {False})
+
+        Returns:
+            number -- file descriptor of the log device, -1 on failure
+        """
+        path = (self.__intrLog, self.__wqNLog, self.__wqXLog,
+                self.__eventLog, self.__aioLog)[logDev]
+
+        try:
+            fd = os.open(path, os.O_RDONLY | os.O_NONBLOCK)
+        except (IOError, OSError) as e:
+            print('Error: open gihlog device file failed, {0}'.format(e),
+                file = stderr)
+            return -1
+
+        try:
+            version = gih_config.configure_log_format(fd, Gih.__LOG_FMT_BIN)
+            if version != Gih.__LOG_VERSION:
+                print('Error: unsupported log record version {:d}.'\
+                    .format(version), file = stderr)
+                os.close(fd)
+                return -1
+            gih_config.configure_log_batch(fd, batch)
+            if tail:
+                gih_config.configure_log_tail(fd)
+        except Exception as e:
+            print('Error: configure gihlog device failed, {0}'.format(e),
+                file = stderr)
+            os.close(fd)
+            return -1
+
+        return fd
+
+
+
+    @staticmethod
+    def logDrops(fd):
+        """Number of logs a log device file lost, for being lapped by the
+        writer: logs are never held back for a slow reader.
+
+        Arguments:
+            fd {number} -- file descriptor of the log device, see openLog()
+
+        Returns:
+            number -- logs lost since the file was opened, -1 on failure
+        """
+        try:
+            return gih_config.configure_log_drops(fd)
+        except Exception as e:
+            print('Error: query gihlog device failed, {0}'.format(e),
+                file = stderr)
+            return -1
+
+
+
+    def readBinLogs(self, logDev):
+        """Read logs from a log device in binary format, without any text
+        formatting or parsing.
+
+        Arguments:
+            logDev {number} -- which log device to read, 0 for interrupt
+                               happening, 1 for entering workqueue, 2 for
+                               exiting workqueue, 3 for events and 4 for
+                               the writes of SINK_AIO
+
+        Returns:
+            list -- list of all logs currently in the device, as tuples of
+                    (stampNs, irqCount, byteSent), see decodeLogs(), or of
+                    the event and aio logs as decodeEventLogs(); False on
+                    failure
+        """
+        path = (self.__intrLog, self.__wqNLog, self.__wqXLog,
+                self.__eventLog, self.__aioLog)[logDev]
+        chunks = []
+
+        try:
+            fd = os.open(path, os.O_RDONLY)
+            try:
+                version = gih_config.configure_log_format(fd, Gih.__LOG_FMT_BIN)
+                if version != Gih.__LOG_VERSION:
+                    print('Error: unsupported log record version {:d}.'\
+                        .format(version), file = stderr)
+                    return False
+
+                chunk = os.read(fd, Gih.__LOG_READ_SIZE)
+                while chunk:
+                    chunks.append(chunk)
+                    chunk = os.read(fd, Gih.__LOG_READ_SIZE)
+            finally:
+                os.close(fd)
+
+        except (IOError, OSError) as e:
+            print('Error: read gihlog device file failed, {0}'.format(e),
+                file = stderr)
+            return False
+
+        if logDev in (3, 4):
+            return Gih.decodeEventLogs(b''.join(chunks))
+        return Gih.decodeLogs(b''.join(chunks))
+
+
+
+    def readEventLogs(self):
+        """Read the event log: one record per interrupt whose output is done,
+        in the order of the interrupts, with the time of the interrupt and
+        of the start and end of its output. Interrupts dropped on a full
+        event queue have no record, they show as gaps in irqCount.
+
+        Returns:
+            list -- list of (irqNs, startNs, endNs, irqCount, byteSent)
+                    tuples, see decodeEventLogs(); False on failure
+        """
+        return self.readBinLogs(3)
+
+
+
+    def iterLogs(self, logDev, chunk = 4096, timeout = None, tail = False):
+        """Stream the logs of a log device: a generator that reads them in
+        binary format, chunk records per read whenever the device polls
+        readable, and yields them one by one as decoded tuples. Memory use
+        is one chunk, however long the capture; close the generator (or
+        break out of the loop) to release the log device.
+
+        Arguments:
+            logDev {number} -- which log device to read, 0 to 4 as in
+                               readBinLogs()
+            chunk {number} -- records per read, also the number of logs the
+                              device polls readable at (default: {4096})
+            timeout {number} -- milliseconds without a full chunk after
+                                which the logs left are read and the
+                                iteration ends, None to stream until closed
+                                (default: {None})
+            tail {bool} -- as in openLog() (default: {False})
+
+        Yields:
+            tuple -- a log as decodeLogs() or, for the event log,
+                     decodeEventLogs() gives them
+        """
+        record = Gih.__EVENT_RECORD if logDev in (3, 4) else Gih.__LOG_RECORD
+        buf    = bytearray(chunk * record.size)
+        view   = memoryview(buf)
+
+        for n in self.__logChunks(logDev, view, chunk, timeout, tail):
+            for off in range(0, n, record.size):
+                yield record.unpack_from(buf, off)
+
+
+
+    def iterLogArrays(self, logDev, out = None, chunk = 4096, timeout = None,
+                      tail = False):
+        """Stream the logs of a log device into numpy structured arrays (see
+        logDtype()): a generator that reads the records straight into the
+        memory of one array whenever the device polls readable, and yields
+        the part of it that was filled. The same array is filled again on
+        the next iteration, copy what you need to keep (or write it out, 
+        e.g. with tofile()) before going on.
+
+        Arguments:
+            logDev {number} -- which log device to read, 0 to 4 as in
+                               readBinLogs()
+            out {ndarray} -- preallocated C-contiguous array of logDtype(),
+                             filled by every read; None to allocate one of
+                             chunk records (default: {None})
+            chunk {number} -- records per read if out isn't given, also the
+                              number of logs the device polls readable at
+                              (default: {4096})
+            timeout {number} -- as in iterLogs() (default: {None})
+            tail {bool} -- as in openLog() (default: {False})
+
+        Yields:
+            ndarray -- view of out holding the records just read
+        """
+        if numpy is None:
+            print('Error: numpy is needed for log arrays.', file = stderr)
+            return
+
+        dtype = Gih.logDtype(logDev)
+        if out is None:
+            out = numpy.empty(chunk, dtype)
+        elif out.dtype != dtype or not out.flags['C_CONTIGUOUS']:
+            print('Error: log array needs to be C-contiguous, of dtype '
+                  'logDtype({:d}).'.format(logDev), file = stderr)
+            return
+
+        view = memoryview(out.reshape(-1).view(numpy.uint8))
+
+        for n in self.__logChunks(logDev, view, out.size, timeout, tail):
+            yield out.reshape(-1)[:n // dtype.itemsize]
+
+
+
+    @staticmethod
+    def logDtype(logDev):
+        """numpy structured dtype of the binary records of a log device, the
+        fields named as in decodeLogs() and decodeEventLogs().
+
+        Arguments:
+            logDev {number} -- which log device, 0 to 4
+
+        Returns:
+            dtype -- the record dtype, None without numpy
+        """
+        if numpy is None:
+            return None
+
+        if logDev in (3, 4):
+            return numpy.dtype([('irqNs', '=u8'), ('startNs', '=u8'),
+                                ('endNs', '=u8'), ('irqCount', '=u4'),
+                                ('byteSent', '=i4')])
+
+        return numpy.dtype([('stampNs', '=u8'), ('irqCount', '=u4'),
+                            ('byteSent', '=i4')])
+
+
+
+    def __logChunks(self, logDev, view, batch, timeout, tail):
+        """Read a log device in binary format into view, each time it polls
+        readable with batch logs.
+
+        Arguments:
+            logDev {number} -- which log device to read, 0 to 4
+            view {memoryview} -- writable bytes the records are read into,
+                                 a whole number of records
+            batch {number} -- number of logs the device polls readable at,
+                              capped to the log ring size
+            timeout {number} -- milliseconds to wait for a batch before the
+                                logs left are read and the reading ends,
+                                None to wait forever
+            tail {bool} -- as in openLog()
+
+        Yields:
+            number -- number of bytes read into view, non-zero
+        """
+        fd = self.openLog(logDev, max(1, min(batch, self.__logSize)), tail)
+        if fd < 0:
+            return
+
+        poller = select.poll()
+        poller.register(fd, select.POLLIN)
+
+        try:
+            while True:
+                ready = poller.poll(-1 if timeout is None else timeout)
+
+                if hasattr(os, 'readv'):
+                    n = os.readv(fd, [view])
+                else:
+                    data = os.read(fd, len(view))
+                    n = len(data)
+                    view[:n] = data
+
+                if n:
+                    yield n
+                elif not ready:
+                    return
+        finally:
+            os.close(fd)
+
+
+
+    @staticmethod
+    def decodeLogs(data):
+        """Decode binary log records, as read from a log device in binary
+        format.
+
+        Arguments:
+            data {bytes} -- binary log records
+
+        Returns:
+            list -- list of (stampNs, irqCount, byteSent) tuples, stampNs
+                    in nanoseconds of the log clock, byteSent -1 but for
+                    the exiting workqueue log
+        """
+        return Gih.__unpackAll(Gih.__LOG_RECORD, data)
+
+
+
+    @staticmethod
+    def decodeEventLogs(data):
+        """Decode binary event log records, as read from the event log
+        device (3) in binary format.
+
+        Arguments:
+            data {bytes} -- binary event log records
+
+        Returns:
+            list -- list of (irqNs, startNs, endNs, irqCount, byteSent)
+                    tuples, times in nanoseconds of the log clock
+        """
+        return Gih.__unpackAll(Gih.__EVENT_RECORD, data)
+
+
+
+    @staticmethod
+    def __unpackAll(record, data):
+        """Unpack all the whole records of data.
+
+        Arguments:
+            record {Struct} -- the record
+            data {bytes} -- records, a partial one at the end is ignored
+
+        Returns:
+            list -- list of tuples, one per record
+        """
+        end = len(data) - len(data) % record.size
+
+        if hasattr(record, 'iter_unpack'):
+            return list(record.iter_unpack(memoryview(data)[:end]))
+
+        return [record.unpack_from(data, off) \
+                for off in range(0, end, record.size)]
@@ -3,7 +3,10 @@
  * Author: Weiyang Wang
  * Description: User land configuration utility for the gih device,
  *              responsible for calling all the ioctl routines to set the
- *              irq number, delay time, write-file path and write size.
+ *              irq number, delay time, write-file path and write size,
+ *              and the output format of the log devices; also the data path
+ *              of the feeder, write/writev of any buffer object without a
+ *              copy, the GIL released during the syscalls.
  *
  *              The function defined in this file is supposed to be called 
  *              by the python script that will be used to configure the file
@@ -20,17 +23,23 @@
 
 #include <sys/types.h>
 #include <sys/ioctl.h>
+#include <sys/uio.h>
 
 #include <err.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <limits.h>
+#include <poll.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 
 #define MOD_NAME "gih_config"
-#define MOD_DOC  "gih ioctl configuration routines"
+#define MOD_DOC  "gih ioctl configuration routines and data writes"
+
+/* buffers submitted per writev() call, views are kept on the stack */
+#define WRITEV_BATCH 64
 
 /* gih ioctl */
 #define GIH_IOC 'G'
@@ -42,6 +51,61 @@
 #define GIH_IOC_CONFIG_START    _IO (GIH_IOC, 5)
 #define GIH_IOC_CONFIG_STOP     _IO (GIH_IOC, 6)
 #define GIH_IOC_CONFIG_MISS     _IOW(GIH_IOC, 7, int)
+#define GIH_IOC_CONFIG_RING_SZ  _IOW(GIH_IOC, 8, size_t)
+#define GIH_IOC_CONFIG_LOG_SZ   _IOW(GIH_IOC, 9, unsigned int)
+#define GIH_IOC_CONFIG          _IOW(GIH_IOC, 10, struct gih_config)
+#define GIH_IOC_CONFIG_LOW_WAT  _IOW(GIH_IOC, 11, unsigned int)
+#define GIH_IOC_TRIGGER         _IOW(GIH_IOC, 12, struct gih_trigger)
+#define GIH_IRQ_NONE            (-2)    /* no irq line, trigger only */
+
+#define GIH_LOG_IOC_FORMAT      _IOW(GIH_IOC, 16, int)
+#define GIH_LOG_IOC_VERSION     _IO (GIH_IOC, 17)
+#define GIH_LOG_IOC_BATCH       _IOW(GIH_IOC, 18, unsigned int)
+#define GIH_LOG_IOC_DROPS       _IO (GIH_IOC, 19)
+#define GIH_LOG_IOC_TAIL        _IO (GIH_IOC, 20)
+
+/* batched configuration, keep in sync with gih.h */
+#define PATH_MAX_LEN 128
+#define GIH_CONFIG_VERSION 11
+
+struct gih_config {
+    uint32_t version;               /* GIH_CONFIG_VERSION */
+    uint32_t mask;                  /* GIH_CFG_* fields to apply */
+    uint32_t flags;                 /* GIH_CFG_F_* */
+    int32_t irq;                    /* irq line */
+    uint32_t delay_msec;            /* delay time in milliseconds */
+    uint32_t keep_missed;           /* keep missed data or not */
+    uint64_t write_size;            /* bytes to output on each interrupt */
+    int32_t engine;                 /* 0 workqueue, 1 kthread */
+    int32_t rt_prio;                /* SCHED_FIFO priority, kthread engine */
+    int32_t cpu;                    /* CPU of the kthread engine, -1 any,
+                                       -2 the irq's CPU */
+    int32_t node;                   /* NUMA node, -1 any, -2 the irq's */
+    uint32_t sync;                  /* 0 never, 1 every sync_arg outputs, 
+                                       2 every sync_arg ms, 3 on close */
+    uint32_t sync_arg;              /* outputs or milliseconds, by sync */
+    uint32_t sink;                  /* 0 file, 1 udp, 2 mmap output ring,
+                                       3 file written asynchronously */
+    uint32_t sink_flags;            /* 1 for direct writes, aio sink */
+    uint32_t log_clock;             /* log stamps, 0 monotonic, 1 raw */
+    uint32_t mode;                  /* data ring, 0 bytes, 1 frames */
+    uint32_t frame_limit;           /* frames per output, 0 for no limit */
+    uint32_t stage;                 /* stage the payload ahead, 0 or 1 */
+    uint32_t lead_mode;             /* timer lead, 0 fixed, 1 adapting */
+    uint32_t lead_usec;             /* lead, or the first one to adapt */
+    uint32_t lead_min_usec;         /* bounds of an adapting lead */
+    uint32_t lead_max_usec;
+    uint32_t source_flags;          /* 1 to loop the source */
+    char path[PATH_MAX_LEN];        /* destination path, NUL terminated */
+    char source[PATH_MAX_LEN];      /* played back file, "" for none */
+};
+
+/* software trigger, keep in sync with gih.h */
+struct gih_trigger {
+    uint64_t period_ns;             /* 0 to fire once, from the ioctl */
+    uint32_t burst;                 /* interrupts fired each time */
+    uint32_t count;                 /* periods to fire, 0 for no limit */
+};
 
 
 /* see the header comments for each function */
@@ -52,6 +116,18 @@ static PyObject * configure_path    (PyObject *, PyObject *);
 static PyObject * configure_missed  (PyObject *, PyObject *);
 static PyObject * configure_start   (PyObject *, PyObject *);
 static PyObject * configure_stop    (PyObject *, PyObject *);
+static PyObject * configure_batch   (PyObject *, PyObject *);
+static PyObject * configure_ring_sz (PyObject *, PyObject *);
+static PyObject * configure_log_sz  (PyObject *, PyObject *);
+static PyObject * configure_low_wat (PyObject *, PyObject *);
+static PyObject * configure_log_format (PyObject *, PyObject *);
+static PyObject * configure_log_batch  (PyObject *, PyObject *);
+static PyObject * configure_log_drops  (PyObject *, PyObject *);
+static PyObject * configure_log_tail   (PyObject *, PyObject *);
+static PyObject * configure_trigger    (PyObject *, PyObject *);
+static PyObject * data_write  (PyObject *, PyObject *);
+static PyObject * data_writev (PyObject *, PyObject *);
+static ssize_t write_all(int, struct iovec *, int, int);
 
 
 /* register functions */
@@ -78,6 +154,39 @@ static PyMethodDef config_methods[] = {
     { "configure_stop", configure_stop, 
         METH_VARARGS, "stop device" },
 
+    { "configure_batch", configure_batch, 
+        METH_VARARGS, "configure several fields at once, optionally start" },
+
+    { "configure_ring_sz", configure_ring_sz, 
+        METH_VARARGS, "configure data ring size in byte" },
+
+    { "configure_log_sz", configure_log_sz, 
+        METH_VARARGS, "configure log ring size in number of logs" },
+
+    { "configure_low_wat", configure_low_wat, 
+        METH_VARARGS, "configure free space in byte to poll writable" },
+
+    { "configure_log_format", configure_log_format, 
+        METH_VARARGS, "configure output format of a log device" },
+
+    { "configure_log_batch", configure_log_batch, 
+        METH_VARARGS, "configure number of logs to poll readable" },
+
+    { "configure_log_drops", configure_log_drops, 
+        METH_VARARGS, "number of logs a log device file lost" },
+
+    { "configure_log_tail", configure_log_tail, 
+        METH_VARARGS, "skip the logs held by a log device file" },
+
+    { "configure_trigger", configure_trigger, 
+        METH_VARARGS, "fire software interrupts, once or periodically" },
+
+    { "write", data_write, 
+        METH_VARARGS, "write a buffer object to the device" },
+
+    { "writev", data_writev, 
+        METH_VARARGS, "write a sequence of buffer objects to the device" },
+
     { NULL, NULL, 0, NULL }
 };
 
@@ -134,14 +243,14 @@ PyMODINIT_FUNC PyInit_gih_config(void) {
  *     @self: the calling object
  *     @args: argument that wraps two integer value
  *            arg1: int fd - file descriptor
- *            arg2: int irq - irq number
+ *            arg2: int irq - irq number, or GIH_IRQ_NONE for no irq line
  *     
  * Side Effects:
  *     On success, the irq number associated with the gih device is set to 
  *     the number specified by args.
  *     
  * Error Condition: 
- *     Argument is invalid if isn't a positive integer. 
+ *     Argument is invalid if isn't a positive integer or GIH_IRQ_NONE. 
  *     This function will NOT check if this irq is assigned to any device 
  *     as long as it's a positive integer!
  *     
@@ -157,7 +266,7 @@ static PyObject * configure_irq(PyObject * self, PyObject * args) {
 
     /* parse the input number and check validity */
     if (!PyArg_ParseTuple(args, "ii:IRQ", &fd, &irq))   return NULL;
-    if (irq < 0)                                        return NULL;
+    if (irq < 0 && irq != GIH_IRQ_NONE)                 return NULL;
 
     /* call the ioctl to set irq */
     if (ioctl(fd, GIH_IOC_CONFIG_IRQ, irq) < 0) {
@@ -467,3 +576,679 @@ static PyObject * configure_stop(PyObject * self, PyObject * args) {
     return Py_BuildValue("i", 0);
 }
 
+/*
+ * Function name: configure_batch
+ * 
+ * Function prototype:
+ *     static PyObject * configure_batch(PyObject * self, PyObject * args)
+ *     
+ * Description: 
+ *     Configures all fields selected by mask in one ioctl, and starts the 
+ *     device if asked by flags. The device validates all of them before 
+ *     taking any, so either everything is configured or nothing is.
+ *     
+ * Arguments:
+ *     @self: the calling object
+ *     @args: argument that wraps twenty-six value
+ *            arg1: int fd - file descriptor
+ *            arg2: unsigned int mask - fields to configure (GIH_CFG_*)
+ *            arg3: unsigned int flags - GIH_CFG_F_*, 1 to start the device
+ *            arg4: int irq - irq number
+ *            arg5: unsigned int delay - delay time in ms
+ *            arg6: unsigned long long wrt_sz - write size in bytes
+ *            arg7: int keep_missed - keep missed data or not
+ *            arg8: str path - path of the destination file
+ *            arg9: int engine - output engine, 0 workqueue, 1 kthread
+ *            arg10: int rt_prio - SCHED_FIFO priority of the kthread
+ *            arg11: int cpu - CPU of the kthread, -1 any, -2 the irq's
+ *            arg12: unsigned int sync - sync policy of the destination
+ *            arg13: unsigned int sync_arg - outputs or ms between syncs
+ *            arg14: unsigned int sink - destination sink type
+ *            arg15: unsigned int log_clock - clock of the log stamps
+ *            arg16: unsigned int mode - data mode, 0 bytes, 1 frames
+ *            arg17: unsigned int frame_limit - frames per output, 0 no limit
+ *            arg18: unsigned int stage - stage the payload ahead, 0 or 1
+ *            arg19: unsigned int lead_mode - timer lead, 0 fixed, 1 adapting
+ *            arg20: unsigned int lead_usec - lead, or the first to adapt
+ *            arg21: unsigned int lead_min_usec - lower bound of the lead
+ *            arg22: unsigned int lead_max_usec - upper bound of the lead
+ *            arg23: unsigned int sink_flags - 1 for direct writes (aio sink)
+ *            arg24: str source - file played back into the data ring, or ""
+ *            arg25: unsigned int source_flags - 1 to loop the source
+ *            arg26: int node - NUMA node of the rings and the output, -1 
+ *                   for any, -2 for the node of the irq
+ *     
+ * Side Effects:
+ *     On success, selected fields are set, the device may be started.
+ *     
+ * Error Condition: 
+ *     The call will fail if the device is running, any selected field is 
+ *     invalid, or starting fails.
+ *     
+ * Return: 
+ *     return 0 upon success, NULL otherwise.
+ */
+static PyObject * configure_batch(PyObject * self, PyObject * args) {
+
+    int fd;                             /* file descriptor */
+    int keep_missed;                    /* keep missed data or not */
+    const char * path;                  /* destination path */
+    const char * source;                /* playback source */
+    unsigned long long wrt_sz;          /* write size */
+    struct gih_config cfg;              /* the whole configuration */
+    errno = 0;                          /* error code */
+
+    memset(&cfg, 0, sizeof(cfg));
+
+    /* parse the input arguments */
+    if (!PyArg_ParseTuple(args, "iIIiIKisiiiIIIIIIIIIIIIsIi:configure", &fd,
+            &cfg.mask, &cfg.flags, &cfg.irq, &cfg.delay_msec, &wrt_sz, 
+            &keep_missed, &path, &cfg.engine, &cfg.rt_prio, &cfg.cpu, 
+            &cfg.sync, &cfg.sync_arg, &cfg.sink, &cfg.log_clock, &cfg.mode,
+            &cfg.frame_limit, &cfg.stage, &cfg.lead_mode, &cfg.lead_usec,
+            &cfg.lead_min_usec, &cfg.lead_max_usec, &cfg.sink_flags, 
+            &source, &cfg.source_flags, &cfg.node))
+        return NULL;
+
+    if (strlen(path) > PATH_MAX_LEN - 1 || strlen(source) > PATH_MAX_LEN - 1) 
+        return PyErr_Format(PyExc_ValueError, 
+            "path longer than %d characters", PATH_MAX_LEN - 1);
+
+    cfg.version     = GIH_CONFIG_VERSION;
+    cfg.write_size  = wrt_sz;
+    cfg.keep_missed = keep_missed;
+    strcpy(cfg.path, path);
+    strcpy(cfg.source, source);
+
+    /* call the ioctl to configure everything */
+    if (ioctl(fd, GIH_IOC_CONFIG, &cfg) < 0) {
+        return PyErr_Format(PyExc_Exception, 
+            "ioctl(gih): configuration failed, error code %s", 
+            strerror(errno));
+    }
+
+    return Py_BuildValue("i", 0);
+}
+
+/*
+ * Function name: configure_ring_sz
+ * 
+ * Function prototype:
+ *     static PyObject * configure_ring_sz(PyObject * self, PyObject * args)
+ *     
+ * Description: 
+ *     Reallocates the data ring of the device with the given size in bytes,
+ *     rounded up to a power of 2 by the device. Data in the ring is dropped.
+ *     
+ * Arguments:
+ *     @self: the calling object
+ *     @args: argument that wraps two value
+ *            arg1: int fd - file descriptor
+ *            arg2: unsigned long size - size of the data ring in bytes
+ *     
+ * Side Effects:
+ *     On success, the device has a new data ring.
+ *     
+ * Error Condition: 
+ *     The call will fail if the device is running or the ring is mapped, if
+ *     the size is out of range or the ring can't be allocated.
+ *     
+ * Return: 
+ *     return the actual ring size upon success, NULL otherwise.
+ */
+static PyObject * configure_ring_sz(PyObject * self, PyObject * args) {
+
+    int fd;                 /* file descriptor */
+    unsigned long size;     /* requested ring size */
+    int actual;             /* ring size after rounding */
+    errno = 0;              /* error code */
+
+    /* parse the input argument */
+    if (!PyArg_ParseTuple(args, "ik:ring_size", &fd, &size))  return NULL;
+
+    /* call the ioctl to resize the ring */
+    if ((actual = ioctl(fd, GIH_IOC_CONFIG_RING_SZ, size)) < 0) {
+        return PyErr_Format(PyExc_Exception, 
+            "ioctl(gih): ring size configuration failed, error code %s", 
+            strerror(errno));
+    }
+
+    return Py_BuildValue("i", actual);
+}
+
+/*
+ * Function name: configure_log_sz
+ * 
+ * Function prototype:
+ *     static PyObject * configure_log_sz(PyObject * self, PyObject * args)
+ *     
+ * Description: 
+ *     Reallocates the log rings of the device to hold the given number of 
+ *     logs, rounded up to a power of 2 by the device. Unread logs are 
+ *     dropped.
+ *     
+ * Arguments:
+ *     @self: the calling object
+ *     @args: argument that wraps two value
+ *            arg1: int fd - file descriptor of the gih device
+ *            arg2: unsigned int size - number of logs per log ring
+ *     
+ * Side Effects:
+ *     On success, the log devices have new log rings.
+ *     
+ * Error Condition: 
+ *     The call will fail if the device is running, a log device is opened,
+ *     the size is out of range or the rings can't be allocated.
+ *     
+ * Return: 
+ *     return the actual log ring size upon success, NULL otherwise.
+ */
+static PyObject * configure_log_sz(PyObject * self, PyObject * args) {
+
+    int fd;                 /* file descriptor */
+    unsigned int size;      /* requested log ring size */
+    int actual;             /* log ring size after rounding */
+    errno = 0;              /* error code */
+
+    /* parse the input argument */
+    if (!PyArg_ParseTuple(args, "iI:log_size", &fd, &size))  return NULL;
+
+    /* call the ioctl to resize the log rings */
+    if ((actual = ioctl(fd, GIH_IOC_CONFIG_LOG_SZ, size)) < 0) {
+        return PyErr_Format(PyExc_Exception, 
+            "ioctl(gih): log size configuration failed, error code %s", 
+            strerror(errno));
+    }
+
+    return Py_BuildValue("i", actual);
+}
+
+/*
+ * Function name: configure_low_wat
+ * 
+ * Function prototype:
+ *     static PyObject * configure_low_wat(PyObject * self, PyObject * args)
+ *     
+ * Description: 
+ *     Sets the low water mark of the device: it polls writable once the data
+ *     ring has at least this many bytes free. Can be set while running.
+ *     
+ * Arguments:
+ *     @self: the calling object
+ *     @args: argument that wraps two value
+ *            arg1: int fd - file descriptor
+ *            arg2: unsigned int low_wat - free bytes to poll writable
+ *     
+ * Side Effects:
+ *     On success, set the low water mark of the device.
+ *     
+ * Error Condition: 
+ *     The call will fail if the mark is 0.
+ *     
+ * Return: 
+ *     return the set value upon success, NULL otherwise.
+ */
+static PyObject * configure_low_wat(PyObject * self, PyObject * args) {
+
+    int fd;                 /* file descriptor */
+    unsigned int low_wat;   /* low water mark */
+    errno = 0;              /* error code */
+
+    /* parse the input argument */
+    if (!PyArg_ParseTuple(args, "iI:low_water", &fd, &low_wat))  return NULL;
+
+    /* call the ioctl to set the mark */
+    if (ioctl(fd, GIH_IOC_CONFIG_LOW_WAT, low_wat) < 0) {
+        return PyErr_Format(PyExc_Exception, 
+            "ioctl(gih): low water configuration failed, error code %s", 
+            strerror(errno));
+    }
+
+    return Py_BuildValue("I", low_wat);
+}
+
+/*
+ * Function name: configure_log_format 
+ * 
+ * Function prototype:
+ *     static PyObject * configure_log_format(PyObject * self, PyObject * args)
+ *     
+ * Description: 
+ *     Sets the output format of an opened log device file, being 0 for text
+ *     lines or 1 for binary records. The format only applies to the file 
+ *     descriptor passed in.
+ *     
+ * Arguments:
+ *     @self: the calling object
+ *     @args: argument that wraps two value
+ *            arg1: int fd - file descriptor of the log device
+ *            arg2: int format - 0 for text, 1 for binary
+ *     
+ * Side Effects:
+ *     On success, set the output format of the log device file.
+ *     
+ * Error Condition: 
+ *     The call will fail if the format is unknown.
+ *     
+ * Return: 
+ *     return the version of the binary log record upon success, 
+ *     NULL otherwise.
+ */
+static PyObject * configure_log_format(PyObject * self, PyObject * args) {
+
+    int fd;                 /* file descriptor */
+    int format;             /* log output format */
+    int version;            /* binary log record version */
+    errno = 0;              /* error code */
+
+    /* parse the input argument */
+    if (!PyArg_ParseTuple(args, "ii:log_format", &fd, &format))  return NULL;
+
+    /* call the ioctl to set the format */
+    if ((version = ioctl(fd, GIH_LOG_IOC_FORMAT, format)) < 0) {
+        return PyErr_Format(PyExc_Exception, 
+            "ioctl(gihlog): log format configuration failed, error code %s", 
+            strerror(errno));
+    }
+
+    return Py_BuildValue("i", version);
+}
+
+/*
+ * Function name: configure_log_batch
+ * 
+ * Function prototype:
+ *     static PyObject * configure_log_batch(PyObject * self, PyObject * args)
+ *     
+ * Description: 
+ *     Sets the batch of an opened log device file: it polls readable once it
+ *     has at least this many logs to read. 1 when the file is opened.
+ *     
+ * Arguments:
+ *     @self: the calling object
+ *     @args: argument that wraps two value
+ *            arg1: int fd - file descriptor of the log device
+ *            arg2: unsigned int batch - number of logs to poll readable
+ *     
+ * Side Effects:
+ *     On success, set the batch of the log device.
+ *     
+ * Error Condition: 
+ *     The call will fail if the batch is 0 or larger than the log ring.
+ *     
+ * Return: 
+ *     return the set value upon success, NULL otherwise.
+ */
+static PyObject * configure_log_batch(PyObject * self, PyObject * args) {
+
+    int fd;                 /* file descriptor */
+    unsigned int batch;     /* poll threshold */
+    errno = 0;              /* error code */
+
+    /* parse the input argument */
+    if (!PyArg_ParseTuple(args, "iI:log_batch", &fd, &batch))  return NULL;
+
+    /* call the ioctl to set the batch */
+    if (ioctl(fd, GIH_LOG_IOC_BATCH, batch) < 0) {
+        return PyErr_Format(PyExc_Exception, 
+            "ioctl(gihlog): log batch configuration failed, error code %s", 
+            strerror(errno));
+    }
+
+    return Py_BuildValue("I", batch);
+}
+
+/*
+ * Function name: configure_log_drops
+ * 
+ * Function prototype:
+ *     static PyObject * configure_log_drops(PyObject * self, PyObject * args)
+ *     
+ * Description: 
+ *     Number of logs an opened log device file lost: the writer doesn't wait
+ *     for the readers, a reader that falls a whole log ring behind is lapped
+ *     and skips to the oldest log still held.
+ *     
+ * Arguments:
+ *     @self: the calling object
+ *     @args: argument that wraps one value
+ *            arg1: int fd - file descriptor of the log device
+ *     
+ * Side Effects:
+ *     None.
+ *     
+ * Error Condition: 
+ *     The call will fail if fd isn't a log device.
+ *     
+ * Return: 
+ *     return the number of logs lost upon success, NULL otherwise.
+ */
+static PyObject * configure_log_drops(PyObject * self, PyObject * args) {
+
+    int fd;                 /* file descriptor */
+    long dropped;           /* logs lost */
+    errno = 0;              /* error code */
+
+    /* parse the input argument */
+    if (!PyArg_ParseTuple(args, "i:log_drops", &fd))  return NULL;
+
+    /* call the ioctl to get the drops */
+    if ((dropped = ioctl(fd, GIH_LOG_IOC_DROPS)) < 0) {
+        return PyErr_Format(PyExc_Exception, 
+            "ioctl(gihlog): log drops query failed, error code %s", 
+            strerror(errno));
+    }
+
+    return Py_BuildValue("l", dropped);
+}
+
+/*
+ * Function name: configure_log_tail
+ * 
+ * Function prototype:
+ *     static PyObject * configure_log_tail(PyObject * self, PyObject * args)
+ *     
+ * Description: 
+ *     Moves an opened log device file past all the logs held, so that it 
+ *     only reads the logs to come. A file opens at the oldest log held.
+ *     
+ * Arguments:
+ *     @self: the calling object
+ *     @args: argument that wraps one value
+ *            arg1: int fd - file descriptor of the log device
+ *     
+ * Side Effects:
+ *     On success, the logs held are skipped for this file.
+ *     
+ * Error Condition: 
+ *     The call will fail if fd isn't a log device.
+ *     
+ * Return: 
+ *     return 0 upon success, NULL otherwise.
+ */
+static PyObject * configure_log_tail(PyObject * self, PyObject * args) {
+
+    int fd;                 /* file descriptor */
+    errno = 0;              /* error code */
+
+    /* parse the input argument */
+    if (!PyArg_ParseTuple(args, "i:log_tail", &fd))  return NULL;
+
+    /* call the ioctl to skip the logs */
+    if (ioctl(fd, GIH_LOG_IOC_TAIL) < 0) {
+        return PyErr_Format(PyExc_Exception, 
+            "ioctl(gihlog): log tail configuration failed, error code %s", 
+            strerror(errno));
+    }
+
+    return Py_BuildValue("i", 0);
+}
+
+
+/*
+ * Function name: configure_trigger 
+ * 
+ * Function prototype:
+ *     static PyObject * configure_trigger(PyObject * self, PyObject * args)
+ *     
+ * Description: 
+ *     Fires software interrupts into a device running without an irq line:
+ *     burst interrupts right away if the period is 0, otherwise burst 
+ *     interrupts every period, count times (0 for no limit). A period and a
+ *     burst of 0 stop the periodic trigger.
+ *     
+ * Arguments:
+ *     @self: the calling object
+ *     @args: argument that wraps four value
+ *            arg1: int fd - file descriptor
+ *            arg2: unsigned long long period_ns - period in ns, or 0
+ *            arg3: unsigned int burst - interrupts fired each time
+ *            arg4: unsigned int count - periods to fire
+ *     
+ * Side Effects:
+ *     On success, interrupts are fired or the trigger timer (re-)started.
+ *     
+ * Error Condition: 
+ *     The call will fail if the device is not running, has an irq line, or 
+ *     the period or burst are out of range.
+ *     
+ * Return: 
+ *     return 0 upon success, NULL otherwise.
+ */
+static PyObject * configure_trigger(PyObject * self, PyObject * args) {
+
+    int fd;                     /* file descriptor */
+    struct gih_trigger trig;    /* the trigger */
+    errno = 0;                  /* error code */
+
+    /* parse the input argument */
+    if (!PyArg_ParseTuple(args, "iKII:trigger", &fd, &trig.period_ns, 
+            &trig.burst, &trig.count))  
+        return NULL;
+
+    /* call the ioctl to fire */
+    if (ioctl(fd, GIH_IOC_TRIGGER, &trig) < 0) {
+        return PyErr_Format(PyExc_Exception, 
+            "ioctl(gih): trigger failed, error code %s", strerror(errno));
+    }
+
+    return Py_BuildValue("i", 0);
+}
+
+/*
+ * Function name: write_all
+ * 
+ * Function prototype:
+ *     static ssize_t write_all(int fd, struct iovec * iov, int iovcnt, 
+ *                              int block);
+ *     
+ * Description: 
+ *     writev() @iov to @fd, the gih device. The device is non-blocking and 
+ *     takes what fits in its data ring; if @block is set, the rest is 
+ *     written as the ring frees up, waiting for it with poll(). Called 
+ *     without the GIL.
+ *     
+ * Arguments:
+ *     @fd: file descriptor of the gih device
+ *     @iov: buffers to write, advanced past what is written
+ *     @iovcnt: number of buffers in @iov
+ *     @block: wait until everything is written
+ *     
+ * Side Effects:
+ *     Data is written to the device, @iov is modified.
+ *     
+ * Error Condition: 
+ *     A failed writev() or poll(), or one interrupted by a signal, stops the
+ *     write; errno is kept.
+ *     
+ * Return: 
+ *     number of bytes written, -1 if nothing was and the write failed.
+ */
+static ssize_t write_all(int fd, struct iovec * iov, int iovcnt, int block) {
+
+    struct pollfd pfd = { .fd = fd, .events = POLLOUT };
+    ssize_t done = 0;
+    ssize_t n;
+
+    /* zero length buffers have nothing to wait for */
+    while (iovcnt > 0 && iov->iov_len == 0) {iov++; iovcnt--;}
+
+    while (iovcnt > 0) {
+
+        n = writev(fd, iov, iovcnt);
+
+        if (n < 0 && errno != EAGAIN)
+            return done ? done : -1;
+
+        if (n > 0) {
+            done += n;
+
+            /* skip what's written, the ring took the buffers in order */
+            while (iovcnt > 0 && (size_t)n >= iov->iov_len) {
+                n -= iov->iov_len;
+                iov++; 
+                iovcnt--;
+            }
+            if (iovcnt > 0) {
+                iov->iov_base = (char *)iov->iov_base + n;
+                iov->iov_len -= n;
+            }
+            continue;
+        }
+
+        /* the ring is full */
+        if (!block || poll(&pfd, 1, -1) < 0)
+            return done ? done : (block ? -1 : 0);
+    }
+
+    return done;
+}
+
+/*
+ * Function name: data_write
+ * 
+ * Function prototype:
+ *     static PyObject * data_write(PyObject * self, PyObject * args)
+ *     
+ * Description: 
+ *     Writes the data of any object supporting the buffer protocol (bytes, 
+ *     bytearray, memoryview, mmap, array, contiguous numpy arrays...) to the
+ *     gih device, in place without a copy, and with the GIL released for the
+ *     syscall so other threads keep running meanwhile.
+ *     
+ * Arguments:
+ *     @self: the calling object
+ *     @args: argument that wraps three value
+ *            arg1: int fd - file descriptor of the gih device
+ *            arg2: object data - C-contiguous buffer object
+ *            arg3: int block - wait until all of data is written (optional,
+ *                  default 0)
+ *     
+ * Side Effects:
+ *     On success, data is put on the data ring of the device.
+ *     
+ * Error Condition: 
+ *     Objects without a contiguous buffer raise TypeError or BufferError, a
+ *     failed write raises OSError.
+ *     
+ * Return: 
+ *     return the number of bytes written upon success, NULL otherwise. Not 
+ *     blocking, that's what fits in the ring, possibly 0.
+ */
+static PyObject * data_write(PyObject * self, PyObject * args) {
+
+    int fd;                             /* file descriptor */
+    int block = 0;                      /* wait for all of it */
+    PyObject * data;                    /* the buffer object */
+    Py_buffer view;                     /* its buffer */
+    struct iovec iov;
+    ssize_t written;
+
+    /* parse the input arguments */
+    if (!PyArg_ParseTuple(args, "iO|i:write", &fd, &data, &block))
+        return NULL;
+
+    if (PyObject_GetBuffer(data, &view, PyBUF_SIMPLE) < 0)  return NULL;
+
+    iov.iov_base = view.buf;
+    iov.iov_len  = view.len;
+
+    Py_BEGIN_ALLOW_THREADS
+    written = write_all(fd, &iov, 1, block);
+    Py_END_ALLOW_THREADS
+
+    PyBuffer_Release(&view);
+
+    if (written < 0)  return PyErr_SetFromErrno(PyExc_OSError);
+
+    return Py_BuildValue("n", (Py_ssize_t)written);
+}
+
+/*
+ * Function name: data_writev
+ * 
+ * Function prototype:
+ *     static PyObject * data_writev(PyObject * self, PyObject * args)
+ *     
+ * Description: 
+ *     Writes a sequence of buffer objects to the gih device with writev(), 
+ *     WRITEV_BATCH buffers per syscall, as data_write() does a single one. 
+ *     The buffers are described to the kernel in place, nothing is joined 
+ *     or allocated per buffer; the device takes each writev() as one write.
+ *     
+ * Arguments:
+ *     @self: the calling object
+ *     @args: argument that wraps three value
+ *            arg1: int fd - file descriptor of the gih device
+ *            arg2: sequence buffers - C-contiguous buffer objects
+ *            arg3: int block - wait until all of them are written (optional,
+ *                  default 0)
+ *     
+ * Side Effects:
+ *     On success, the data is put on the data ring of the device, in order.
+ *     
+ * Error Condition: 
+ *     A non-sequence, or an object without a contiguous buffer in it, raises
+ *     TypeError or BufferError before that batch is written; a failed write
+ *     raises OSError if nothing was written.
+ *     
+ * Return: 
+ *     return the total number of bytes written upon success, NULL otherwise.
+ *     Not blocking, it stops at the first buffer that doesn't fit.
+ */
+static PyObject * data_writev(PyObject * self, PyObject * args) {
+
+    int fd;                             /* file descriptor */
+    int block = 0;                      /* wait for all of it */
+    PyObject * buffers;                 /* the buffer objects */
+    PyObject * seq;                     /* as a list or tuple */
+    Py_buffer views[WRITEV_BATCH];      /* buffers of a batch */
+    struct iovec iov[WRITEV_BATCH];
+    Py_ssize_t count, i, n, m;
+    ssize_t total = 0;
+    ssize_t written;
+    ssize_t wanted;
+
+    /* parse the input arguments */
+    if (!PyArg_ParseTuple(args, "iO|i:writev", &fd, &buffers, &block))
+        return NULL;
+
+    seq = PySequence_Fast(buffers, "writev() takes a sequence of buffers");
+    if (!seq)  return NULL;
+
+    count = PySequence_Fast_GET_SIZE(seq);
+
+    for (i = 0; i < count; i += n) {
+
+        wanted = 0;
+        for (n = 0; n < WRITEV_BATCH && i + n < count; n++) {
+            if (PyObject_GetBuffer(PySequence_Fast_GET_ITEM(seq, i + n), 
+                    &views[n], PyBUF_SIMPLE) < 0) {
+                while (n--)  PyBuffer_Release(&views[n]);
+                Py_DECREF(seq);
+                return NULL;
+            }
+            iov[n].iov_base = views[n].buf;
+            iov[n].iov_len  = views[n].len;
+            wanted += views[n].len;
+        }
+
+        Py_BEGIN_ALLOW_THREADS
+        written = write_all(fd, iov, (int)n, block);
+        Py_END_ALLOW_THREADS
+
+        for (m = 0; m < n; m++)  PyBuffer_Release(&views[m]);
+
+        if (written < 0) {
+            Py_DECREF(seq);
+            if (total)  return Py_BuildValue("n", (Py_ssize_t)total);
+            return PyErr_SetFromErrno(PyExc_OSError);
+        }
+
+        total += written;
+        if (written < wanted)  break;
+    }
+
+    Py_DECREF(seq);
+    return Py_BuildValue("n", (Py_ssize_t)total);
+}
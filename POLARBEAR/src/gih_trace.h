@@ -0,0 +1,161 @@
+/*
+ * Filename: gih_trace.h
+ * Author: Weiyang Wang
+ * Description: tracepoints of the gih module, for ftrace/perf timelines of
+ *              the interrupts and outputs, e.g.
+ *                  echo 1 > /sys/kernel/debug/tracing/events/gih/enable
+ *                  perf record -e 'gih:*' -a
+ *              They cost a patched out branch while disabled, so they are
+ *              used on the hot paths instead of printk.
+ * Date: Oct 14, 2026
+ */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM gih
+
+#if !defined(_GIH_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _GIH_TRACE_H
+
+#include <linux/tracepoint.h>
+
+/* what overflowed, gih_overflow */
+#define GIH_OVF_EVENT   0           /* event queue, an interrupt dropped */
+#define GIH_OVF_DATA    1           /* data ring, bytes not taken */
+#define GIH_OVF_LOG     2           /* log ring, a reader lapped */
+
+/* interrupt caught, in the interrupt handler */
+TRACE_EVENT(gih_irq_caught,
+
+    TP_PROTO(unsigned int index, unsigned long seq),
+
+    TP_ARGS(index, seq),
+
+    TP_STRUCT__entry(
+        __field(unsigned int,   index)
+        __field(unsigned long,  seq)
+    ),
+
+    TP_fast_assign(
+        __entry->index = index;
+        __entry->seq   = seq;
+    ),
+
+    TP_printk("gih%u seq=%lu", __entry->index, __entry->seq)
+);
+
+/* output of an interrupt starts, @avail bytes are taken of @budget */
+TRACE_EVENT(gih_emit_begin,
+
+    TP_PROTO(unsigned int index, unsigned long seq, size_t avail,
+             size_t budget),
+
+    TP_ARGS(index, seq, avail, budget),
+
+    TP_STRUCT__entry(
+        __field(unsigned int,   index)
+        __field(unsigned long,  seq)
+        __field(size_t,         avail)
+        __field(size_t,         budget)
+    ),
+
+    TP_fast_assign(
+        __entry->index  = index;
+        __entry->seq    = seq;
+        __entry->avail  = avail;
+        __entry->budget = budget;
+    ),
+
+    TP_printk("gih%u seq=%lu avail=%zu budget=%zu", __entry->index,
+        __entry->seq, __entry->avail, __entry->budget)
+);
+
+/* output of an interrupt done, @ret is what the sink returned */
+TRACE_EVENT(gih_emit_end,
+
+    TP_PROTO(unsigned int index, unsigned long seq, int ret,
+             unsigned int left),
+
+    TP_ARGS(index, seq, ret, left),
+
+    TP_STRUCT__entry(
+        __field(unsigned int,   index)
+        __field(unsigned long,  seq)
+        __field(int,            ret)
+        __field(unsigned int,   left)
+    ),
+
+    TP_fast_assign(
+        __entry->index = index;
+        __entry->seq   = seq;
+        __entry->ret   = ret;
+        __entry->left  = left;
+    ),
+
+    TP_printk("gih%u seq=%lu ret=%d left=%u", __entry->index,
+        __entry->seq, __entry->ret, __entry->left)
+);
+
+/* data taken by gih_write_iter() or read from the playback source, @len 
+   bytes, @used in the ring after */
+TRACE_EVENT(gih_write_enqueued,
+
+    TP_PROTO(unsigned int index, size_t len, unsigned int used),
+
+    TP_ARGS(index, len, used),
+
+    TP_STRUCT__entry(
+        __field(unsigned int,   index)
+        __field(size_t,         len)
+        __field(unsigned int,   used)
+    ),
+
+    TP_fast_assign(
+        __entry->index = index;
+        __entry->len   = len;
+        __entry->used  = used;
+    ),
+
+    TP_printk("gih%u len=%zu used=%u", __entry->index, __entry->len,
+        __entry->used)
+);
+
+/*
+ * something was dropped for a full ring, @what is GIH_OVF_*. @dev is the gih
+ * instance, or the minor number of the log device for GIH_OVF_LOG; @amount
+ * is the interrupt sequence number, bytes, or logs the reader lost.
+ */
+TRACE_EVENT(gih_overflow,
+
+    TP_PROTO(unsigned int dev, int what, u64 amount),
+
+    TP_ARGS(dev, what, amount),
+
+    TP_STRUCT__entry(
+        __field(unsigned int,   dev)
+        __field(int,            what)
+        __field(u64,            amount)
+    ),
+
+    TP_fast_assign(
+        __entry->dev    = dev;
+        __entry->what   = what;
+        __entry->amount = amount;
+    ),
+
+    TP_printk("dev=%u %s amount=%llu", __entry->dev,
+        __print_symbolic(__entry->what,
+            { GIH_OVF_EVENT, "event" },
+            { GIH_OVF_DATA,  "data" },
+            { GIH_OVF_LOG,   "log" }),
+        __entry->amount)
+);
+
+#endif /* _GIH_TRACE_H */
+
+/* out of tree, the header is found from the build directory */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE gih_trace
+
+#include <trace/define_trace.h>
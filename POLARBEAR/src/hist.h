@@ -0,0 +1,260 @@
+/*
+ * Filename: hist.h
+ * Author: Weiyang Wang
+ * Description: log-linear latency histograms of the gih device. Histograms
+ *              are kept per CPU and only ever updated by the CPU they belong
+ *              to, with preemption disabled, so recording takes no lock and
+ *              no atomic. Readers add up all the CPUs. See HIST_* in gih.h.
+ * Date: Oct 14, 2026
+ */
+
+#ifndef _HIST_H
+#define _HIST_H
+
+/*
+ * Function name: hist_mag_index
+ *
+ * Function prototype:
+ *     static inline unsigned int hist_mag_index(u64 v);
+ *
+ * Description:
+ *     Bucket of magnitude @v: values below HIST_SUB have a bucket each,
+ *     above that every power of 2 is split into HIST_SUB linear buckets.
+ *
+ * Arguments:
+ *     @v: magnitude, capped at 2^HIST_MAX_BITS - 1
+ *
+ * Side Effects:
+ *     None.
+ *
+ * Error Condition:
+ *     None.
+ *
+ * Return:
+ *     Bucket in [0, HIST_MAG).
+ */
+static inline unsigned int hist_mag_index(u64 v) {
+    unsigned int msb;
+
+    if (v >= (1ULL << HIST_MAX_BITS))
+        v = (1ULL << HIST_MAX_BITS) - 1;
+
+    if (v < HIST_SUB)
+        return v;
+
+    msb = fls64(v) - 1;
+    return (msb - HIST_SUB_BITS + 1) * HIST_SUB +
+        ((v >> (msb - HIST_SUB_BITS)) & (HIST_SUB - 1));
+}
+
+/*
+ * Function name: hist_mag_lower
+ *
+ * Function prototype:
+ *     static inline u64 hist_mag_lower(unsigned int i);
+ *
+ * Description:
+ *     Smallest magnitude of bucket @i, the inverse of hist_mag_index().
+ *
+ * Arguments:
+ *     @i: bucket, in [0, HIST_MAG]; HIST_MAG gives the cap
+ *
+ * Side Effects:
+ *     None.
+ *
+ * Error Condition:
+ *     None.
+ *
+ * Return:
+ *     The smallest magnitude that falls into bucket @i.
+ */
+static inline u64 hist_mag_lower(unsigned int i) {
+    unsigned int group = i / HIST_SUB;
+
+    if (group == 0)
+        return i;
+
+    return (u64)(HIST_SUB + i % HIST_SUB) << (group - 1);
+}
+
+/*
+ * Function name: hist_index
+ *
+ * Function prototype:
+ *     static inline unsigned int hist_index(s64 v);
+ *
+ * Description:
+ *     Bucket of the signed value @v. Non-negative values are in the upper
+ *     half of the buckets, negative ones mirrored in the lower half, so the
+ *     buckets are in the order of the values.
+ *
+ * Arguments:
+ *     @v: the value
+ *
+ * Side Effects:
+ *     None.
+ *
+ * Error Condition:
+ *     None.
+ *
+ * Return:
+ *     Bucket in [0, HIST_BUCKETS).
+ */
+static inline unsigned int hist_index(s64 v) {
+    if (v >= 0)
+        return HIST_MAG + hist_mag_index(v);
+
+    return HIST_MAG - 1 - hist_mag_index(-(u64)v);
+}
+
+/*
+ * Function name: hist_lower / hist_upper
+ *
+ * Function prototype:
+ *     static inline s64 hist_lower(unsigned int b);
+ *     static inline s64 hist_upper(unsigned int b);
+ *
+ * Description:
+ *     Smallest and largest value of the signed bucket @b.
+ *
+ * Arguments:
+ *     @b: bucket, by hist_index()
+ *
+ * Side Effects:
+ *     None.
+ *
+ * Error Condition:
+ *     None.
+ *
+ * Return:
+ *     The bound of the values of bucket @b.
+ */
+static inline s64 hist_lower(unsigned int b) {
+    if (b >= HIST_MAG)
+        return hist_mag_lower(b - HIST_MAG);
+
+    return -(s64)(hist_mag_lower(HIST_MAG - b) - 1);
+}
+
+static inline s64 hist_upper(unsigned int b) {
+    if (b >= HIST_MAG)
+        return hist_mag_lower(b - HIST_MAG + 1) - 1;
+
+    return -(s64)hist_mag_lower(HIST_MAG - 1 - b);
+}
+
+/*
+ * Function name: hist_record
+ *
+ * Function prototype:
+ *     static inline void hist_record(struct gih_hists __percpu * hists,
+ *                                    int stage, s64 v);
+ *
+ * Description:
+ *     Records @v into histogram @stage of the current CPU.
+ *
+ * Arguments:
+ *     @hists: the per CPU histograms
+ *     @stage: HIST_*
+ *     @v: the value, in ns
+ *
+ * Side Effects:
+ *     The histogram of this CPU is updated.
+ *
+ * Error Condition:
+ *     Must not be called from interrupt context, the update is only
+ *     protected against preemption.
+ *
+ * Return:
+ *     None.
+ */
+static inline void hist_record(struct gih_hists __percpu * hists,
+                               int stage, s64 v) {
+    struct gih_hist * h = &get_cpu_ptr(hists)->stage[stage];
+
+    if (!h->count || v < h->min) h->min = v;
+    if (!h->count || v > h->max) h->max = v;
+    h->count++;
+    h->sum += v;
+    h->bucket[hist_index(v)]++;
+
+    put_cpu_ptr(hists);
+}
+
+/*
+ * Function name: hist_reset
+ *
+ * Function prototype:
+ *     static void hist_reset(struct gih_hists __percpu * hists, int stage);
+ *
+ * Description:
+ *     Empties histogram @stage on all the CPUs.
+ *
+ * Arguments:
+ *     @hists: the per CPU histograms
+ *     @stage: HIST_*
+ *
+ * Side Effects:
+ *     All values recorded so far are dropped.
+ *
+ * Error Condition:
+ *     A value recorded at the same time may be lost, or counted in the
+ *     buckets but not the summary.
+ *
+ * Return:
+ *     None.
+ */
+static void hist_reset(struct gih_hists __percpu * hists, int stage) {
+    int cpu;
+
+    for_each_possible_cpu(cpu)
+        memset(&per_cpu_ptr(hists, cpu)->stage[stage], 0,
+            sizeof(struct gih_hist));
+}
+
+/*
+ * Function name: hist_percentile
+ *
+ * Function prototype:
+ *     static s64 hist_percentile(const u64 * bucket, u64 count,
+ *                                unsigned int q, s64 min, s64 max);
+ *
+ * Description:
+ *     Value at quantile @q of the histogram: the upper bound of the bucket
+ *     where @q of the values are reached, so at most 1/HIST_SUB too large.
+ *
+ * Arguments:
+ *     @bucket: counts of all the buckets, added up over the CPUs
+ *     @count: sum of @bucket
+ *     @q: quantile, in 1/10000
+ *     @min: smallest value recorded
+ *     @max: largest value recorded
+ *
+ * Side Effects:
+ *     None.
+ *
+ * Error Condition:
+ *     None.
+ *
+ * Return:
+ *     The value at @q, within [@min, @max]; 0 if @count is 0.
+ */
+static s64 hist_percentile(const u64 * bucket, u64 count, unsigned int q,
+                           s64 min, s64 max) {
+    u64 target = div64_u64(count * q + 9999, 10000);
+    u64 seen = 0;
+    unsigned int b;
+
+    if (count == 0)
+        return 0;
+
+    for (b = 0; b < HIST_BUCKETS; b++) {
+        seen += bucket[b];
+        if (seen >= target)
+            return clamp(hist_upper(b), min, max);
+    }
+
+    return max;
+}
+
+#endif
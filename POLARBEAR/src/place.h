@@ -0,0 +1,120 @@
+/*
+ * Filename: place.h
+ * Author: Weiyang Wang
+ * Description: NUMA placement of the gih device, see GIH_CFG_NODE in gih.h.
+ *              The memory the interrupt handler, the output and the feeder
+ *              all touch is allocated on one node, the one the irq is
+ *              delivered to unless configured, and the output is kept on
+ *              the CPUs of that node, so that an event doesn't cross the
+ *              sockets.
+ * Date: Oct 14, 2026
+ */
+
+#ifndef _PLACE_H
+#define _PLACE_H
+
+/*
+ * Function name: place_cpu
+ *
+ * Function prototype:
+ *     static int place_cpu(int node);
+ *
+ * Description:
+ *     The first online CPU of @node.
+ *
+ * Arguments:
+ *     @node: the node, or NUMA_NO_NODE
+ *
+ * Side Effects:
+ *     None.
+ *
+ * Error Condition:
+ *     NUMA_NO_NODE, or a node without an online CPU, returns nr_cpu_ids.
+ *
+ * Return:
+ *     The CPU, nr_cpu_ids for none.
+ */
+static int place_cpu(int node) {
+    if (node == NUMA_NO_NODE)
+        return nr_cpu_ids;
+
+    return cpumask_first_and(cpumask_of_node(node), cpu_online_mask);
+}
+
+/*
+ * Function name: place_irq_node
+ *
+ * Function prototype:
+ *     static int place_irq_node(int irq);
+ *
+ * Description:
+ *     The node @irq is delivered to: the node of the first online CPU of
+ *     its affinity, /proc/irq/@irq/smp_affinity, as it is now.
+ *
+ * Arguments:
+ *     @irq: the irq line, or GIH_IRQ_NONE
+ *
+ * Side Effects:
+ *     None.
+ *
+ * Error Condition:
+ *     GIH_IRQ_NONE, an irq without a descriptor or an affinity without an
+ *     online CPU returns NUMA_NO_NODE.
+ *
+ * Return:
+ *     The node, NUMA_NO_NODE for none.
+ */
+static int place_irq_node(int irq) {
+    struct irq_data * irq_data;
+    int cpu;
+
+    irq_data = irq != GIH_IRQ_NONE ? irq_get_irq_data(irq) : NULL;
+    if (!irq_data)
+        return NUMA_NO_NODE;
+
+    cpu = cpumask_first_and(irq_data_get_affinity_mask(irq_data),
+                            cpu_online_mask);
+
+    return cpu < nr_cpu_ids ? cpu_to_node(cpu) : NUMA_NO_NODE;
+}
+
+/* work_on_cpu() function of place_vmalloc_user() */
+static long place_vmalloc_user_fn(void * size) {
+    return (long)vmalloc_user(*(size_t *)size);
+}
+
+/*
+ * Function name: place_vmalloc_user
+ *
+ * Function prototype:
+ *     static void * place_vmalloc_user(size_t size, int node);
+ *
+ * Description:
+ *     vmalloc_user() with the pages on @node. vmalloc_user() has no node
+ *     variant, and the memory has to stay mappable to user space, so it's
+ *     called from a CPU of @node, where the pages are allocated locally.
+ *
+ * Arguments:
+ *     @size: bytes to allocate
+ *     @node: the node, or NUMA_NO_NODE for anywhere
+ *
+ * Side Effects:
+ *     May sleep, waiting for a worker of the CPU.
+ *
+ * Error Condition:
+ *     Failed allocation returns NULL. A node without an online CPU gets the
+ *     memory anywhere.
+ *
+ * Return:
+ *     The memory, zeroed, or NULL.
+ */
+static void * place_vmalloc_user(size_t size, int node) {
+    int cpu = place_cpu(node);
+
+    if (cpu >= nr_cpu_ids)
+        return vmalloc_user(size);
+
+    return (void *)work_on_cpu(cpu, place_vmalloc_user_fn, &size);
+}
+
+#endif
@@ -0,0 +1,1173 @@
+/*
+ * Filename: sink.h
+ * Author: Weiyang Wang
+ * Description: output sinks of the gih device, where the output sends the
+ *              data of the data ring to. Every sink takes the data straight
+ *              out of the ring, as at most two contiguous segments, so the
+ *              cost of an output doesn't depend on a filesystem unless the
+ *              file sink is used; the aio sink copies it into a write of 
+ *              its own and doesn't wait for it. See GIH_SINK_* in gih.h.
+ * Date: Oct 14, 2026
+ */
+
+#ifndef _SINK_H
+#define _SINK_H
+
+/*
+ * Function name: sink_kvec
+ *
+ * Function prototype:
+ *     static unsigned int sink_kvec(struct kfifo * kfifo_buf, size_t size,
+ *                                   struct kvec * vec);
+ *
+ * Description:
+ *     Describes the first @size bytes of @kfifo_buf as at most two kvecs,
+ *     the second one only if the data wraps around the end of the buffer.
+ *
+ * Arguments:
+ *     @kfifo_buf: kfifo holding the data, element size must be 1 byte
+ *     @size: amount of data, no more than what's in @kfifo_buf
+ *     @vec: array of at least 2 kvecs to fill
+ *
+ * Side Effects:
+ *     None, @kfifo_buf is not advanced.
+ *
+ * Error Condition:
+ *     None.
+ *
+ * Return:
+ *     Number of kvecs filled.
+ */
+static inline unsigned int sink_kvec(struct kfifo * kfifo_buf, size_t size,
+                                     struct kvec * vec) {
+    struct __kfifo * fifo = &kfifo_buf->kfifo;
+    unsigned int off = fifo->out & fifo->mask;
+    size_t first = min_t(size_t, size, fifo->mask + 1 - off);
+
+    if (size == 0)
+        return 0;
+
+    vec[0].iov_base = (unsigned char *)fifo->data + off;
+    vec[0].iov_len  = first;
+
+    if (size == first)
+        return 1;
+
+    vec[1].iov_base = fifo->data;
+    vec[1].iov_len  = size - first;
+    return 2;
+}
+
+/*
+ * Function name: sink_kvec_slice
+ *
+ * Function prototype:
+ *     static unsigned int sink_kvec_slice(const struct kvec * vec,
+ *                                         unsigned int nvec, size_t off,
+ *                                         size_t len, struct kvec * out);
+ *
+ * Description:
+ *     Describes @len bytes starting at @off of the data in @vec as kvecs
+ *     in @out, without copying any data.
+ *
+ * Arguments:
+ *     @vec: the data
+ *     @nvec: number of kvecs in @vec
+ *     @off: offset of the slice in the data
+ *     @len: length of the slice
+ *     @out: array of at least @nvec kvecs to fill
+ *
+ * Side Effects:
+ *     None.
+ *
+ * Error Condition:
+ *     A slice past the end of the data is cut short.
+ *
+ * Return:
+ *     Number of kvecs filled.
+ */
+static inline unsigned int sink_kvec_slice(const struct kvec * vec,
+                                           unsigned int nvec, size_t off,
+                                           size_t len, struct kvec * out) {
+    unsigned int i;
+    unsigned int n = 0;
+    size_t take;
+
+    for (i = 0; i < nvec && len; i++) {
+        if (off >= vec[i].iov_len) {
+            off -= vec[i].iov_len;
+            continue;
+        }
+
+        take = min(len, vec[i].iov_len - off);
+        out[n].iov_base = (unsigned char *)vec[i].iov_base + off;
+        out[n].iov_len  = take;
+        n++;
+
+        len -= take;
+        off = 0;
+    }
+
+    return n;
+}
+
+/*
+ * Function name: sink_udp_open
+ *
+ * Function prototype:
+ *     static int sink_udp_open(gih_sink * sink, const char * addr);
+ *
+ * Description:
+ *     Creates the kernel udp socket of @sink and connects it to @addr, so
+ *     that an output is a plain sendmsg with no lookup of the destination.
+ *
+ * Arguments:
+ *     @sink: the sink
+ *     @addr: destination, "a.b.c.d:port"
+ *
+ * Side Effects:
+ *     On success, the sock field of @sink is set.
+ *
+ * Error Condition:
+ *     A malformed @addr returns -EINVAL, errors creating or connecting the
+ *     socket are returned.
+ *
+ * Return:
+ *     0 on success, -ERRORCODE on failure.
+ */
+static int sink_udp_open(gih_sink * sink, const char * addr) {
+    struct sockaddr_in sin;
+    const char * port = strrchr(addr, ':');
+    const char * end;
+    u16 portnum;
+    int ret;
+
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family = AF_INET;
+
+    if (!port || !in4_pton(addr, port - addr, (u8 *)&sin.sin_addr.s_addr,
+            -1, &end) || end != port || kstrtou16(port + 1, 10, &portnum) ||
+            portnum == 0) {
+        printk(KERN_ALERT "[sink] ERROR: %s is not a.b.c.d:port\n", addr);
+        return -EINVAL;
+    }
+    sin.sin_port = htons(portnum);
+
+    ret = sock_create_kern(&init_net, AF_INET, SOCK_DGRAM, IPPROTO_UDP,
+        &sink->sock);
+    if (ret < 0) {
+        printk(KERN_ALERT "[sink] ERROR creating socket: %d\n", ret);
+        sink->sock = NULL;
+        return ret;
+    }
+
+    ret = kernel_connect(sink->sock, (struct sockaddr *)&sin, sizeof(sin), 0);
+    if (ret < 0) {
+        printk(KERN_ALERT "[sink] ERROR connecting to %s: %d\n", addr, ret);
+        sock_release(sink->sock);
+        sink->sock = NULL;
+        return ret;
+    }
+
+    return 0;
+}
+
+/*
+ * Function name: sink_udp_write
+ *
+ * Function prototype:
+ *     static int sink_udp_write(gih_sink * sink, const struct kvec * vec,
+ *                               unsigned int nvec, size_t size);
+ *
+ * Description:
+ *     Sends @size bytes of @vec as datagrams of at most GIH_UDP_DGRAM_SZ
+ *     bytes. Datagrams are built by the udp stack straight from @vec, and
+ *     sending never blocks.
+ *
+ * Arguments:
+ *     @sink: the sink, opened udp
+ *     @vec: the data
+ *     @nvec: number of kvecs in @vec
+ *     @size: amount of data in @vec
+ *
+ * Side Effects:
+ *     Datagrams are sent.
+ *
+ * Error Condition:
+ *     Stops at the first datagram the socket doesn't take, that one and the
+ *     rest are not sent. An error is only returned if nothing was sent.
+ *
+ * Return:
+ *     Number of bytes sent on success, -ERRORCODE otherwise.
+ */
+static int sink_udp_write(gih_sink * sink, const struct kvec * vec,
+                          unsigned int nvec, size_t size) {
+    struct msghdr msg;
+    struct kvec dgram[2];
+    unsigned int n;
+    size_t len;
+    size_t sent = 0;
+    int ret;
+
+    while (sent < size) {
+        len = min_t(size_t, size - sent, GIH_UDP_DGRAM_SZ);
+        n = sink_kvec_slice(vec, nvec, sent, len, dgram);
+
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_flags = MSG_DONTWAIT | MSG_NOSIGNAL;
+
+        ret = kernel_sendmsg(sink->sock, &msg, dgram, n, len);
+        if (ret < 0) {
+            /* a full socket buffer is a short write, not an error */
+            if (sent || ret == -EAGAIN)
+                break;
+            return ret;
+        }
+
+        sent += len;
+    }
+
+    return sent;
+}
+
+/*
+ * Function name: sink_ring_alloc
+ *
+ * Function prototype:
+ *     static int sink_ring_alloc(gih_sink * sink, size_t size);
+ *
+ * Description:
+ *     Makes sure the output ring of the mmap sink is there and empty. An
+ *     existing ring is kept if it's already @size on the node of @sink, or
+ *     still mapped by a reader, otherwise it's (re)allocated with @size 
+ *     bytes on that node.
+ *
+ * Arguments:
+ *     @sink: the sink
+ *     @size: size of the output ring, power of 2
+ *
+ * Side Effects:
+ *     The ring and ring_size fields of @sink are set, the ring is emptied.
+ *
+ * Error Condition:
+ *     Allocation failure returns -ENOMEM, the old ring (if any) is kept.
+ *
+ * Return:
+ *     0 on success, -ERRORCODE on failure.
+ */
+static int sink_ring_alloc(gih_sink * sink, size_t size) {
+    struct gih_ring_ctrl * ring;
+
+    mutex_lock(&sink->ring_lock);
+
+    if (!sink->ring ||
+        ((sink->ring_size != size || sink->ring_node != sink->node) && 
+         !atomic_read(&sink->mapped))) {
+
+        ring = place_vmalloc_user(PAGE_SIZE + size, sink->node);
+        if (!ring) {
+            mutex_unlock(&sink->ring_lock);
+            return -ENOMEM;
+        }
+
+        vfree(sink->ring);
+        sink->ring      = ring;
+        sink->ring_size = size;
+        sink->ring_node = sink->node;
+
+        ring->version  = GIH_RING_VERSION;
+        ring->data_off = PAGE_SIZE;
+        ring->size     = size;
+    }
+
+    sink->head = 0;
+    WRITE_ONCE(sink->ring->tail, 0);
+    smp_store_release(&sink->ring->head, 0);
+
+    mutex_unlock(&sink->ring_lock);
+    return 0;
+}
+
+/*
+ * Function name: sink_ring_copy / sink_ring_publish
+ *
+ * Function prototype:
+ *     static size_t sink_ring_copy(gih_sink * sink, const struct kvec * vec,
+ *                                  unsigned int nvec, size_t size);
+ *     static void sink_ring_publish(gih_sink * sink);
+ *
+ * Description:
+ *     sink_ring_copy() copies @size bytes of @vec into the output ring past
+ *     the private head, as much as there's room for; sink_ring_publish()
+ *     then makes everything copied so far visible to the reader and wakes
+ *     it up. The output is the only producer of the ring and a user reader
+ *     the only consumer, so no lock is taken.
+ *
+ * Arguments:
+ *     @sink: the sink, opened mmap
+ *     @vec: the data
+ *     @nvec: number of kvecs in @vec
+ *     @size: amount of data in @vec
+ *
+ * Side Effects:
+ *     Data is copied to the output ring / head is published.
+ *
+ * Error Condition:
+ *     An inconsistent tail from the reader reads as a full ring.
+ *
+ * Return:
+ *     sink_ring_copy(): number of bytes copied.
+ */
+static size_t sink_ring_copy(gih_sink * sink, const struct kvec * vec,
+                             unsigned int nvec, size_t size) {
+    unsigned char * data = (unsigned char *)sink->ring + PAGE_SIZE;
+    unsigned int mask = sink->ring_size - 1;
+    unsigned int head = sink->head;
+    unsigned int used = head - smp_load_acquire(&sink->ring->tail);
+    unsigned int i;
+    size_t n, len, first;
+
+    if (used > sink->ring_size)
+        return 0;
+
+    size = n = min_t(size_t, size, sink->ring_size - used);
+
+    for (i = 0; i < nvec && n; i++) {
+        len   = min(n, vec[i].iov_len);
+        first = min_t(size_t, len, mask + 1 - (head & mask));
+
+        memcpy(data + (head & mask), vec[i].iov_base, first);
+        memcpy(data, (unsigned char *)vec[i].iov_base + first, len - first);
+
+        head += len;
+        n    -= len;
+    }
+
+    sink->head = head;
+    return size;
+}
+
+static void sink_ring_publish(gih_sink * sink) {
+    /* data is in place before the reader can see it */
+    smp_store_release(&sink->ring->head, sink->head);
+
+    if (wq_has_sleeper(&sink->read_wait))
+        wake_up_interruptible(&sink->read_wait);
+}
+
+/*
+ * Function name: sink_ring_write
+ *
+ * Function prototype:
+ *     static int sink_ring_write(gih_sink * sink, const struct kvec * vec,
+ *                                unsigned int nvec, size_t size);
+ *
+ * Description:
+ *     Copies @size bytes of @vec into the output ring, as much as there's
+ *     room for, then publishes the new head and wakes up the readers.
+ *
+ * Arguments:
+ *     @sink: the sink, opened mmap
+ *     @vec: the data
+ *     @nvec: number of kvecs in @vec
+ *     @size: amount of data in @vec
+ *
+ * Side Effects:
+ *     Data is copied to the output ring.
+ *
+ * Error Condition:
+ *     See sink_ring_copy().
+ *
+ * Return:
+ *     Number of bytes copied.
+ */
+static int sink_ring_write(gih_sink * sink, const struct kvec * vec,
+                           unsigned int nvec, size_t size) {
+    size = sink_ring_copy(sink, vec, nvec, size);
+
+    if (size)
+        sink_ring_publish(sink);
+
+    return size;
+}
+
+/*
+ * Function name: sink_aio_free
+ *
+ * Function prototype:
+ *     static void sink_aio_free(gih_sink * sink);
+ *
+ * Description:
+ *     Frees the write pool of the aio sink, also a partially allocated one.
+ *
+ * Arguments:
+ *     @sink: the sink
+ *
+ * Side Effects:
+ *     The pool is freed.
+ *
+ * Error Condition:
+ *     No write may be in flight.
+ *
+ * Return:
+ *     None.
+ */
+static void sink_aio_free(gih_sink * sink) {
+    unsigned int i;
+
+    if (!sink->aio)
+        return;
+
+    for (i = 0; i < GIH_AIO_DEPTH; i++) {
+        vfree(sink->aio[i].buf);
+        kfree(sink->aio[i].bvec);
+    }
+
+    kfree(sink->aio);
+    sink->aio = NULL;
+}
+
+/*
+ * Function name: sink_aio_open
+ *
+ * Function prototype:
+ *     static int sink_aio_open(gih_sink * sink, const char * path,
+ *                              size_t out_size);
+ *
+ * Description:
+ *     Opens the file of the aio sink at @path, O_DIRECT with 
+ *     GIH_SINK_F_DIRECT, and allocates its pool of GIH_AIO_DEPTH writes of
+ *     @out_size bytes, rounded up to pages, on the node of @sink.
+ *
+ * Arguments:
+ *     @sink: the sink
+ *     @path: path of the file
+ *     @out_size: largest output
+ *
+ * Side Effects:
+ *     On success, the sink can be written to from file offset 0.
+ *
+ * Error Condition:
+ *     Failing to open the file returns -EBADF, a file without write_iter or
+ *     an @out_size below a block of a direct write -EINVAL, and failing to
+ *     allocate -ENOMEM.
+ *
+ * Return:
+ *     0 on success, -ERRORCODE on failure.
+ */
+static int sink_aio_open(gih_sink * sink, const char * path, 
+                         size_t out_size) {
+    struct gih_aio * w;
+    unsigned int pages;
+    unsigned int i, p;
+    int flags = O_WRONLY | O_NONBLOCK;
+
+    if (sink->flags & GIH_SINK_F_DIRECT) {
+        if (out_size < GIH_AIO_ALIGN)
+            return -EINVAL;
+        flags |= O_DIRECT;
+    }
+
+    sink->filp = file_open(path, flags, S_IALLUGO);
+    if (!sink->filp)
+        return -EBADF;
+
+    if (!sink->filp->f_op->write_iter)
+        goto inval;
+
+    sink->aio_size = PAGE_ALIGN(out_size);
+    pages = sink->aio_size >> PAGE_SHIFT;
+
+    sink->aio = kcalloc(GIH_AIO_DEPTH, sizeof(struct gih_aio), GFP_KERNEL);
+    if (!sink->aio)
+        goto nomem;
+
+    for (i = 0; i < GIH_AIO_DEPTH; i++) {
+        w = &sink->aio[i];
+        w->sink = sink;
+        w->buf  = vmalloc_node(sink->aio_size, sink->node);
+        w->bvec = kmalloc_array(pages, sizeof(struct bio_vec), GFP_KERNEL);
+        if (!w->buf || !w->bvec)
+            goto nomem;
+
+        for (p = 0; p < pages; p++) {
+            w->bvec[p].bv_page   = vmalloc_to_page(w->buf + p * PAGE_SIZE);
+            w->bvec[p].bv_len    = PAGE_SIZE;
+            w->bvec[p].bv_offset = 0;
+        }
+    }
+
+    sink->aio_head = 0;
+    sink->aio_tail = 0;
+    sink->aio_pos  = 0;
+    atomic_set(&sink->aio_busy, 0);
+
+    return 0;
+
+inval:
+    file_close(sink->filp);
+    sink->filp = NULL;
+    return -EINVAL;
+
+nomem:
+    sink_aio_free(sink);
+    file_close(sink->filp);
+    sink->filp = NULL;
+    return -ENOMEM;
+}
+
+/*
+ * Function name: sink_aio_stamp
+ *
+ * Function prototype:
+ *     static inline u64 sink_aio_stamp(gih_sink * sink);
+ *
+ * Description:
+ *     Time of now, ns of the log clock, for the stamps of the writes.
+ *
+ * Arguments:
+ *     @sink: the sink
+ *
+ * Side Effects:
+ *     None.
+ *
+ * Error Condition:
+ *     None.
+ *
+ * Return:
+ *     The time.
+ */
+static inline u64 sink_aio_stamp(gih_sink * sink) {
+    return sink->aio_raw ? ktime_get_raw_ns() : ktime_get_ns();
+}
+
+/*
+ * Function name: sink_aio_complete
+ *
+ * Function prototype:
+ *     static void sink_aio_complete(struct kiocb * iocb, long res, 
+ *                                   long res2);
+ *
+ * Description:
+ *     Completion of a write of the aio sink, ki_complete of its kiocb: 
+ *     stamps it, marks it done and queues the reaping of the completions. 
+ *     May run in interrupt context.
+ *
+ * Arguments:
+ *     @iocb: the kiocb of the write
+ *     @res: bytes written or -ERRORCODE
+ *     @res2: Unused.
+ *
+ * Side Effects:
+ *     aio_work is queued; waiters of the sink are woken up once the last 
+ *     write in flight completed.
+ *
+ * Error Condition:
+ *     None.
+ *
+ * Return:
+ *     None.
+ */
+static void sink_aio_complete(struct kiocb * iocb, long res, long res2) {
+    struct gih_aio * w = container_of(iocb, struct gih_aio, iocb);
+    gih_sink * sink = w->sink;
+
+    w->completed = sink_aio_stamp(sink);
+    w->res = res;
+    smp_store_release(&w->done, true);
+
+    /* the write may be reused from here on, only the sink is looked at */
+    queue_work(sink->aio_wq, sink->aio_work);
+
+    if (atomic_dec_and_test(&sink->aio_busy))
+        wake_up(&sink->aio_wait);
+}
+
+/*
+ * Function name: sink_aio_write
+ *
+ * Function prototype:
+ *     static int sink_aio_write(gih_sink * sink, struct kfifo * kfifo_buf,
+ *                               size_t size, u64 irq_stamp, 
+ *                               unsigned long seq);
+ *
+ * Description:
+ *     Takes up to @size bytes from @kfifo_buf into a free write of the aio 
+ *     sink and submits it at the file offset of the sink. The call doesn't
+ *     wait for the write unless the filesystem completes it right away; 
+ *     either way it's completed by sink_aio_complete(). A write takes at 
+ *     most aio_size bytes, and whole GIH_AIO_ALIGN blocks if direct.
+ *
+ * Arguments:
+ *     @sink: the sink, opened
+ *     @kfifo_buf: kfifo holding the data, element size must be 1 byte
+ *     @size: amount of data to send
+ *     @irq_stamp: time of the interrupt of the output, for the aio log
+ *     @seq: sequence number of that interrupt
+ *
+ * Side Effects:
+ *     The data taken is removed from @kfifo_buf, and the file offset of 
+ *     the sink advanced by it.
+ *
+ * Error Condition:
+ *     Same rules as sink_write_kfifo(). With all the writes in flight, 
+ *     -EAGAIN is returned and nothing taken. An error of the submission is
+ *     only seen by the completion.
+ *
+ * Return:
+ *     Number of bytes taken, -ERRORCODE otherwise.
+ */
+static int sink_aio_write(gih_sink * sink, struct kfifo * kfifo_buf,
+                          size_t size, u64 irq_stamp, unsigned long seq) {
+    struct file * filp = sink->filp;
+    struct gih_aio * w;
+    struct iov_iter iter;
+    struct kvec vec[2];
+    unsigned int nvec, i;
+    size_t off = 0;
+    ssize_t ret;
+
+    if (sink->aio_head - smp_load_acquire(&sink->aio_tail) >= GIH_AIO_DEPTH)
+        return -EAGAIN;
+
+    size = min(size, sink->aio_size);
+    if (sink->flags & GIH_SINK_F_DIRECT)
+        size = round_down(size, GIH_AIO_ALIGN);
+    if (size == 0)
+        return 0;
+
+    w = &sink->aio[sink->aio_head % GIH_AIO_DEPTH];
+
+    nvec = sink_kvec(kfifo_buf, size, vec);
+    for (i = 0; i < nvec; off += vec[i].iov_len, i++)
+        memcpy(w->buf + off, vec[i].iov_base, vec[i].iov_len);
+
+    /* done reading the data before giving the space back */
+    smp_mb();
+    kfifo_buf->kfifo.out += size;
+
+    w->len       = size;
+    w->res       = 0;
+    w->seq       = seq;
+    w->irq_stamp = irq_stamp;
+
+    init_sync_kiocb(&w->iocb, filp);
+    w->iocb.ki_pos      = sink->aio_pos;
+    w->iocb.ki_complete = sink_aio_complete;
+    sink->aio_pos += size;
+
+    iov_iter_bvec(&iter, ITER_BVEC | WRITE, w->bvec, 
+        DIV_ROUND_UP(size, PAGE_SIZE), size);
+
+    /* visible to the reaper before the completion can be */
+    smp_store_release(&sink->aio_head, sink->aio_head + 1);
+    atomic_inc(&sink->aio_busy);
+
+    w->issued = sink_aio_stamp(sink);
+
+    file_start_write(filp);
+    ret = filp->f_op->write_iter(&w->iocb, &iter);
+    file_end_write(filp);
+
+    if (ret != -EIOCBQUEUED)
+        sink_aio_complete(&w->iocb, ret, 0);
+
+    return size;
+}
+
+/*
+ * Function name: sink_aio_reap / sink_aio_release
+ *
+ * Function prototype:
+ *     static struct gih_aio * sink_aio_reap(gih_sink * sink);
+ *     static inline void sink_aio_release(gih_sink * sink);
+ *
+ * Description:
+ *     Consumer of the completions of the aio sink, in submission order: 
+ *     sink_aio_reap() gives the oldest write if it completed, 
+ *     sink_aio_release() gives it back to the pool.
+ *
+ * Arguments:
+ *     @sink: the sink
+ *
+ * Side Effects:
+ *     sink_aio_release() frees the oldest write for the output.
+ *
+ * Error Condition:
+ *     A single reaper at a time. A write completing early waits for the 
+ *     ones before it.
+ *
+ * Return:
+ *     sink_aio_reap(): the oldest write, NULL if none completed.
+ */
+static struct gih_aio * sink_aio_reap(gih_sink * sink) {
+    struct gih_aio * w;
+
+    if (!sink->aio || sink->aio_tail == smp_load_acquire(&sink->aio_head))
+        return NULL;
+
+    w = &sink->aio[sink->aio_tail % GIH_AIO_DEPTH];
+
+    return smp_load_acquire(&w->done) ? w : NULL;
+}
+
+static inline void sink_aio_release(gih_sink * sink) {
+    sink->aio[sink->aio_tail % GIH_AIO_DEPTH].done = false;
+    smp_store_release(&sink->aio_tail, sink->aio_tail + 1);
+}
+
+/*
+ * Function name: sink_aio_wait
+ *
+ * Function prototype:
+ *     static inline void sink_aio_wait(gih_sink * sink);
+ *
+ * Description:
+ *     Waits for all the writes in flight of the aio sink to complete.
+ *
+ * Arguments:
+ *     @sink: the sink
+ *
+ * Side Effects:
+ *     May sleep.
+ *
+ * Error Condition:
+ *     The output must be stopped, or more writes may be submitted.
+ *
+ * Return:
+ *     None.
+ */
+static inline void sink_aio_wait(gih_sink * sink) {
+    wait_event(sink->aio_wait, atomic_read(&sink->aio_busy) == 0);
+}
+
+/*
+ * Function name: sink_readable
+ *
+ * Function prototype:
+ *     static bool sink_readable(gih_sink * sink);
+ *
+ * Description:
+ *     Whether a reader of the mmap sink has output data to consume.
+ *
+ * Arguments:
+ *     @sink: the sink
+ *
+ * Side Effects:
+ *     None.
+ *
+ * Error Condition:
+ *     None.
+ *
+ * Return:
+ *     True if the output ring holds data, false otherwise.
+ */
+static inline bool sink_readable(gih_sink * sink) {
+    struct gih_ring_ctrl * ring = READ_ONCE(sink->ring);
+
+    return sink->type == GIH_SINK_MMAP && ring &&
+        READ_ONCE(ring->head) != READ_ONCE(ring->tail);
+}
+
+/*
+ * Function name: sink_open
+ *
+ * Function prototype:
+ *     static int sink_open(gih_sink * sink, const char * path,
+ *                          size_t ring_size, size_t out_size);
+ *
+ * Description:
+ *     Opens @sink as its type: opens the file at @path, connects the udp
+ *     socket to @path, sets up an empty output ring of @ring_size bytes, or
+ *     opens the file at @path with a pool of writes of @out_size bytes.
+ *
+ * Arguments:
+ *     @sink: the sink
+ *     @path: destination, by the type of @sink
+ *     @ring_size: size of the output ring of the mmap sink
+ *     @out_size: largest output, the size of a write of the aio sink
+ *
+ * Side Effects:
+ *     On success, the sink can be written to.
+ *
+ * Error Condition:
+ *     Failing to open the file returns -EBADF, for the other sinks their
+ *     error is returned (see sink_aio_open()).
+ *
+ * Return:
+ *     0 on success, -ERRORCODE on failure.
+ */
+static int sink_open(gih_sink * sink, const char * path, size_t ring_size,
+                     size_t out_size) {
+
+    switch (sink->type) {
+
+        case GIH_SINK_UDP:
+            return sink_udp_open(sink, path);
+
+        case GIH_SINK_MMAP:
+            return sink_ring_alloc(sink, ring_size);
+
+        case GIH_SINK_AIO:
+            return sink_aio_open(sink, path, out_size);
+
+        default:
+            sink->filp = file_open(path, O_WRONLY | O_NONBLOCK, S_IALLUGO);
+            return sink->filp ? 0 : -EBADF;
+    }
+}
+
+/*
+ * Function name: sink_write_kfifo
+ *
+ * Function prototype:
+ *     static int sink_write_kfifo(gih_sink * sink, struct kfifo * kfifo_buf,
+ *                                 size_t size);
+ *
+ * Description:
+ *     Sends @size bytes from @kfifo_buf to @sink, straight out of the
+ *     kfifo's buffer. The kfifo is only advanced by the number of bytes
+ *     actually taken by @sink, see file_write_kfifo() for the rules. The
+ *     aio sink takes a copy, see sink_aio_write().
+ *
+ * Arguments:
+ *     @sink: the sink, opened
+ *     @kfifo_buf: kfifo holding the data, element size must be 1 byte
+ *     @size: amount of data to send
+ *
+ * Side Effects:
+ *     Data is sent and removed from @kfifo_buf.
+ *
+ * Error Condition:
+ *     Must only be called by the consumer of @kfifo_buf, with @size no more
+ *     than the data the producer has published. On error nothing is
+ *     removed from @kfifo_buf.
+ *
+ * Return:
+ *     Number of bytes sent on success, -ERRORCODE otherwise.
+ */
+static int sink_write_kfifo(gih_sink * sink, struct kfifo * kfifo_buf,
+                            size_t size) {
+    struct kvec vec[2];
+    unsigned int nvec;
+    int ret;
+
+    if (sink->type == GIH_SINK_FILE)
+        return file_write_kfifo(sink->filp, kfifo_buf, size);
+
+    if (sink->type == GIH_SINK_AIO)
+        return sink_aio_write(sink, kfifo_buf, size, 0, 0);
+
+    nvec = sink_kvec(kfifo_buf, size, vec);
+    if (nvec == 0)
+        return 0;
+
+    if (sink->type == GIH_SINK_UDP)
+        ret = sink_udp_write(sink, vec, nvec, size);
+    else
+        ret = sink_ring_write(sink, vec, nvec, size);
+
+    if (ret > 0) {
+        /* done reading the data before giving the space back */
+        smp_mb();
+        kfifo_buf->kfifo.out += ret;
+    }
+
+    return ret;
+}
+
+/*
+ * Function name: sink_stage_kfifo / sink_commit
+ *
+ * Function prototype:
+ *     static bool sink_stage_kfifo(gih_sink * sink, struct kfifo * kfifo_buf,
+ *                                  size_t size);
+ *     static inline void sink_commit(gih_sink * sink);
+ *
+ * Description:
+ *     Two halves of sink_write_kfifo(), for sinks whose output can be built
+ *     ahead of time: sink_stage_kfifo() takes @size bytes from @kfifo_buf 
+ *     into @sink without sending them, sink_commit() sends what is staged.
+ *     Only the mmap sink stages, into its output ring past the published 
+ *     head, so that committing is publishing head.
+ *
+ * Arguments:
+ *     @sink: the sink, opened
+ *     @kfifo_buf: kfifo holding the data, element size must be 1 byte
+ *     @size: amount of data to stage
+ *
+ * Side Effects:
+ *     Staged data is removed from @kfifo_buf.
+ *
+ * Error Condition:
+ *     Nothing is staged for the other sinks, or if the output ring has no 
+ *     room for all of @size; the data is then left in @kfifo_buf for
+ *     sink_write_kfifo(). Same rules as sink_write_kfifo() otherwise.
+ *
+ * Return:
+ *     sink_stage_kfifo(): true if all of @size is staged, false if none.
+ */
+static bool sink_stage_kfifo(gih_sink * sink, struct kfifo * kfifo_buf,
+                             size_t size) {
+    struct kvec vec[2];
+    unsigned int nvec;
+    unsigned int used;
+
+    if (sink->type != GIH_SINK_MMAP || size == 0)
+        return false;
+
+    used = sink->head - smp_load_acquire(&sink->ring->tail);
+    if (used > sink->ring_size || sink->ring_size - used < size)
+        return false;
+
+    nvec = sink_kvec(kfifo_buf, size, vec);
+    sink_ring_copy(sink, vec, nvec, size);
+
+    /* done reading the data before giving the space back */
+    smp_mb();
+    kfifo_buf->kfifo.out += size;
+
+    return true;
+}
+
+static inline void sink_commit(gih_sink * sink) {
+    if (sink->type == GIH_SINK_MMAP)
+        sink_ring_publish(sink);
+}
+
+/*
+ * Function name: sink_flush_kfifo
+ *
+ * Function prototype:
+ *     static int sink_flush_kfifo(gih_sink * sink, struct kfifo * kfifo_buf,
+ *                                 size_t size);
+ *
+ * Description:
+ *     Sends the rest of the data, @size bytes from @kfifo_buf, as the 
+ *     device closes. The aio sink writes it synchronously after its last 
+ *     write and without O_DIRECT, so an unaligned tail is written too; the
+ *     other sinks as sink_write_kfifo().
+ *
+ * Arguments:
+ *     @sink: the sink, opened
+ *     @kfifo_buf: kfifo holding the data, element size must be 1 byte
+ *     @size: amount of data to send
+ *
+ * Side Effects:
+ *     Data is sent and removed from @kfifo_buf. The aio sink is left 
+ *     without O_DIRECT.
+ *
+ * Error Condition:
+ *     The writes of the aio sink must all be completed, see sink_aio_wait().
+ *     Same rules as sink_write_kfifo() otherwise.
+ *
+ * Return:
+ *     Number of bytes sent on success, -ERRORCODE otherwise.
+ */
+static int sink_flush_kfifo(gih_sink * sink, struct kfifo * kfifo_buf,
+                            size_t size) {
+    struct file * filp = sink->filp;
+    int ret;
+
+    if (sink->type != GIH_SINK_AIO)
+        return sink_write_kfifo(sink, kfifo_buf, size);
+
+    spin_lock(&filp->f_lock);
+    filp->f_flags &= ~O_DIRECT;
+    spin_unlock(&filp->f_lock);
+
+    filp->f_pos = sink->aio_pos;
+    ret = file_write_kfifo(filp, kfifo_buf, size);
+    if (ret > 0)
+        sink->aio_pos += ret;
+
+    return ret;
+}
+
+/*
+ * Function name: sink_sync
+ *
+ * Function prototype:
+ *     static int sink_sync(gih_sink * sink);
+ *
+ * Description:
+ *     Makes the data sent to @sink durable, only the file sinks have 
+ *     anything to do; for the aio sink, what's completed.
+ *
+ * Arguments:
+ *     @sink: the sink, opened
+ *
+ * Side Effects:
+ *     The file of the file sink is synced.
+ *
+ * Error Condition:
+ *     Errors of file_sync() are returned.
+ *
+ * Return:
+ *     0 on success, -ERRORCODE on failure.
+ */
+static inline int sink_sync(gih_sink * sink) {
+    return (sink->type == GIH_SINK_FILE || sink->type == GIH_SINK_AIO) ? 
+        file_sync(sink->filp) : 0;
+}
+
+/*
+ * Function name: sink_close
+ *
+ * Function prototype:
+ *     static void sink_close(gih_sink * sink);
+ *
+ * Description:
+ *     Closes @sink. The output ring of the mmap sink is kept, so a reader
+ *     can still drain it; it's freed by sink_free(). The aio sink waits for
+ *     its writes and frees its pool, their completions need to be reaped 
+ *     before.
+ *
+ * Arguments:
+ *     @sink: the sink, opened
+ *
+ * Side Effects:
+ *     The file is closed, or the socket released. May sleep.
+ *
+ * Error Condition:
+ *     None.
+ *
+ * Return:
+ *     None.
+ */
+static void sink_close(gih_sink * sink) {
+
+    if (sink->aio) {
+        sink_aio_wait(sink);
+        sink_aio_free(sink);
+    }
+
+    if (sink->filp) {
+        file_close(sink->filp);
+        sink->filp = NULL;
+    }
+
+    if (sink->sock) {
+        sock_release(sink->sock);
+        sink->sock = NULL;
+    }
+}
+
+/*
+ * Function name: sink_free
+ *
+ * Function prototype:
+ *     static void sink_free(gih_sink * sink);
+ *
+ * Description:
+ *     Frees the output ring of @sink.
+ *
+ * Arguments:
+ *     @sink: the sink, closed
+ *
+ * Side Effects:
+ *     The output ring is freed.
+ *
+ * Error Condition:
+ *     The ring must not be mapped anymore.
+ *
+ * Return:
+ *     None.
+ */
+static inline void sink_free(gih_sink * sink) {
+    vfree(sink->ring);
+    sink->ring = NULL;
+    mutex_destroy(&sink->ring_lock);
+}
+
+/*
+ * Function name: sink_vm_open / sink_vm_close
+ *
+ * Function prototype:
+ *     static void sink_vm_open(struct vm_area_struct * vma);
+ *     static void sink_vm_close(struct vm_area_struct * vma);
+ *
+ * Description:
+ *     Count the mappings of the output ring, it's not reallocated while
+ *     mapped.
+ *
+ * Arguments:
+ *     @vma: the mapping
+ *
+ * Side Effects:
+ *     The mapped count of the sink is changed.
+ *
+ * Error Condition:
+ *     None.
+ *
+ * Return:
+ *     None.
+ */
+static void sink_vm_open(struct vm_area_struct * vma) {
+    gih_sink * sink = vma->vm_private_data;
+    atomic_inc(&sink->mapped);
+}
+
+static void sink_vm_close(struct vm_area_struct * vma) {
+    gih_sink * sink = vma->vm_private_data;
+    atomic_dec(&sink->mapped);
+}
+
+static const struct vm_operations_struct sink_vm_ops = {
+    .open               = sink_vm_open,
+    .close              = sink_vm_close
+};
+
+/*
+ * Function name: sink_mmap
+ *
+ * Function prototype:
+ *     static int sink_mmap(gih_sink * sink, struct vm_area_struct * vma);
+ *
+ * Description:
+ *     Maps the output ring of the mmap sink into user space: the control
+ *     page followed by the ring at data_off. The reader consumes from
+ *     tail & (size - 1) up to head, then publishes the new tail.
+ *
+ * Arguments:
+ *     @sink: the sink
+ *     @vma: virtual memory area to map the ring into
+ *
+ * Side Effects:
+ *     The ring is mapped to @vma, it's kept until unmapped.
+ *
+ * Error Condition:
+ *     Mapping before the mmap sink was first started returns -ENODEV, more
+ *     than the control page and the ring -EINVAL.
+ *
+ * Return:
+ *     0 on success, -ERRORCODE on failure.
+ */
+static int sink_mmap(gih_sink * sink, struct vm_area_struct * vma) {
+    unsigned long size = vma->vm_end - vma->vm_start;
+    int error;
+
+    mutex_lock(&sink->ring_lock);
+
+    if (!sink->ring) {
+        mutex_unlock(&sink->ring_lock);
+        return -ENODEV;
+    }
+
+    if (size > PAGE_SIZE + sink->ring_size) {
+        mutex_unlock(&sink->ring_lock);
+        return -EINVAL;
+    }
+
+    error = remap_vmalloc_range(vma, sink->ring, 0);
+    if (!error) {
+        vma->vm_ops = &sink_vm_ops;
+        vma->vm_private_data = sink;
+        sink_vm_open(vma);
+    }
+
+    mutex_unlock(&sink->ring_lock);
+    return error;
+}
+
+#endif
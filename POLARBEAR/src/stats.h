@@ -0,0 +1,82 @@
+/*
+ * Filename: stats.h
+ * Author: Weiyang Wang
+ * Description: drop accounting counters of the gih device. Counters are kept
+ *              per CPU and only ever added to by the CPU they belong to, with
+ *              this_cpu operations, so counting takes no lock and is safe in
+ *              any context. Readers add up all the CPUs. See GIH_STAT_* in
+ *              gih.h.
+ * Date: Oct 14, 2026
+ */
+
+#ifndef _STATS_H
+#define _STATS_H
+
+/*
+ * Function name: stat_add / stat_inc
+ *
+ * Function prototype:
+ *     static inline void stat_add(struct gih_stats __percpu * stats,
+ *                                 int stat, u64 v);
+ *     static inline void stat_inc(struct gih_stats __percpu * stats,
+ *                                 int stat);
+ *
+ * Description:
+ *     Adds @v, or 1, to counter @stat of the current CPU.
+ *
+ * Arguments:
+ *     @stats: the per CPU counters
+ *     @stat: GIH_STAT_*
+ *     @v: the amount
+ *
+ * Side Effects:
+ *     The counter of this CPU is updated.
+ *
+ * Error Condition:
+ *     None.
+ *
+ * Return:
+ *     None.
+ */
+static inline void stat_add(struct gih_stats __percpu * stats, int stat,
+                            u64 v) {
+    this_cpu_add(stats->count[stat], v);
+}
+
+static inline void stat_inc(struct gih_stats __percpu * stats, int stat) {
+    this_cpu_inc(stats->count[stat]);
+}
+
+/*
+ * Function name: stat_sum
+ *
+ * Function prototype:
+ *     static u64 stat_sum(struct gih_stats __percpu * stats, int stat);
+ *
+ * Description:
+ *     Counter @stat of the instance, added up over all the CPUs.
+ *
+ * Arguments:
+ *     @stats: the per CPU counters
+ *     @stat: GIH_STAT_*
+ *
+ * Side Effects:
+ *     None.
+ *
+ * Error Condition:
+ *     Not a snapshot, what's counted at the same time may or may not be in.
+ *
+ * Return:
+ *     The sum.
+ */
+static u64 stat_sum(struct gih_stats __percpu * stats, int stat) {
+    u64 sum = 0;
+    int cpu;
+
+    for_each_possible_cpu(cpu)
+        sum += per_cpu_ptr(stats, cpu)->count[stat];
+
+    return sum;
+}
+
+#endif